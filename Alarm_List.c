@@ -0,0 +1,410 @@
+#include <pthread.h>
+#include "errors.h"
+#include "types.h"
+#include "Hash.h"
+#include "Alarm_Request.h"
+#include "Alarm_List.h"
+
+#define INITIAL_NUMBER_OF_BUCKETS 64
+
+/**
+ * Allocates an array of empty buckets.
+ */
+static void *allocate_buckets(size_t number_of_buckets) {
+    void *buckets = calloc(number_of_buckets, sizeof(void *));
+    if (buckets == NULL) {
+        errno_abort("Calloc failed");
+    }
+
+    return buckets;
+}
+
+void alarm_list_init(alarm_list_t *list) {
+    memset(list, 0, sizeof(alarm_list_t));
+
+    list->number_of_id_buckets = INITIAL_NUMBER_OF_BUCKETS;
+    list->id_buckets = allocate_buckets(list->number_of_id_buckets);
+
+    list->number_of_time_buckets = INITIAL_NUMBER_OF_BUCKETS;
+    list->time_buckets = allocate_buckets(list->number_of_time_buckets);
+
+    list->free_request = free_alarm_request;
+}
+
+/*******************************************************************************
+ *                              ALARM ID INDEX                                 *
+ ******************************************************************************/
+
+/**
+ * Adds the alarm request to the front of its bucket in the alarm ID index.
+ */
+static void add_to_id_index(alarm_list_t *list, alarm_request_t *alarm_request) {
+    alarm_request_t **bucket = &list->id_buckets[
+        hash_key(alarm_request->alarm_id, list->number_of_id_buckets)
+    ];
+
+    alarm_request->id_hash_prev = NULL;
+    alarm_request->id_hash_next = *bucket;
+    if (*bucket != NULL) {
+        (*bucket)->id_hash_prev = alarm_request;
+    }
+    *bucket = alarm_request;
+}
+
+/**
+ * Removes the alarm request from its bucket in the alarm ID index.
+ */
+static void remove_from_id_index(alarm_list_t *list, alarm_request_t *alarm_request) {
+    if (alarm_request->id_hash_prev != NULL) {
+        alarm_request->id_hash_prev->id_hash_next = alarm_request->id_hash_next;
+    } else {
+        list->id_buckets[
+            hash_key(alarm_request->alarm_id, list->number_of_id_buckets)
+        ] = alarm_request->id_hash_next;
+    }
+
+    if (alarm_request->id_hash_next != NULL) {
+        alarm_request->id_hash_next->id_hash_prev = alarm_request->id_hash_prev;
+    }
+
+    alarm_request->id_hash_next = NULL;
+    alarm_request->id_hash_prev = NULL;
+}
+
+/**
+ * Doubles the number of buckets in the alarm ID index once there are more
+ * alarm requests than buckets, so that buckets stay short.
+ */
+static void grow_id_index(alarm_list_t *list) {
+    alarm_request_t *alarm_request;
+
+    free(list->id_buckets);
+    list->number_of_id_buckets *= 2;
+    list->id_buckets = allocate_buckets(list->number_of_id_buckets);
+
+    for (alarm_request = list->header.next;
+         alarm_request != NULL;
+         alarm_request = alarm_request->next) {
+        add_to_id_index(list, alarm_request);
+    }
+}
+
+alarm_request_t *find_newest_alarm_request(alarm_list_t *list, int alarm_id) {
+    alarm_request_t *alarm_request = list->id_buckets[
+        hash_key(alarm_id, list->number_of_id_buckets)
+    ];
+    alarm_request_t *newest_alarm_request = NULL;
+
+    while (alarm_request != NULL) {
+        if (alarm_request->alarm_id == alarm_id
+            && (newest_alarm_request == NULL
+                || alarm_request->sequence_number > newest_alarm_request->sequence_number)) {
+            newest_alarm_request = alarm_request;
+        }
+
+        alarm_request = alarm_request->id_hash_next;
+    }
+
+    return newest_alarm_request;
+}
+
+/*******************************************************************************
+ *                             TIME VALUE INDEX                                *
+ ******************************************************************************/
+
+/**
+ * Returns the group of alarm requests with the given time value, or NULL if
+ * there are no alarm requests with that time value in the list.
+ */
+static alarm_time_group_t *find_time_group(alarm_list_t *list, int time) {
+    alarm_time_group_t *group = list->time_buckets[
+        hash_key(time, list->number_of_time_buckets)
+    ];
+
+    while (group != NULL && group->time != time) {
+        group = group->hash_next;
+    }
+
+    return group;
+}
+
+/**
+ * Doubles the number of buckets in the time value index once there are more
+ * time groups than buckets.
+ */
+static void grow_time_index(alarm_list_t *list) {
+    alarm_time_group_t *group;
+    size_t bucket;
+
+    free(list->time_buckets);
+    list->number_of_time_buckets *= 2;
+    list->time_buckets = allocate_buckets(list->number_of_time_buckets);
+
+    for (group = list->time_group_header.next; group != NULL; group = group->next) {
+        bucket = hash_key(group->time, list->number_of_time_buckets);
+        group->hash_next = list->time_buckets[bucket];
+        list->time_buckets[bucket] = group;
+    }
+}
+
+/**
+ * Creates a group for the given time value, and inserts it after the given
+ * group (which must have the largest time value smaller than the given one, or
+ * be the list's time_group_header).
+ */
+static alarm_time_group_t *create_time_group_after(
+    alarm_list_t *list,
+    int time,
+    alarm_time_group_t *previous
+) {
+    alarm_time_group_t *group;
+    size_t bucket;
+
+    if (list->number_of_time_groups >= list->number_of_time_buckets) {
+        grow_time_index(list);
+    }
+
+    group = malloc(sizeof(alarm_time_group_t));
+    if (group == NULL) {
+        errno_abort("Malloc failed");
+    }
+
+    group->time = time;
+    group->last = NULL;
+    group->prev = previous;
+    group->next = previous->next;
+    if (previous->next != NULL) {
+        previous->next->prev = group;
+    }
+    previous->next = group;
+
+    bucket = hash_key(time, list->number_of_time_buckets);
+    group->hash_next = list->time_buckets[bucket];
+    list->time_buckets[bucket] = group;
+    list->number_of_time_groups++;
+
+    return group;
+}
+
+/**
+ * Creates a group for the given time value. The group is inserted after the
+ * group with the largest time value smaller than the given one, which is
+ * returned through the previous_group parameter (it is the list's
+ * time_group_header if there is no such group).
+ */
+static alarm_time_group_t *create_time_group(
+    alarm_list_t *list,
+    int time,
+    alarm_time_group_t **previous_group
+) {
+    alarm_time_group_t *previous = &list->time_group_header;
+
+    /*
+     * Find where the group goes. This only walks the groups (one per distinct
+     * time value), not the alarm requests.
+     */
+    while (previous->next != NULL && previous->next->time < time) {
+        previous = previous->next;
+    }
+
+    *previous_group = previous;
+    return create_time_group_after(list, time, previous);
+}
+
+/**
+ * Removes and frees an empty time group.
+ */
+static void destroy_time_group(alarm_list_t *list, alarm_time_group_t *group) {
+    alarm_time_group_t **bucket = &list->time_buckets[
+        hash_key(group->time, list->number_of_time_buckets)
+    ];
+
+    group->prev->next = group->next;
+    if (group->next != NULL) {
+        group->next->prev = group->prev;
+    }
+
+    while (*bucket != group) {
+        bucket = &(*bucket)->hash_next;
+    }
+    *bucket = group->hash_next;
+
+    list->number_of_time_groups--;
+    free(group);
+}
+
+/*******************************************************************************
+ *                               ALARM LIST                                    *
+ ******************************************************************************/
+
+void insert_to_alarm_list(alarm_list_t *list, alarm_request_t *alarm_request) {
+    alarm_time_group_t *group = find_time_group(list, alarm_request->time);
+    alarm_time_group_t *previous_group;
+    alarm_request_t *current;
+
+    /*
+     * Find the alarm request to insert after. If there are already alarm
+     * requests with this time value, it goes after the last of them. If not,
+     * it goes after the last alarm request of the group before it.
+     */
+    if (group != NULL) {
+        current = group->last;
+    } else {
+        group = create_time_group(list, alarm_request->time, &previous_group);
+        current = previous_group == &list->time_group_header
+            ? &list->header
+            : previous_group->last;
+    }
+
+    alarm_request->prev = current;
+    alarm_request->next = current->next;
+    if (current->next != NULL) {
+        current->next->prev = alarm_request;
+    }
+    current->next = alarm_request;
+
+    group->last = alarm_request;
+
+    /*
+     * Add it to the alarm ID index
+     */
+    list->length++;
+    if (list->length > list->number_of_id_buckets) {
+        grow_id_index(list);
+    } else {
+        add_to_id_index(list, alarm_request);
+    }
+}
+
+bool bulk_insert_to_alarm_list(
+    alarm_list_t *list,
+    alarm_request_t *alarm_requests[],
+    size_t number_of_alarm_requests
+) {
+    alarm_time_group_t *group = &list->time_group_header;
+    alarm_request_t *current = &list->header;
+    alarm_request_t *alarm_request;
+    alarm_request_t *other;
+    size_t number_of_id_buckets = list->number_of_id_buckets;
+
+    /*
+     * Size the alarm ID index for all of them at once, instead of doubling it
+     * (and adding everything to it again) as they are inserted.
+     */
+    while (number_of_id_buckets < number_of_alarm_requests) {
+        number_of_id_buckets *= 2;
+    }
+    if (number_of_id_buckets > list->number_of_id_buckets) {
+        free(list->id_buckets);
+        list->number_of_id_buckets = number_of_id_buckets;
+        list->id_buckets = allocate_buckets(list->number_of_id_buckets);
+    }
+
+    for (size_t i = 0; i < number_of_alarm_requests; i++) {
+        alarm_request = alarm_requests[i];
+
+        /*
+         * The alarm requests are sorted by time value, so each one goes at the
+         * end of the list, and a new group is only needed when the time value
+         * changes.
+         */
+        if (group == &list->time_group_header || group->time != alarm_request->time) {
+            group = create_time_group_after(list, alarm_request->time, group);
+        }
+
+        for (other = list->id_buckets[hash_key(alarm_request->alarm_id, list->number_of_id_buckets)];
+             other != NULL;
+             other = other->id_hash_next) {
+            if (other->alarm_id == alarm_request->alarm_id) {
+                return false;
+            }
+        }
+
+        alarm_request->prev = current;
+        alarm_request->next = NULL;
+        current->next = alarm_request;
+        current = alarm_request;
+        group->last = alarm_request;
+
+        add_to_id_index(list, alarm_request);
+        list->length++;
+    }
+
+    return true;
+}
+
+void unlink_from_alarm_list(alarm_list_t *list, alarm_request_t *alarm_request) {
+    alarm_time_group_t *group = find_time_group(list, alarm_request->time);
+
+    /*
+     * If it was the last alarm request of its time group, the one before it
+     * becomes the last (or the group is now empty).
+     */
+    if (group->last == alarm_request) {
+        if (alarm_request->prev != &list->header
+            && alarm_request->prev->time == alarm_request->time) {
+            group->last = alarm_request->prev;
+        } else {
+            destroy_time_group(list, group);
+        }
+    }
+
+    alarm_request->prev->next = alarm_request->next;
+    if (alarm_request->next != NULL) {
+        alarm_request->next->prev = alarm_request->prev;
+    }
+    alarm_request->next = NULL;
+    alarm_request->prev = NULL;
+
+    remove_from_id_index(list, alarm_request);
+    list->length--;
+}
+
+void remove_alarm_requests_from_list(alarm_list_t *list, alarm_request_t *alarm_request) {
+    int alarm_id = alarm_request->alarm_id;
+    unsigned long sequence_number = alarm_request->sequence_number;
+    alarm_request_t *alarm_node = list->id_buckets[
+        hash_key(alarm_id, list->number_of_id_buckets)
+    ];
+    alarm_request_t *alarm_temp;
+
+    /*
+     * Only the bucket of the alarm ID needs to be searched.
+     */
+    while (alarm_node != NULL) {
+        alarm_temp = alarm_node;
+        alarm_node = alarm_node->id_hash_next;
+
+        if (alarm_temp->alarm_id == alarm_id
+            && alarm_temp->sequence_number <= sequence_number) {
+            unlink_from_alarm_list(list, alarm_temp);
+            list->free_request(alarm_temp);
+        }
+    }
+}
+
+int remove_old_alarm_requests_from_list(alarm_list_t *list, int alarm_id, alarm_request_t *newest_alarm_request) {
+    alarm_request_t *alarm_node = list->id_buckets[
+        hash_key(alarm_id, list->number_of_id_buckets)
+    ];
+    alarm_request_t *alarm_temp;
+    int old_time_value = -1;
+
+    /*
+     * Only the bucket of the alarm ID needs to be searched.
+     */
+    while (alarm_node != NULL) {
+        alarm_temp = alarm_node;
+        alarm_node = alarm_node->id_hash_next;
+
+        if (alarm_temp->alarm_id == alarm_id
+            && alarm_temp != newest_alarm_request
+            && alarm_temp->sequence_number < newest_alarm_request->sequence_number) {
+            old_time_value = alarm_temp->time;
+            unlink_from_alarm_list(list, alarm_temp);
+            list->free_request(alarm_temp);
+        }
+    }
+
+    return old_time_value;
+}
@@ -0,0 +1,123 @@
+#ifndef ALARM_LIST_H
+#define ALARM_LIST_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * A group of alarm requests in an alarm list that have the same time value.
+ *
+ * Because the list is sorted by time value, the alarm requests in a group are
+ * next to each other in the list. The group remembers the last one so that new
+ * alarm requests with the same time value can be inserted without walking the
+ * list.
+ */
+typedef struct alarm_time_group_t {
+    int time;
+    alarm_request_t *last;
+    struct alarm_time_group_t *next;      // Next group (sorted by time value).
+    struct alarm_time_group_t *prev;      // Previous group.
+    struct alarm_time_group_t *hash_next; // Next group in the same bucket.
+} alarm_time_group_t;
+
+/**
+ * A list of alarm requests sorted by time value, with an index on alarm ID and
+ * an index on time value.
+ *
+ * The alarm requests are linked together through their next and prev
+ * pointers, starting from header.next (header is never a real alarm request).
+ * The alarm ID index is a hash table whose buckets are chained through the
+ * id_hash_next and id_hash_prev pointers of the alarm requests themselves, so
+ * looking up or unlinking an alarm request takes constant time and does not
+ * allocate anything.
+ *
+ * Alarm requests that are removed from the list are freed with the list's
+ * free_request function, which is free_alarm_request unless the owner of the
+ * list changes it (for example, to delay freeing them until no other thread
+ * can still be reading them).
+ *
+ * An alarm list is not thread-safe. The caller must make sure that only one
+ * thread modifies it at a time, and that no thread reads it while it is being
+ * modified.
+ */
+typedef struct alarm_list_t {
+    alarm_request_t header;
+
+    alarm_request_t **id_buckets;
+    size_t number_of_id_buckets;
+
+    alarm_time_group_t time_group_header;
+    alarm_time_group_t **time_buckets;
+    size_t number_of_time_buckets;
+    size_t number_of_time_groups;
+
+    size_t length;
+
+    void (*free_request)(alarm_request_t *alarm_request);
+} alarm_list_t;
+
+/**
+ * Initializes an empty alarm list.
+ */
+void alarm_list_init(alarm_list_t *list);
+
+/**
+ * A.3.2. Inserts the alarm request in its specified position in the alarm list
+ * (sorted by their time values). Alarm requests with the same time value stay
+ * in the order they were inserted.
+ */
+void insert_to_alarm_list(alarm_list_t *list, alarm_request_t *alarm_request);
+
+/**
+ * Inserts alarm requests into an empty alarm list all at once. They must be
+ * sorted by time value, and have distinct alarm IDs. The indices are built as
+ * they are appended, so this is faster than inserting them one at a time.
+ * Returns false (leaving only the ones before it in the list) if one of them
+ * has the same alarm ID as one before it.
+ */
+bool bulk_insert_to_alarm_list(
+    alarm_list_t *list,
+    alarm_request_t *alarm_requests[],
+    size_t number_of_alarm_requests
+);
+
+/**
+ * Unlinks the alarm request from the alarm list and its indices, without
+ * freeing it.
+ */
+void unlink_from_alarm_list(alarm_list_t *list, alarm_request_t *alarm_request);
+
+/**
+ * Returns the alarm request with the given alarm ID that has the largest
+ * sequence number (the one that was inserted most recently), or NULL if there
+ * are no alarm requests with the given alarm ID.
+ */
+alarm_request_t *find_newest_alarm_request(alarm_list_t *list, int alarm_id);
+
+/**
+ * A.3.3.2. Removes all alarm requests with the same alarm id as the given
+ * alarm request from the list of alarms, including the given alarm request if
+ * it is in the list.
+ *
+ * Only alarm requests that were inserted before the given alarm request (that
+ * have a smaller sequence number) are removed, so that requests for the same
+ * alarm id that have not been handled yet stay in the list.
+ *
+ * Note that THIS METHOD WILL FREE ALARM REQUESTS THAT ARE FOUND, so don't keep
+ * references to the alarm list entries.
+ */
+void remove_alarm_requests_from_list(alarm_list_t *list, alarm_request_t *alarm_request);
+
+/**
+ * A.3.3.3. Removes all alarm requests with the given alarm id from the list of
+ * alarms that were inserted before the given alarm request (that have a
+ * smaller sequence number). The time value of the old alarm request that was
+ * removed is returned (so that the alarm thread can use it to check for
+ * periodic display threads). If no alarms were removed, then -1 is returned.
+ *
+ * Note that THIS METHOD WILL FREE ALARM REQUESTS THAT ARE FOUND, so don't keep
+ * references to the alarm list entries.
+ */
+int remove_old_alarm_requests_from_list(alarm_list_t *list, int alarm_id, alarm_request_t *newest_alarm_request);
+
+#endif
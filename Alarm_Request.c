@@ -0,0 +1,10 @@
+#include <pthread.h>
+#include "errors.h"
+#include "types.h"
+#include "Alarm_Request.h"
+
+object_pool_t alarm_request_pool;
+
+void alarm_request_pool_init(void) {
+    object_pool_init(&alarm_request_pool, "alarm_request_t", sizeof(alarm_request_t));
+}
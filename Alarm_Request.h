@@ -0,0 +1,38 @@
+#ifndef ALARM_REQUEST_H
+#define ALARM_REQUEST_H
+
+#include "Object_Pool.h"
+
+/**
+ * The pool that every alarm request is allocated from. It must be initialized
+ * with alarm_request_pool_init before any alarm request is allocated.
+ */
+extern object_pool_t alarm_request_pool;
+
+/**
+ * Initializes the alarm request pool.
+ */
+void alarm_request_pool_init(void);
+
+/**
+ * Allocates an alarm request from the alarm request pool. The alarm request is
+ * not initialized.
+ */
+static inline alarm_request_t *allocate_alarm_request(void) {
+    return object_pool_allocate(&alarm_request_pool);
+}
+
+/**
+ * Releases the alarm request's message and gives the alarm request back to the
+ * alarm request pool. Nothing happens if the alarm request is NULL.
+ */
+static inline void free_alarm_request(alarm_request_t *alarm_request) {
+    if (alarm_request == NULL) {
+        return;
+    }
+
+    message_release(alarm_request->message);
+    object_pool_free(&alarm_request_pool, alarm_request);
+}
+
+#endif
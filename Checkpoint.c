@@ -0,0 +1,267 @@
+#include <fcntl.h>
+#include <libgen.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "errors.h"
+#include "types.h"
+#include "Checkpoint.h"
+
+#define CHECKPOINT_MAGIC "ALARMCKP"
+#define CHECKPOINT_VERSION 1
+#define WRITE_BUFFER_SIZE (1 << 20)
+
+/*******************************************************************************
+ *                           HELPER FUNCTIONS                                  *
+ ******************************************************************************/
+
+/**
+ * Numbers the distinct messages of the alarms in the order they first appear.
+ * Messages are interned, so two alarms have the same message exactly when
+ * they have the same pointer. Sets the index of each alarm's message, and
+ * returns the messages (which must be freed) and their number.
+ */
+static message_t **number_messages(
+    const checkpoint_alarm_t alarms[],
+    size_t number_of_alarms,
+    uint32_t indices[],
+    size_t *number_of_messages
+) {
+    size_t table_size = 16;
+    message_t **table;
+    uint32_t *table_indices;
+    message_t **messages;
+    size_t bucket;
+
+    while (table_size < 2 * number_of_alarms) {
+        table_size *= 2;
+    }
+
+    table = calloc(table_size, sizeof(message_t *));
+    table_indices = malloc(table_size * sizeof(uint32_t));
+    messages = malloc((number_of_alarms > 0 ? number_of_alarms : 1) * sizeof(message_t *));
+    if (table == NULL || table_indices == NULL || messages == NULL) {
+        errno_abort("Malloc failed");
+    }
+
+    *number_of_messages = 0;
+    for (size_t i = 0; i < number_of_alarms; i++) {
+        bucket = (size_t) (alarms[i].message->hash & (table_size - 1));
+        while (table[bucket] != NULL && table[bucket] != alarms[i].message) {
+            bucket = (bucket + 1) & (table_size - 1);
+        }
+
+        if (table[bucket] == NULL) {
+            table[bucket] = alarms[i].message;
+            table_indices[bucket] = *number_of_messages;
+            messages[(*number_of_messages)++] = alarms[i].message;
+        }
+        indices[i] = table_indices[bucket];
+    }
+
+    free(table);
+    free(table_indices);
+
+    return messages;
+}
+
+/**
+ * Syncs the directory that holds the given path, so that a rename in it is
+ * durable.
+ */
+static int sync_directory(const char *path) {
+    char copy[PATH_MAX];
+    int fd;
+    int status = 0;
+
+    snprintf(copy, sizeof(copy), "%s", path);
+    fd = open(dirname(copy), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return errno;
+    }
+    if (fsync(fd) != 0) {
+        status = errno;
+    }
+    close(fd);
+
+    return status;
+}
+
+/**
+ * Exits with a message about a checkpoint that cannot be loaded.
+ */
+static void invalid_checkpoint(const char *path, const char *reason) {
+    fprintf(stderr, "%s is not a valid checkpoint: %s\n", path, reason);
+    exit(1);
+}
+
+/*******************************************************************************
+ *                              PUBLIC FUNCTIONS                               *
+ ******************************************************************************/
+
+int checkpoint_write(const char *path, const checkpoint_alarm_t alarms[], size_t number_of_alarms) {
+    char temporary_path[PATH_MAX];
+    checkpoint_header_t header;
+    checkpoint_record_t record;
+    checkpoint_message_t message;
+    message_t **messages;
+    uint32_t *indices;
+    size_t number_of_messages;
+    FILE *file;
+    int status = 0;
+
+    if (snprintf(temporary_path, sizeof(temporary_path), "%s.tmp", path) >= (int) sizeof(temporary_path)) {
+        return ENAMETOOLONG;
+    }
+
+    indices = malloc((number_of_alarms > 0 ? number_of_alarms : 1) * sizeof(uint32_t));
+    if (indices == NULL) {
+        errno_abort("Malloc failed");
+    }
+    messages = number_messages(alarms, number_of_alarms, indices, &number_of_messages);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.number_of_alarms = number_of_alarms;
+    header.number_of_messages = number_of_messages;
+    for (size_t i = 0; i < number_of_messages; i++) {
+        header.text_size += messages[i]->length;
+    }
+
+    file = fopen(temporary_path, "w");
+    if (file == NULL) {
+        status = errno;
+        goto done;
+    }
+    setvbuf(file, NULL, _IOFBF, WRITE_BUFFER_SIZE);
+
+    fwrite(&header, sizeof(header), 1, file);
+
+    for (size_t i = 0; i < number_of_alarms; i++) {
+        record.alarm_id = alarms[i].alarm_id;
+        record.time = alarms[i].time;
+        record.type = alarms[i].type;
+        record.message = indices[i];
+        fwrite(&record, sizeof(record), 1, file);
+    }
+
+    message.offset = 0;
+    for (size_t i = 0; i < number_of_messages; i++) {
+        message.length = messages[i]->length;
+        fwrite(&message, sizeof(message), 1, file);
+        message.offset += message.length;
+    }
+
+    for (size_t i = 0; i < number_of_messages; i++) {
+        fwrite(messages[i]->text, 1, messages[i]->length, file);
+    }
+
+    if (fflush(file) != 0 || ferror(file) || fsync(fileno(file)) != 0) {
+        status = errno != 0 ? errno : EIO;
+        fclose(file);
+        unlink(temporary_path);
+        goto done;
+    }
+    if (fclose(file) != 0) {
+        status = errno;
+        unlink(temporary_path);
+        goto done;
+    }
+
+    if (rename(temporary_path, path) != 0) {
+        status = errno;
+        unlink(temporary_path);
+        goto done;
+    }
+    status = sync_directory(path);
+
+done:
+    free(messages);
+    free(indices);
+
+    return status;
+}
+
+bool checkpoint_map(checkpoint_t *checkpoint, const char *path) {
+    const checkpoint_header_t *header;
+    struct stat status;
+    size_t expected_size;
+    int fd;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT) {
+            return false;
+        }
+        errno_abort("Checkpoint open failed");
+    }
+    if (fstat(fd, &status) != 0) {
+        errno_abort("Checkpoint fstat failed");
+    }
+    if ((size_t) status.st_size < sizeof(checkpoint_header_t)) {
+        invalid_checkpoint(path, "too short");
+    }
+
+    /*
+     * The whole file is read in one pass while it is loaded, so it is read
+     * in up front rather than one page fault at a time.
+     */
+    checkpoint->size = status.st_size;
+    checkpoint->mapping = mmap(NULL, checkpoint->size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    if (checkpoint->mapping == MAP_FAILED) {
+        errno_abort("Checkpoint mmap failed");
+    }
+    close(fd);
+
+    header = checkpoint->mapping;
+    if (memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic)) != 0) {
+        invalid_checkpoint(path, "wrong magic number");
+    }
+    if (header->version != CHECKPOINT_VERSION) {
+        invalid_checkpoint(path, "unknown version");
+    }
+
+    expected_size = sizeof(checkpoint_header_t)
+        + header->number_of_alarms * sizeof(checkpoint_record_t)
+        + header->number_of_messages * sizeof(checkpoint_message_t)
+        + header->text_size;
+    if (header->number_of_alarms > INT_MAX
+        || header->number_of_messages > header->number_of_alarms
+        || header->text_size > checkpoint->size
+        || expected_size != checkpoint->size) {
+        invalid_checkpoint(path, "wrong size");
+    }
+
+    checkpoint->number_of_alarms = header->number_of_alarms;
+    checkpoint->records = (const checkpoint_record_t *) (header + 1);
+    checkpoint->number_of_messages = header->number_of_messages;
+    checkpoint->messages = (const checkpoint_message_t *) (checkpoint->records + checkpoint->number_of_alarms);
+    checkpoint->text = (const char *) (checkpoint->messages + checkpoint->number_of_messages);
+
+    /*
+     * Check everything that the records point to, so that loading them does
+     * not have to.
+     */
+    for (size_t i = 0; i < checkpoint->number_of_messages; i++) {
+        if (checkpoint->messages[i].offset > header->text_size
+            || checkpoint->messages[i].length > header->text_size - checkpoint->messages[i].offset) {
+            invalid_checkpoint(path, "message out of bounds");
+        }
+    }
+    for (size_t i = 0; i < checkpoint->number_of_alarms; i++) {
+        if (checkpoint->records[i].message >= checkpoint->number_of_messages
+            || (checkpoint->records[i].type != Start_Alarm
+                && checkpoint->records[i].type != Change_Alarm)
+            || checkpoint->records[i].time <= 0
+            || (i > 0 && checkpoint->records[i].time < checkpoint->records[i - 1].time)) {
+            invalid_checkpoint(path, "bad alarm record");
+        }
+    }
+
+    return true;
+}
+
+void checkpoint_unmap(checkpoint_t *checkpoint) {
+    munmap(checkpoint->mapping, checkpoint->size);
+}
@@ -0,0 +1,88 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * A checkpoint is a file that holds every alarm in the alarm list, in a
+ * layout that is read in place through mmap:
+ *
+ *   checkpoint_header_t
+ *   checkpoint_record_t[number_of_alarms]        (sorted by time value)
+ *   checkpoint_message_t[number_of_messages]
+ *   the text of the messages, one after the other
+ *
+ * Each distinct message is stored once, and the records refer to it by its
+ * index, so loading a checkpoint interns each message once however many
+ * alarms have it. All the numbers are in the byte order of the machine that
+ * wrote the checkpoint.
+ */
+typedef struct checkpoint_header_t {
+    char magic[8];                  // CHECKPOINT_MAGIC, without the
+                                    // terminating zero.
+    uint32_t version;
+    uint32_t unused;
+    uint64_t number_of_alarms;
+    uint64_t number_of_messages;
+    uint64_t text_size;
+} checkpoint_header_t;
+
+typedef struct checkpoint_record_t {
+    int32_t alarm_id;
+    int32_t time;                   // In milliseconds.
+    uint32_t type;                  // Start_Alarm or Change_Alarm.
+    uint32_t message;               // Index in the message table.
+} checkpoint_record_t;
+
+typedef struct checkpoint_message_t {
+    uint64_t offset;                // In the text.
+    uint64_t length;
+} checkpoint_message_t;
+
+/**
+ * An alarm to write to a checkpoint.
+ */
+typedef struct checkpoint_alarm_t {
+    int alarm_id;
+    int time;
+    request_type type;
+    message_t *message;
+} checkpoint_alarm_t;
+
+/**
+ * A checkpoint mapped into memory.
+ */
+typedef struct checkpoint_t {
+    void *mapping;
+    size_t size;
+    size_t number_of_alarms;
+    const checkpoint_record_t *records;
+    size_t number_of_messages;
+    const checkpoint_message_t *messages;
+    const char *text;
+} checkpoint_t;
+
+/**
+ * Writes a checkpoint of the given alarms, which must be sorted by time value,
+ * to the file at the given path. The checkpoint is written to a temporary
+ * file next to it, synced, and renamed over it, so a crash leaves either the
+ * old checkpoint or the new one. Returns 0, or an errno value if the
+ * checkpoint could not be written (in which case the old one is left).
+ */
+int checkpoint_write(const char *path, const checkpoint_alarm_t alarms[], size_t number_of_alarms);
+
+/**
+ * Maps the checkpoint at the given path into memory. Returns false if there is
+ * no file at the path. A file that is not a valid checkpoint of this version
+ * is an error.
+ */
+bool checkpoint_map(checkpoint_t *checkpoint, const char *path);
+
+/**
+ * Unmaps a checkpoint.
+ */
+void checkpoint_unmap(checkpoint_t *checkpoint);
+
+#endif
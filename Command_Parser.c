@@ -1,202 +1,445 @@
+
 #include "errors.h"
 #include "types.h"
-#include <regex.h>
+#include "Alarm_Request.h"
+#include "Command_Parser.h"
 #include <time.h>
-
-#define MAXIMUM_MESSAGE_SIZE 128
+#include <limits.h>
 
 /**
- * This is the data type that holds information about parsing a
- * request. It contains the type of the request, the regular
- * expression for the request, and the number of matches within the
- * request (that must be parsed out).
+ * This is the data type that describes one kind of request. It contains the
+ * type of the request, the keyword that every request of that type starts with
+ * (including the opening bracket), and whether the request is followed by a
+ * time and a message.
  */
-typedef struct regex_parser {
+typedef struct request_keyword {
     request_type type;
-    const char *regex_string;
-    int expected_matches;
-} regex_parser;
+    const char *keyword;
+    size_t keyword_length;
+    bool has_time_and_message;
+} request_keyword;
 
 /**
- * These are the regexes for the requests that we must parse.
+ * These are the requests that we must parse. They are listed in the order that
+ * they are tried in, so if an input contains more than one request (e.g.
+ * "Cancel_Alarm(1) Start_Alarm(2): 5 message"), the one that is listed first
+ * wins no matter where it appears in the input.
+ *
+ * The grammar for each of them is (where SPACE is any one whitespace character
+ * and the request can appear anywhere in the input):
+ *
+ *   Start_Alarm(IDS):SPACE TIME SPACE MESSAGE
+ *   Change_Alarm(IDS):SPACE TIME SPACE MESSAGE
+ *   Cancel_Alarm(IDS)
+ *
+ * where IDS is one or more alarm IDs separated by commas, each of which is
+ * either DIGITS or a range DIGITS-DIGITS (whose first alarm ID is not larger
+ * than its last), for example "5" or "5,9,12-40". TIME is DIGITS, optionally
+ * followed by a point and more DIGITS, and then optionally by a unit, "ms"
+ * (milliseconds) or "s" (seconds, which is what a time without a unit is in).
+ * For example "5", "250ms" or "1.5s".
  */
-regex_parser regexes[] = {
-    {
-        Start_Alarm,
-        "Start_Alarm\\(([0-9]+)\\):[[:space:]]([0-9]+)[[:space:]](.*)",
-        4
-    },
-    {
-        Change_Alarm,
-        "Change_Alarm\\(([0-9]+)\\):[[:space:]]([0-9]+)[[:space:]](.*)",
-        4
-    },
-    {
-        Cancel_Alarm,
-        "Cancel_Alarm\\(([0-9]+)\\)",
-        2
-    }
+static const request_keyword request_keywords[] = {
+    {Start_Alarm, "Start_Alarm(", sizeof("Start_Alarm(") - 1, true},
+    {Change_Alarm, "Change_Alarm(", sizeof("Change_Alarm(") - 1, true},
+    {Cancel_Alarm, "Cancel_Alarm(", sizeof("Cancel_Alarm(") - 1, false}
 };
 
+#define NUMBER_OF_REQUEST_KEYWORDS \
+    (sizeof(request_keywords) / sizeof(request_keywords[0]))
+
+/**
+ * Holds where the fields of a request are in the input string. Nothing is
+ * copied while scanning, the fields are only converted once the request that
+ * wins has been found.
+ */
+typedef struct request_fields {
+    const char *alarm_id_start;
+    const char *alarm_id_end;
+    size_t number_of_alarm_ids;
+    const char *time_start;
+    const char *time_end;
+    const char *message_start;
+} request_fields;
+
+/**
+ * Returns true if the character is matched by "[0-9]".
+ */
+static inline bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+/**
+ * Returns true if the character is matched by "[[:space:]]" in the C locale.
+ */
+static inline bool is_space(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+/**
+ * Skips over a run of at least one digit. Returns a pointer to the first
+ * character after the digits, or NULL if there were no digits.
+ */
+static inline const char *skip_digits(const char *position) {
+    const char *start = position;
+
+    while (is_digit(*position)) {
+        position++;
+    }
+
+    return position == start ? NULL : position;
+}
+
+/**
+ * Converts a run of digits to an int. Numbers that are too large are treated
+ * the same way atoi treats them (they saturate as a long and are then
+ * truncated to an int).
+ */
+static int parse_number(const char *start, const char *end) {
+    long value = 0;
+
+    for (const char *digit = start; digit < end; digit++) {
+        if (value > (LONG_MAX - (*digit - '0')) / 10) {
+            value = LONG_MAX;
+            break;
+        }
+        value = value * 10 + (*digit - '0');
+    }
+
+    return (int) value;
+}
+
+/**
+ * Skips over IDS (see the grammar above). Returns a pointer to the first
+ * character after them, or NULL if they are not valid, in which case the
+ * number of alarm IDs is not set either. Lists of more than
+ * MAXIMUM_BULK_REQUEST_SIZE alarm IDs are not valid.
+ */
+static const char *skip_alarm_ids(const char *position, size_t *number_of_alarm_ids) {
+    const char *first_start;
+    const char *first_end;
+    long first;
+    long last;
+    size_t count = 0;
+
+    while (1) {
+        first_start = position;
+        first_end = position = skip_digits(position);
+        if (position == NULL) {
+            return NULL;
+        }
+        first = last = parse_number(first_start, first_end);
+
+        if (*position == '-') {
+            first_start = position + 1;
+            position = skip_digits(first_start);
+            if (position == NULL) {
+                return NULL;
+            }
+            last = parse_number(first_start, position);
+            if (last < first) {
+                return NULL;
+            }
+        }
+
+        count += last - first + 1;
+        if (count > MAXIMUM_BULK_REQUEST_SIZE) {
+            return NULL;
+        }
+
+        if (*position != ',') {
+            break;
+        }
+        position++;
+    }
+
+    *number_of_alarm_ids = count;
+    return position;
+}
+
+/**
+ * Checks if the request described by the keyword starts exactly at the given
+ * position of the input. If it does, the positions of its fields are saved in
+ * the fields parameter and true is returned, otherwise false is returned.
+ */
+static bool match_request_at(
+    const char *position,
+    const request_keyword *keyword,
+    request_fields *fields
+) {
+    if (strncmp(position, keyword->keyword, keyword->keyword_length) != 0) {
+        return false;
+    }
+    position += keyword->keyword_length;
+
+    /*
+     * "(IDS)"
+     */
+    fields->alarm_id_start = position;
+    position = skip_alarm_ids(position, &fields->number_of_alarm_ids);
+    if (position == NULL || *position != ')') {
+        return false;
+    }
+    fields->alarm_id_end = position;
+    position++;
+
+    if (!keyword->has_time_and_message) {
+        return true;
+    }
+
+    /*
+     * ":SPACE TIME SPACE"
+     */
+    if (*position != ':' || !is_space(position[1])) {
+        return false;
+    }
+    position += 2;
+
+    fields->time_start = position;
+    position = skip_digits(position);
+    if (position != NULL && *position == '.') {
+        position = skip_digits(position + 1);
+    }
+    if (position != NULL && position[0] == 'm' && position[1] == 's') {
+        position += 2;
+    } else if (position != NULL && position[0] == 's') {
+        position++;
+    }
+    if (position == NULL || !is_space(*position)) {
+        return false;
+    }
+    fields->time_end = position;
+
+    /*
+     * The message is the rest of the input (it may be empty).
+     */
+    fields->message_start = position + 1;
+
+    return true;
+}
+
+/**
+ * Converts a TIME (see the grammar above) to milliseconds. Decimals smaller
+ * than a millisecond are dropped, and times that are too large saturate at
+ * INT_MAX milliseconds.
+ */
+static int parse_time(const char *start, const char *end) {
+    long long unit = 1000;          // Milliseconds per unit.
+    long long milliseconds = 0;
+    long long scale;
+    const char *digit = start;
+
+    if (end[-1] == 's' && end[-2] == 'm') {
+        unit = 1;
+        end -= 2;
+    } else if (end[-1] == 's') {
+        end--;
+    }
+
+    for (; digit < end && *digit != '.'; digit++) {
+        milliseconds = milliseconds * 10 + (*digit - '0') * unit;
+        if (milliseconds > INT_MAX) {
+            return INT_MAX;
+        }
+    }
+
+    if (digit < end) {
+        digit++;
+        for (scale = unit / 10; digit < end && scale > 0; digit++, scale /= 10) {
+            milliseconds += (*digit - '0') * scale;
+        }
+    }
+
+    return milliseconds > INT_MAX ? INT_MAX : (int) milliseconds;
+}
+
+/**
+ * Makes the rest of the alarm requests of a bulk request, one for each alarm
+ * ID in IDS (see the grammar above) after the first, and links them behind
+ * the first one through their bulk_next pointers, in the order of IDS. They
+ * are the same as the first one apart from their alarm IDs.
+ */
+static void add_bulk_alarm_requests(alarm_request_t *first, const char *ids) {
+    alarm_request_t *last = first;
+    alarm_request_t *alarm_request;
+    const char *position = ids;
+    const char *end;
+    long first_id;
+    long last_id;
+    bool skip_first = true;
+
+    while (1) {
+        end = skip_digits(position);
+        first_id = last_id = parse_number(position, end);
+        position = end;
+
+        if (*position == '-') {
+            end = skip_digits(position + 1);
+            last_id = parse_number(position + 1, end);
+            position = end;
+        }
+
+        for (long alarm_id = first_id; alarm_id <= last_id; alarm_id++) {
+            // The first alarm ID already has its alarm request
+            if (skip_first) {
+                skip_first = false;
+                continue;
+            }
+
+            alarm_request = allocate_alarm_request();
+            alarm_request->type = first->type;
+            alarm_request->change_status = alarm_request->type == Change_Alarm;
+            alarm_request->next = NULL;
+            alarm_request->sequence_number = 0;
+            alarm_request->queue_next = NULL;
+            alarm_request->bulk_next = NULL;
+            alarm_request->alarm_id = (int) alarm_id;
+            alarm_request->time = first->time;
+            alarm_request->message = message_retain(first->message);
+            alarm_request->creation_time = first->creation_time;
+
+            last->bulk_next = alarm_request;
+            last = alarm_request;
+        }
+
+        if (*position != ',') {
+            break;
+        }
+        position++;
+    }
+}
+
 /**
  * This method takes a string and checks if it matches any of the request
  * formats. If there is no match, NULL is returned. If there is a match, it
  * parses the string into a request and returns it.
  *
- * Note that the alarm_request_t pointer that is returned was malloced, so it
- * must be freed when it is done being used.
+ * The input is scanned once from left to right. At each position, only the
+ * requests whose keyword starts with the current character are tried, and the
+ * earliest match of each type is remembered. Start_Alarm has the highest
+ * priority, so the scan stops as soon as one is found.
+ *
+ * Note that the alarm_request_t pointer that is returned was allocated from
+ * the alarm request pool, so it must be freed with free_alarm_request when it
+ * is done being used.
  */
 alarm_request_t *parse_request(char input[]) {
-    regex_t regex; // Holds the regex that we are testing.
+    alarm_request_t *alarm_request; // Holds the pointer to the request that
+                                    // will be returned. (This will be
+                                    // allocated, so it must be freed later).
 
-    int re_status; // Holds the status of regex tests.
+    request_fields fields = {0};    // Fields of the request currently being
+                                    // tried.
 
-    regmatch_t matches[4]; // Holds the number of matches. (No request has more
-                           // than 3 matches, which we add 1 to because the
-                           // entire string itself counts as a match. This is
-                           // why the array size is 4).
+    request_fields best_fields = {0}; // Fields of the best request found so
+                                      // far.
 
-    alarm_request_t *alarm_request; // Holds the pointer to the request that
-                                    // will be returned. (This will be malloced,
-                                    // so it must be freed later).
+    size_t best = NUMBER_OF_REQUEST_KEYWORDS; // Index of the best request found
+                                              // so far (lower is better).
 
-    int number_of_regexes = 3; // Three regexes for three request types.
+    /*
+     * Scan the input for the requests.
+     */
+    for (const char *position = input; *position != 0 && best > 0; position++) {
+        for (size_t i = 0; i < best; i++) {
+            if (*position == request_keywords[i].keyword[0]
+                && match_request_at(position, &request_keywords[i], &fields)) {
+                best = i;
+                best_fields = fields;
+                break;
+            }
+        }
+    }
 
-    char alarm_id_buffer[64]; // Buffer used to hold alarm_id as a string when
-                              // it is being converted to an int.
+    if (best == NUMBER_OF_REQUEST_KEYWORDS) {
+        return NULL;
+    }
 
-    char time_buffer[64]; // Buffer used to hold time as a string when it is
-                          // being converted to an int.
+    /*
+     * Allocate alarm request (IT MUST BE FREED LATER!).
+     */
+    alarm_request = allocate_alarm_request();
 
     /*
-     * Loop through the regexes and test each one.
+     * Fill command with data.
      */
-    for (int i = 0; i < number_of_regexes; i++) {
-        /*
-         * Compile the regex
-         */
-        re_status = regcomp(
-            &regex,
-            regexes[i].regex_string,
-            REG_EXTENDED
-        );
+    alarm_request->type = request_keywords[best].type;
+    alarm_request->change_status = alarm_request->type == Change_Alarm;
+    alarm_request->next = NULL;
+    alarm_request->sequence_number = 0;
+    alarm_request->queue_next = NULL;
+    alarm_request->bulk_next = NULL;
 
-        // Make sure regex compilation succeeded
-        if (re_status != 0) {
-            fprintf(
-                stderr,
-                "Regex %d \"%s\" did not compile\n",
-                i,
-                regexes[i].regex_string
-            );
-            exit(1);
-        }
+    alarm_request->alarm_id = parse_number(
+        best_fields.alarm_id_start,
+        skip_digits(best_fields.alarm_id_start)
+    );
 
-        /*
-         * Test input string against regex.
-         */
-        re_status = regexec(
-            &regex,
-            input,
-            regexes[i].expected_matches,
-            matches,
-            0
+    if (request_keywords[best].has_time_and_message) {
+        alarm_request->time = parse_time(
+            best_fields.time_start,
+            best_fields.time_end
+        );
+        alarm_request->message = message_intern(
+            best_fields.message_start,
+            strlen(best_fields.message_start)
         );
 
-        if (re_status == REG_NOMATCH) {
-            /*
-             * If no match, then free the regex and continue on with the loop.
-             */
-            regfree(&regex);
-            continue;
-        } else if (re_status != 0) {
-            /*
-             * If regex test returned nonzero value, then it was an error. In
-             * this case, free the regex and stop the program.
-             */
-            fprintf(
-                stderr,
-                "Regex %d \"%s\" did not work with input \"%s\"\n",
-                i,
-                regexes[i].regex_string,
-                input);
-            regfree(&regex);
-            exit(1);
+        // A periodic display cannot run more than once a millisecond
+        if (alarm_request->time == 0) {
+            free_alarm_request(alarm_request);
+            return NULL;
         }
-        else {
-            /*
-             * In this case (regex returned 0), we know the input has matched a
-             * request and we can now parse it.
-             */
-
-            // Free the regex
-            regfree(&regex);
-
-            /*
-             * Allocate alarm request (IT MUST BE FREED LATER!).
-             */
-            alarm_request = malloc(sizeof(alarm_request_t));
-            if (alarm_request == NULL) {
-                errno_abort("Malloc failed");
-            }
-
-            /*
-             * Fill command with data.
-             */
+    } else {
+        alarm_request->time = 0;
+        alarm_request->message = message_intern("", 0);
+    }
 
-            // Get the type from the regex that succeeded
-            alarm_request->type = regexes[i].type;
+    // Set the creation time to now
+    alarm_request->creation_time = time(NULL);
 
-            if (alarm_request->type == Change_Alarm) {
-                alarm_request->change_status = true;
-            }
-            else {
-                alarm_request->change_status = false;
-            }
+    if (best_fields.number_of_alarm_ids > 1) {
+        add_bulk_alarm_requests(alarm_request, best_fields.alarm_id_start);
+    }
 
-            // Get the alarm_id from the input (if it exists)
-            if (regexes[i].expected_matches > 1) {
-                strncpy(
-                    alarm_id_buffer,
-                    input + matches[1].rm_so,
-                    matches[1].rm_eo - matches[1].rm_so
-                );
-                alarm_request->alarm_id = atoi(alarm_id_buffer);
-            } else {
-                alarm_request->alarm_id = 0;
-            }
+    return alarm_request;
+}
 
-            // Get the time from the input (if it exists)
-            if (regexes[i].expected_matches > 2) {
-                strncpy(
-                    time_buffer,
-                    input + matches[2].rm_so,
-                    matches[2].rm_eo - matches[2].rm_so
-                );
-                alarm_request->time = atoi(time_buffer);
-            } else {
-                alarm_request->time = 0;
-            }
+/**
+ * Returns true if the input is the given keyword, with nothing but whitespace
+ * around it.
+ */
+static bool is_keyword_command(const char input[], const char keyword[]) {
+    const char *position = input;
 
-            // Copy the message from the input (if it exists)
-            if (regexes[i].expected_matches > 3) {
-                strncpy(
-                    alarm_request->message,
-                    input + matches[3].rm_so,
-                    MAXIMUM_MESSAGE_SIZE
-                );
-                alarm_request->message[matches[3].rm_eo - matches[3].rm_so] = 0;
-            } else {
-                strncpy(alarm_request->message, "", MAXIMUM_MESSAGE_SIZE);
-            }
+    while (is_space(*position)) {
+        position++;
+    }
 
-            // Set the creation time to now
-            alarm_request->creation_time = time(NULL);
+    if (strncmp(position, keyword, strlen(keyword)) != 0) {
+        return false;
+    }
+    position += strlen(keyword);
 
-            return alarm_request;
-        }
+    while (is_space(*position)) {
+        position++;
     }
 
-    return NULL;
+    return *position == 0;
+}
+
+/**
+ * Returns true if the input is the Stats command: "Stats", with nothing but
+ * whitespace around it.
+ */
+bool is_stats_command(const char input[]) {
+    return is_keyword_command(input, "Stats");
 }
 
+/**
+ * Returns true if the input is the Checkpoint command: "Checkpoint", with
+ * nothing but whitespace around it.
+ */
+bool is_checkpoint_command(const char input[]) {
+    return is_keyword_command(input, "Checkpoint");
+}
@@ -1,6 +1,11 @@
 #ifndef COMMAND_PARSER_H
 #define COMMAND_PARSER_H
 
+/**
+ * The most alarm IDs that one bulk request can have.
+ */
+#define MAXIMUM_BULK_REQUEST_SIZE 1000000
+
 /**
  * Parses a request as a string (from user input) into an alarm_request_t
  * object.
@@ -9,10 +14,28 @@
  * not be parsed. Otherwise, this function will return a pointer to the alarm
  * request.
  *
- * Note that the alarm_request_t pointer that is returned is malloced, so it must
- * be freed when it is done being used.
+ * A request for a list or a range of alarm IDs (such as "Cancel_Alarm(5,9,
+ * 12-40)") is a bulk request: there is one alarm request per alarm ID, and
+ * the ones after the first are linked behind it through their bulk_next
+ * pointers.
+ *
+ * Note that the alarm_request_t pointer that is returned is allocated from the
+ * alarm request pool, so it must be freed with free_alarm_request when it is
+ * done being used (as must each of the alarm requests of a bulk request).
  */
 alarm_request_t *parse_request(char input[]);
 
+/**
+ * Returns true if the input (from user input) is the Stats command, which is
+ * not an alarm request, so parse_request does not accept it.
+ */
+bool is_stats_command(const char input[]);
+
+/**
+ * Returns true if the input (from user input) is the Checkpoint command, which
+ * is not an alarm request, so parse_request does not accept it.
+ */
+bool is_checkpoint_command(const char input[]);
+
 #endif
 
@@ -0,0 +1,518 @@
+#include <fcntl.h>
+#include <stdbool.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "errors.h"
+#include "Command_Server.h"
+
+#define LISTEN_BACKLOG 1024
+#define MAXIMUM_EVENTS 256
+
+/**
+ * A client with this many bytes of responses waiting to be sent is not read
+ * from until some of them have been sent.
+ */
+#define MAXIMUM_PENDING_OUTPUT (1 << 20)
+
+/**
+ * Most bytes read from a client at once. A client's input buffer grows by
+ * this much at a time while a line is longer than it, up to
+ * COMMAND_MAXIMUM_LINE_SIZE.
+ */
+#define READ_SIZE 4096
+
+struct command_client_t {
+    int fd;
+    bool listening;                 // A listening socket, not a client.
+    bool closing;                   // The client will not send anything
+                                    // more, so it is closed once its
+                                    // responses have been sent.
+    bool failed;                    // The connection failed, so nobody
+                                    // reads the responses.
+    bool dirty;                     // In the list of clients to look at
+                                    // after the round.
+    unsigned int events;            // Events the client is registered for.
+    command_client_t *next_dirty;
+
+    char *output;
+    size_t output_capacity;
+    size_t output_length;
+    size_t output_sent;
+
+    bool discarding;                // The line being read is too long,
+                                    // so it is dropped up to its newline.
+    char *input;                    // NULL while there is no incomplete
+    size_t input_capacity;          // line, so idle clients stay small.
+    size_t input_length;
+};
+
+static int epoll_fd = -1;
+static command_client_t *dirty_clients;
+
+/*******************************************************************************
+ *                           HELPER FUNCTIONS                                  *
+ ******************************************************************************/
+
+/**
+ * Adds a client to the list of clients to look at after the round (to send
+ * its responses, or to close it).
+ */
+static void mark_dirty(command_client_t *client) {
+    if (!client->dirty) {
+        client->dirty = true;
+        client->next_dirty = dirty_clients;
+        dirty_clients = client;
+    }
+}
+
+static void set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0) {
+        errno_abort("Fcntl failed");
+    }
+}
+
+static command_client_t *create_client(int fd, bool listening) {
+    command_client_t *client = calloc(1, sizeof(command_client_t));
+    struct epoll_event event;
+
+    if (client == NULL) {
+        errno_abort("Calloc failed");
+    }
+    client->fd = fd;
+    client->listening = listening;
+    client->events = EPOLLIN;
+
+    event.events = client->events;
+    event.data.ptr = client;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+        errno_abort("Epoll_ctl failed");
+    }
+
+    return client;
+}
+
+/**
+ * Closes a client (which also removes it from the epoll instance) and frees it.
+ */
+static void close_client(command_client_t *client) {
+    close(client->fd);
+    free(client->output);
+    free(client->input);
+    free(client);
+}
+
+static void listen_on(int fd, struct sockaddr *address, socklen_t address_length) {
+    if (bind(fd, address, address_length) != 0) {
+        errno_abort("Command server bind failed");
+    }
+    if (listen(fd, LISTEN_BACKLOG) != 0) {
+        errno_abort("Command server listen failed");
+    }
+    set_nonblocking(fd);
+    create_client(fd, true);
+}
+
+/**
+ * Accepts every client that is waiting on a listening socket.
+ */
+static void accept_clients(command_client_t *listener) {
+    int fd;
+
+    while (1) {
+        fd = accept(listener->fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+
+            /*
+             * EAGAIN means there are no more clients. Running out of file
+             * descriptors (EMFILE, ENFILE) leaves the rest waiting until a
+             * client goes away.
+             */
+            return;
+        }
+        set_nonblocking(fd);
+        create_client(fd, false);
+    }
+}
+
+/**
+ * Makes room in a client's input buffer to read up to READ_SIZE more bytes
+ * (fewer if the line would be longer than COMMAND_MAXIMUM_LINE_SIZE), and
+ * returns how much room there is.
+ */
+static size_t reserve_input(command_client_t *client) {
+    size_t needed = client->input_length + READ_SIZE;
+    size_t capacity = client->input_capacity > 0 ? client->input_capacity : READ_SIZE + 1;
+
+    if (needed > COMMAND_MAXIMUM_LINE_SIZE) {
+        needed = COMMAND_MAXIMUM_LINE_SIZE;
+    }
+
+    /*
+     * One more byte than the line, for the terminating zero.
+     */
+    while (capacity < needed + 1) {
+        capacity *= 2;
+    }
+    if (capacity > COMMAND_MAXIMUM_LINE_SIZE + 1) {
+        capacity = COMMAND_MAXIMUM_LINE_SIZE + 1;
+    }
+
+    if (capacity != client->input_capacity) {
+        client->input = realloc(client->input, capacity);
+        if (client->input == NULL) {
+            errno_abort("Realloc failed");
+        }
+        client->input_capacity = capacity;
+    }
+
+    return client->input_capacity - 1 - client->input_length;
+}
+
+/**
+ * Drops the input of a line that is too long, up to and including its
+ * newline, and keeps what comes after it. Once the newline has been found,
+ * the client is no longer discarding.
+ */
+static void discard_input(command_client_t *client) {
+    char *newline = memchr(client->input, '\n', client->input_length);
+
+    if (newline == NULL) {
+        client->input_length = 0;
+        return;
+    }
+
+    client->discarding = false;
+    client->input_length -= newline + 1 - client->input;
+    memmove(client->input, newline + 1, client->input_length);
+}
+
+/**
+ * Passes the complete lines in a client's input buffer to the line handler
+ * and keeps the incomplete last one. At the end of the input, the last line is
+ * passed even if it has no newline.
+ */
+static void handle_lines(
+    command_client_t *client,
+    command_line_handler_t line_handler,
+    bool end_of_input
+) {
+    char *line = client->input;
+    char *end = client->input + client->input_length;
+    char *newline;
+
+    while ((newline = memchr(line, '\n', end - line)) != NULL) {
+        *newline = 0;
+        if (newline > line && newline[-1] == '\r') {
+            newline[-1] = 0;
+        }
+        line_handler(client, line);
+        line = newline + 1;
+    }
+
+    if (end_of_input && end > line) {
+        /*
+         * The client will not send the rest of the line, so pass what we
+         * have.
+         */
+        *end = 0;
+        line_handler(client, line);
+        line = end;
+    }
+
+    /*
+     * Move the incomplete last line to the start of the buffer.
+     */
+    client->input_length = end - line;
+    memmove(client->input, line, client->input_length);
+
+    /*
+     * A line that fills the whole buffer without a newline is too long. No
+     * part of it is passed on, because the parser would take any part of it
+     * (even the middle of a message) as a command of its own.
+     */
+    if (client->input_length == COMMAND_MAXIMUM_LINE_SIZE) {
+        client->discarding = true;
+        client->input_length = 0;
+        command_client_printf(client, "Line too long\n");
+    }
+}
+
+/**
+ * Reads what a client has sent (once per round, so that a busy client cannot
+ * starve the others) and passes its complete lines to the line handler.
+ */
+static void read_client(command_client_t *client, command_line_handler_t line_handler) {
+    size_t room = reserve_input(client);
+    ssize_t bytes_read = read(client->fd, client->input + client->input_length, room);
+
+    if (bytes_read < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return;
+        }
+
+        client->closing = true;
+        client->failed = true;
+        mark_dirty(client);
+        return;
+    }
+
+    client->input_length += bytes_read;
+    if (client->discarding) {
+        discard_input(client);
+    }
+    if (!client->discarding) {
+        handle_lines(client, line_handler, bytes_read == 0);
+    }
+
+    if (client->input_length == 0) {
+        free(client->input);
+        client->input = NULL;
+        client->input_capacity = 0;
+    }
+
+    if (bytes_read == 0) {
+        client->closing = true;
+        mark_dirty(client);
+    }
+}
+
+/**
+ * Sends as much of a client's responses as the socket takes without blocking.
+ */
+static void send_output(command_client_t *client) {
+    ssize_t sent;
+
+    while (client->output_sent < client->output_length) {
+        sent = send(
+            client->fd,
+            client->output + client->output_sent,
+            client->output_length - client->output_sent,
+            MSG_NOSIGNAL
+        );
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                client->closing = true;
+                client->failed = true;
+            }
+            break;
+        }
+        client->output_sent += sent;
+    }
+
+    /*
+     * The output buffer is freed once it has all been sent, so that idle
+     * clients stay small.
+     */
+    if (client->output_sent == client->output_length) {
+        free(client->output);
+        client->output = NULL;
+        client->output_capacity = 0;
+        client->output_length = client->output_sent = 0;
+    }
+}
+
+/**
+ * Sends a client its responses, then closes it if it is done, or registers it
+ * for the events it now needs: input unless it is closing or too far behind
+ * in reading its responses, and output while responses are waiting.
+ */
+static void finish_round(command_client_t *client) {
+    size_t pending;
+    unsigned int events;
+    struct epoll_event event;
+
+    if (!client->failed) {
+        send_output(client);
+    }
+    pending = client->output_length - client->output_sent;
+
+    if (client->failed || (client->closing && pending == 0)) {
+        close_client(client);
+        return;
+    }
+
+    events = (!client->closing && pending < MAXIMUM_PENDING_OUTPUT ? EPOLLIN : 0)
+        | (pending > 0 ? EPOLLOUT : 0);
+
+    if (events != client->events) {
+        client->events = events;
+        event.events = events;
+        event.data.ptr = client;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client->fd, &event) != 0) {
+            errno_abort("Epoll_ctl failed");
+        }
+    }
+}
+
+/*******************************************************************************
+ *                              PUBLIC FUNCTIONS                               *
+ ******************************************************************************/
+
+int command_server_listen(const char *unix_socket_path, int tcp_port) {
+    struct sockaddr_un unix_address;
+    struct sockaddr_in tcp_address;
+    socklen_t address_length = sizeof(tcp_address);
+    struct rlimit limit;
+    struct stat status;
+    int reuse = 1;
+    int fd;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        errno_abort("Epoll_create failed");
+    }
+
+    if (unix_socket_path != NULL) {
+        if (strlen(unix_socket_path) >= sizeof(unix_address.sun_path)) {
+            errno = ENAMETOOLONG;
+            errno_abort("Command server socket path");
+        }
+
+        /*
+         * A socket left behind by an earlier run would make bind fail. Only
+         * sockets are removed, never other files.
+         */
+        if (lstat(unix_socket_path, &status) == 0 && S_ISSOCK(status.st_mode)) {
+            unlink(unix_socket_path);
+        }
+
+        memset(&unix_address, 0, sizeof(unix_address));
+        unix_address.sun_family = AF_UNIX;
+        strcpy(unix_address.sun_path, unix_socket_path);
+
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            errno_abort("Command server socket failed");
+        }
+        listen_on(fd, (struct sockaddr *) &unix_address, sizeof(unix_address));
+    }
+
+    if (tcp_port < 0) {
+        return -1;
+    }
+
+    memset(&tcp_address, 0, sizeof(tcp_address));
+    tcp_address.sin_family = AF_INET;
+    tcp_address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    tcp_address.sin_port = htons(tcp_port);
+
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        errno_abort("Command server socket failed");
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    listen_on(fd, (struct sockaddr *) &tcp_address, sizeof(tcp_address));
+
+    if (getsockname(fd, (struct sockaddr *) &tcp_address, &address_length) != 0) {
+        errno_abort("Command server getsockname failed");
+    }
+
+    return ntohs(tcp_address.sin_port);
+}
+
+void command_server_run(
+    command_line_handler_t line_handler,
+    command_round_handler_t round_handler
+) {
+    struct epoll_event events[MAXIMUM_EVENTS];
+    command_client_t *client;
+    int number_of_events;
+
+    while (1) {
+        number_of_events = epoll_wait(epoll_fd, events, MAXIMUM_EVENTS, -1);
+        if (number_of_events < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            errno_abort("Epoll_wait failed");
+        }
+
+        for (int i = 0; i < number_of_events; i++) {
+            client = events[i].data.ptr;
+
+            if (client->listening) {
+                accept_clients(client);
+                continue;
+            }
+
+            if ((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && !client->closing) {
+                read_client(client, line_handler);
+            }
+            if (events[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+                mark_dirty(client);
+            }
+        }
+
+        round_handler();
+
+        /*
+         * Clients are only closed here, after the round handler, so none of
+         * them goes away while lines it sent are still being handled.
+         */
+        while (dirty_clients != NULL) {
+            client = dirty_clients;
+            dirty_clients = client->next_dirty;
+            client->dirty = false;
+            finish_round(client);
+        }
+    }
+}
+
+void command_client_printf(command_client_t *client, const char *format, ...) {
+    va_list args;
+
+    va_start(args, format);
+    command_client_vprintf(client, format, args);
+    va_end(args);
+}
+
+void command_client_vprintf(command_client_t *client, const char *format, va_list args) {
+    va_list copy;
+    int length;
+    size_t capacity;
+
+    if (client->failed) {
+        return;
+    }
+
+    va_copy(copy, args);
+    length = vsnprintf(NULL, 0, format, copy);
+    va_end(copy);
+    if (length < 0) {
+        return;
+    }
+
+    if (client->output_length + length + 1 > client->output_capacity) {
+        capacity = client->output_capacity > 0 ? client->output_capacity : 256;
+        while (capacity < client->output_length + length + 1) {
+            capacity *= 2;
+        }
+        client->output = realloc(client->output, capacity);
+        if (client->output == NULL) {
+            errno_abort("Realloc failed");
+        }
+        client->output_capacity = capacity;
+    }
+
+    vsnprintf(client->output + client->output_length, length + 1, format, args);
+    client->output_length += length;
+    mark_dirty(client);
+}
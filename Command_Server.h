@@ -0,0 +1,73 @@
+#ifndef COMMAND_SERVER_H
+#define COMMAND_SERVER_H
+
+#include <stdarg.h>
+
+/**
+ * Longest line a client can send, not counting the newline. A longer line is
+ * never passed to the line handler: it is discarded up to the next newline,
+ * and the client is sent "Line too long" instead.
+ */
+#define COMMAND_MAXIMUM_LINE_SIZE (1 << 20)
+
+/**
+ * A client connected to the command server.
+ */
+typedef struct command_client_t command_client_t;
+
+/**
+ * Called for every line a client sends (without the newline, and without a
+ * carriage return before it).
+ */
+typedef void (*command_line_handler_t)(command_client_t *client, char line[]);
+
+/**
+ * Called after the lines of every round have been passed to the line handler,
+ * where a round is all the input that arrived while the server was waiting.
+ * The clients whose lines were passed in the round stay open until this
+ * returns, so lines can be collected and handled together here.
+ */
+typedef void (*command_round_handler_t)(void);
+
+/**
+ * Starts listening for clients on a Unix domain socket at the given path
+ * and/or on the given TCP port of the loopback address (127.0.0.1). Either
+ * can be left out by passing NULL or -1. An old socket file at the path is
+ * replaced. Returns the TCP port (which is chosen by the system if the given
+ * port is 0), or -1 if there is none.
+ *
+ * Also raises the limit on open files as far as it goes, so that thousands of
+ * clients can be connected at once.
+ */
+int command_server_listen(const char *unix_socket_path, int tcp_port);
+
+/**
+ * Serves the clients on the calling thread, forever.
+ *
+ * All the sockets are non-blocking and watched with one epoll instance, so a
+ * client that is idle costs a few hundred bytes and no thread. Each round,
+ * the server reads whatever the ready clients sent, passes their complete
+ * lines to the line handler, calls the round handler, then sends each client
+ * its responses. A client that does not read its responses is not read from
+ * again until they have been sent.
+ */
+void command_server_run(
+    command_line_handler_t line_handler,
+    command_round_handler_t round_handler
+);
+
+/**
+ * Adds a response, formatted as if you were calling printf, to what is sent
+ * back to a client. Responses are sent in the order they were added, and only
+ * to that client. Must only be called on the server thread, from one of the
+ * handlers.
+ */
+void command_client_printf(command_client_t *client, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/**
+ * Same as command_client_printf, but takes a va_list.
+ */
+void command_client_vprintf(command_client_t *client, const char *format, va_list args);
+
+#endif
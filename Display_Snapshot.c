@@ -0,0 +1,227 @@
+#include <pthread.h>
+#include "errors.h"
+#include "types.h"
+#include "Hash.h"
+#include "Alarm_List.h"
+#include "Display_Snapshot.h"
+
+#define MINIMUM_ID_TABLE_SIZE 16
+
+/*******************************************************************************
+ *                           HELPER FUNCTIONS                                  *
+ ******************************************************************************/
+
+/**
+ * Gives each bucket of a new snapshot a version: the version of the same
+ * bucket in the old snapshot if it holds exactly the same alarm requests, or a
+ * new version otherwise.
+ */
+static void set_display_bucket_versions(
+    display_snapshot_t *snapshot,
+    display_snapshot_t *old_snapshot,
+    unsigned long *last_bucket_version
+) {
+    display_bucket_t *bucket;
+    display_bucket_t *old_bucket;
+    size_t j = 0;
+
+    for (size_t i = 0; i < snapshot->number_of_buckets; i++) {
+        bucket = &snapshot->buckets[i];
+
+        /*
+         * Both arrays of buckets are sorted by time value.
+         */
+        while (old_snapshot != NULL
+               && j < old_snapshot->number_of_buckets
+               && old_snapshot->bucket_times[j] < snapshot->bucket_times[i]) {
+            j++;
+        }
+
+        old_bucket = old_snapshot != NULL
+            && j < old_snapshot->number_of_buckets
+            && old_snapshot->bucket_times[j] == snapshot->bucket_times[i]
+            ? &old_snapshot->buckets[j]
+            : NULL;
+
+        if (old_bucket != NULL
+            && old_bucket->length == bucket->length
+            && memcmp(
+                   &snapshot->alarm_requests[bucket->first],
+                   &old_snapshot->alarm_requests[old_bucket->first],
+                   bucket->length * sizeof(alarm_request_t *)
+               ) == 0) {
+            bucket->version = old_bucket->version;
+        } else {
+            bucket->version = ++*last_bucket_version;
+        }
+    }
+}
+
+/**
+ * Puts an alarm request into a snapshot's alarm ID table, unless a newer one
+ * with the same alarm ID is already there.
+ */
+static void add_to_id_table(display_snapshot_t *snapshot, size_t index) {
+    alarm_request_t *alarm_request = snapshot->alarm_requests[index];
+    display_id_entry_t *entry;
+    size_t bucket = hash_key(alarm_request->alarm_id, snapshot->id_table_size);
+
+    while (snapshot->id_table[bucket].index != -1
+           && snapshot->id_table[bucket].alarm_id != alarm_request->alarm_id) {
+        bucket = (bucket + 1) & (snapshot->id_table_size - 1);
+    }
+
+    entry = &snapshot->id_table[bucket];
+    if (entry->index == -1
+        || snapshot->sequence_numbers[entry->index] < alarm_request->sequence_number) {
+        entry->alarm_id = alarm_request->alarm_id;
+        entry->index = (int) index;
+    }
+}
+
+/*******************************************************************************
+ *                              PUBLIC FUNCTIONS                               *
+ ******************************************************************************/
+
+display_snapshot_t *build_display_snapshot(
+    alarm_list_t *list,
+    display_snapshot_t *old_snapshot,
+    unsigned long *last_bucket_version,
+    unsigned long *newest_sequence_number
+) {
+    display_snapshot_t *snapshot;
+    alarm_request_t *alarm_request;
+    size_t length = list->length;
+    size_t id_table_size = MINIMUM_ID_TABLE_SIZE;
+    size_t size;
+    size_t i = 0;
+
+    /*
+     * Keep the hash table at most half full.
+     */
+    while (id_table_size < 2 * length) {
+        id_table_size *= 2;
+    }
+
+    /*
+     * There are at most as many buckets as alarm requests. The arrays are laid
+     * out from the most strictly aligned to the least.
+     */
+    size = sizeof(display_snapshot_t)
+        + length * sizeof(unsigned long)
+        + length * sizeof(alarm_request_t *)
+        + length * sizeof(display_bucket_t)
+        + id_table_size * sizeof(display_id_entry_t)
+        + length * sizeof(int);
+
+    snapshot = malloc(size);
+    if (snapshot == NULL) {
+        errno_abort("Malloc failed");
+    }
+
+    snapshot->length = length;
+    snapshot->size = size;
+    snapshot->sequence_numbers = (unsigned long *) (snapshot + 1);
+    snapshot->alarm_requests = (alarm_request_t **) (snapshot->sequence_numbers + length);
+    snapshot->buckets = (display_bucket_t *) (snapshot->alarm_requests + length);
+    snapshot->id_table = (display_id_entry_t *) (snapshot->buckets + length);
+    snapshot->bucket_times = (int *) (snapshot->id_table + id_table_size);
+    snapshot->number_of_buckets = 0;
+    snapshot->id_table_size = id_table_size;
+
+    for (size_t bucket = 0; bucket < id_table_size; bucket++) {
+        snapshot->id_table[bucket].index = -1;
+    }
+
+    for (alarm_request = list->header.next;
+         alarm_request != NULL;
+         alarm_request = alarm_request->next) {
+        /*
+         * The list is sorted by time value, so a new time value starts a new
+         * bucket.
+         */
+        if (snapshot->number_of_buckets == 0
+            || snapshot->bucket_times[snapshot->number_of_buckets - 1] != alarm_request->time) {
+            snapshot->bucket_times[snapshot->number_of_buckets] = alarm_request->time;
+            snapshot->buckets[snapshot->number_of_buckets].first = i;
+            snapshot->buckets[snapshot->number_of_buckets].length = 0;
+            snapshot->number_of_buckets++;
+        }
+        snapshot->buckets[snapshot->number_of_buckets - 1].length++;
+
+        if (alarm_request->sequence_number > *newest_sequence_number) {
+            *newest_sequence_number = alarm_request->sequence_number;
+        }
+
+        snapshot->sequence_numbers[i] = alarm_request->sequence_number;
+        snapshot->alarm_requests[i] = alarm_request;
+
+        /*
+         * Only the newest alarm request of each alarm ID is kept in the hash
+         * table.
+         */
+        add_to_id_table(snapshot, i);
+
+        i++;
+    }
+
+    snapshot->newest_sequence_number = *newest_sequence_number;
+    set_display_bucket_versions(snapshot, old_snapshot, last_bucket_version);
+
+    return snapshot;
+}
+
+alarm_request_t *find_in_display_snapshot(display_snapshot_t *snapshot, int alarm_id) {
+    size_t bucket = hash_key(alarm_id, snapshot->id_table_size);
+
+    while (snapshot->id_table[bucket].index != -1) {
+        if (snapshot->id_table[bucket].alarm_id == alarm_id) {
+            return snapshot->alarm_requests[snapshot->id_table[bucket].index];
+        }
+        bucket = (bucket + 1) & (snapshot->id_table_size - 1);
+    }
+
+    return NULL;
+}
+
+display_bucket_t *find_display_bucket(display_snapshot_t *snapshot, int time) {
+    size_t low = 0;
+    size_t high = snapshot->number_of_buckets;
+    size_t middle;
+
+    while (low < high) {
+        middle = low + (high - low) / 2;
+        if (snapshot->bucket_times[middle] < time) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    if (low < snapshot->number_of_buckets && snapshot->bucket_times[low] == time) {
+        return &snapshot->buckets[low];
+    }
+
+    return NULL;
+}
+
+size_t find_newer_in_display_bucket(
+    display_snapshot_t *snapshot,
+    display_bucket_t *bucket,
+    unsigned long sequence_number
+) {
+    size_t low = bucket->first;
+    size_t high = bucket->first + bucket->length;
+    size_t middle;
+
+    while (low < high) {
+        middle = low + (high - low) / 2;
+        if (snapshot->sequence_numbers[middle] <= sequence_number) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
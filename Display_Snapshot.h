@@ -0,0 +1,122 @@
+#ifndef DISPLAY_SNAPSHOT_H
+#define DISPLAY_SNAPSHOT_H
+
+#include <stddef.h>
+
+/**
+ * The alarm requests of a snapshot that have the same time value, which are
+ * the ones that one periodic display prints. They are next to each other in
+ * the snapshot's arrays, in the order they were inserted into the alarm list,
+ * so their sequence numbers increase.
+ *
+ * The version changes every time the consumer publishes a snapshot in which
+ * the bucket differs from the one in the previous snapshot (an alarm request
+ * was added to it or removed from it), and stays the same otherwise. So a
+ * periodic display only needs to look at its bucket again when its version
+ * has changed. Versions start at 1; a bucket that does not exist has version 0.
+ */
+typedef struct display_bucket_t {
+    size_t first;                       // Index in the snapshot's arrays.
+    size_t length;
+    unsigned long version;
+} display_bucket_t;
+
+/**
+ * An entry of a snapshot's alarm ID table. The alarm ID is kept in the entry
+ * itself, so probing the table does not touch the alarm requests.
+ */
+typedef struct display_id_entry_t {
+    int alarm_id;
+    int index;                          // In the snapshot's arrays, or -1 if
+                                        // the entry is empty.
+} display_id_entry_t;
+
+/**
+ * An immutable snapshot of one shard of the alarm display list.
+ *
+ * The consumer that owns the shard publishes a new snapshot after it has
+ * applied a batch of requests to its private alarm list. Periodic display
+ * threads read the latest snapshot without locking anything and without
+ * writing anything that other readers write (see Epoch.h), so the consumer
+ * never waits for them. Old snapshots, and the alarm requests removed from the
+ * shard, are freed once no periodic display thread can still be reading them.
+ *
+ * The fields that periodic displays search and scan every period (time
+ * values, sequence numbers and alarm IDs) are kept in compact arrays of their
+ * own, so searching and scanning them does not touch the alarm requests,
+ * which are only read for the alarms that a display actually looks at.
+ *
+ * Neither a snapshot nor the alarm requests in it change after it is
+ * published, except for the change_status of alarm requests, which is atomic.
+ * Readers must only use the data fields of the alarm requests, not their
+ * links, which belong to the consumer's private alarm list.
+ */
+typedef struct display_snapshot_t {
+    size_t length;
+
+    /*
+     * Parallel arrays of length entries, sorted by time value.
+     */
+    unsigned long *sequence_numbers;
+    alarm_request_t **alarm_requests;
+
+    /*
+     * One bucket per time value, sorted by time value. bucket_times holds the
+     * time value of each bucket.
+     */
+    int *bucket_times;
+    display_bucket_t *buckets;
+    size_t number_of_buckets;
+
+    /*
+     * The newest alarm request of each alarm ID, an open addressing hash
+     * table.
+     */
+    display_id_entry_t *id_table;
+    size_t id_table_size;               // A power of two.
+
+    unsigned long newest_sequence_number; // Of any alarm request in the shard
+                                          // so far (0 if none).
+    size_t size;                        // Bytes allocated for the snapshot.
+} display_snapshot_t;
+
+/**
+ * Builds a snapshot of an alarm list. The snapshot is allocated as one block,
+ * so it is freed with free.
+ *
+ * The old snapshot (the previous snapshot of the same list, or NULL) is used to
+ * keep the versions of the buckets that have not changed. The last bucket
+ * version and newest sequence number belong to the list's owner; they are
+ * read and updated by this function.
+ */
+display_snapshot_t *build_display_snapshot(
+    alarm_list_t *list,
+    display_snapshot_t *old_snapshot,
+    unsigned long *last_bucket_version,
+    unsigned long *newest_sequence_number
+);
+
+/**
+ * Returns the alarm request with the given alarm ID in a snapshot (the newest
+ * one, if there are several), or NULL if there is none.
+ */
+alarm_request_t *find_in_display_snapshot(display_snapshot_t *snapshot, int alarm_id);
+
+/**
+ * Returns the bucket of a snapshot with the given time value, or NULL if no
+ * alarm request in the snapshot has that time value.
+ */
+display_bucket_t *find_display_bucket(display_snapshot_t *snapshot, int time);
+
+/**
+ * Returns the index of the first alarm request in a bucket whose sequence
+ * number is larger than the given one (or the end of the bucket if there is
+ * none).
+ */
+size_t find_newer_in_display_bucket(
+    display_snapshot_t *snapshot,
+    display_bucket_t *bucket,
+    unsigned long sequence_number
+);
+
+#endif
@@ -0,0 +1,222 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "errors.h"
+#include "Epoch.h"
+
+#define CACHE_LINE_SIZE 64
+
+/**
+ * A thread tries to reclaim its retired objects every time it has retired this
+ * many more of them.
+ */
+#define RECLAIM_INTERVAL 64
+
+/**
+ * Each reading thread's epoch record.
+ *
+ * The state is 0 while the thread is not reading, and otherwise the epoch
+ * that the thread saw when it started reading, shifted left by one, with the
+ * lowest bit set. Each record is on its own cache line, so readers never write
+ * to the same cache line as each other.
+ */
+typedef struct epoch_record_t {
+    _Alignas(CACHE_LINE_SIZE) atomic_uint_fast64_t state;
+    atomic_bool in_use;             // A thread owns this record.
+    struct epoch_record_t *next;    // Next record in the list of records.
+} epoch_record_t;
+
+/**
+ * An object waiting to be freed.
+ */
+typedef struct retired_object_t {
+    void *object;
+    void (*free_function)(void *object);
+    uint64_t epoch;                 // Global epoch when it was retired.
+} retired_object_t;
+
+/**
+ * A thread's list of retired objects (in the order they were retired).
+ */
+typedef struct retired_list_t {
+    retired_object_t *objects;
+    size_t length;
+    size_t capacity;
+    size_t retired_since_reclaim;
+} retired_list_t;
+
+/*******************************************************************************
+ *                               EPOCH STATE                                   *
+ ******************************************************************************/
+
+static atomic_uint_fast64_t global_epoch = 1;
+
+/**
+ * The list of every epoch record. Records are only ever added to it; when a
+ * thread exits, its record is given to the next thread that needs one.
+ */
+static _Atomic(epoch_record_t *) records = NULL;
+static pthread_mutex_t records_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static _Thread_local epoch_record_t *thread_record = NULL;
+static _Thread_local retired_list_t thread_retired_list = {0};
+
+static pthread_key_t record_key;
+static pthread_once_t record_key_once = PTHREAD_ONCE_INIT;
+
+/*******************************************************************************
+ *                           HELPER FUNCTIONS                                  *
+ ******************************************************************************/
+
+/**
+ * Gives a thread's epoch record back when the thread exits.
+ */
+static void release_record(void *arg) {
+    epoch_record_t *record = arg;
+
+    atomic_store(&record->state, 0);
+    atomic_store(&record->in_use, false);
+}
+
+static void create_record_key(void) {
+    int status = pthread_key_create(&record_key, release_record);
+    if (status != 0) {
+        err_abort(status, "Create epoch record key");
+    }
+}
+
+/**
+ * Returns the calling thread's epoch record, taking a free one or creating
+ * one the first time.
+ */
+static epoch_record_t *get_record(void) {
+    epoch_record_t *record = thread_record;
+    bool expected;
+
+    if (record != NULL) {
+        return record;
+    }
+
+    pthread_once(&record_key_once, create_record_key);
+
+    pthread_mutex_lock(&records_mutex);
+    for (record = atomic_load(&records); record != NULL; record = record->next) {
+        expected = false;
+        if (atomic_compare_exchange_strong(&record->in_use, &expected, true)) {
+            break;
+        }
+    }
+
+    if (record == NULL) {
+        record = aligned_alloc(CACHE_LINE_SIZE, sizeof(epoch_record_t));
+        if (record == NULL) {
+            errno_abort("Aligned_alloc failed");
+        }
+        atomic_init(&record->state, 0);
+        atomic_init(&record->in_use, true);
+        record->next = atomic_load(&records);
+        atomic_store(&records, record);
+    }
+    pthread_mutex_unlock(&records_mutex);
+
+    pthread_setspecific(record_key, record);
+    thread_record = record;
+
+    return record;
+}
+
+/**
+ * Advances the global epoch if every thread that is reading has seen the
+ * current one. Returns the global epoch.
+ */
+static uint64_t try_advance(void) {
+    uint64_t epoch = atomic_load(&global_epoch);
+    uint64_t state;
+
+    for (epoch_record_t *record = atomic_load(&records);
+         record != NULL;
+         record = record->next) {
+        state = atomic_load(&record->state);
+        if ((state & 1) != 0 && (state >> 1) != epoch) {
+            return epoch;
+        }
+    }
+
+    /*
+     * If another thread advanced it first, that is just as good.
+     */
+    atomic_compare_exchange_strong(&global_epoch, &epoch, epoch + 1);
+
+    return atomic_load(&global_epoch);
+}
+
+/*******************************************************************************
+ *                              PUBLIC FUNCTIONS                               *
+ ******************************************************************************/
+
+void epoch_enter(void) {
+    epoch_record_t *record = get_record();
+
+    atomic_store(&record->state, (atomic_load(&global_epoch) << 1) | 1);
+
+    /*
+     * The record must be visible to writers before any shared data is read.
+     */
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+void epoch_exit(void) {
+    atomic_store_explicit(&thread_record->state, 0, memory_order_release);
+}
+
+void epoch_retire(void (*free_function)(void *object), void *object) {
+    retired_list_t *list = &thread_retired_list;
+
+    if (list->length == list->capacity) {
+        list->capacity = list->capacity == 0 ? 256 : 2 * list->capacity;
+        list->objects = realloc(list->objects, list->capacity * sizeof(retired_object_t));
+        if (list->objects == NULL) {
+            errno_abort("Realloc failed");
+        }
+    }
+
+    list->objects[list->length].object = object;
+    list->objects[list->length].free_function = free_function;
+    list->objects[list->length].epoch = atomic_load(&global_epoch);
+    list->length++;
+
+    if (++list->retired_since_reclaim >= RECLAIM_INTERVAL) {
+        epoch_reclaim();
+    }
+}
+
+void epoch_reclaim(void) {
+    retired_list_t *list = &thread_retired_list;
+    uint64_t epoch;
+    size_t freed = 0;
+
+    list->retired_since_reclaim = 0;
+    if (list->length == 0) {
+        return;
+    }
+
+    epoch = try_advance();
+
+    /*
+     * Objects were retired in order, so the ones that can be freed are at the
+     * front of the list.
+     */
+    while (freed < list->length && list->objects[freed].epoch + 2 <= epoch) {
+        list->objects[freed].free_function(list->objects[freed].object);
+        freed++;
+    }
+
+    memmove(
+        list->objects,
+        list->objects + freed,
+        (list->length - freed) * sizeof(retired_object_t)
+    );
+    list->length -= freed;
+}
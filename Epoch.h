@@ -0,0 +1,46 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+
+/**
+ * Epoch-based reclamation.
+ *
+ * Readers read shared data between epoch_enter and epoch_exit without locking
+ * anything and without writing anything that other readers write: entering
+ * and exiting only write the calling thread's own epoch record. Writers never
+ * free data that readers may still see. They unlink it so that new readers
+ * cannot find it, then hand it to epoch_retire, which frees it once every
+ * reader that could have seen it has exited.
+ *
+ * The global epoch only advances when every reader that is currently reading
+ * has seen the current epoch. Data retired in an epoch is freed once the
+ * global epoch is two epochs later, because by then every reader that started
+ * before the data was retired has exited.
+ */
+
+/**
+ * Starts reading shared data. Calls must not be nested.
+ */
+void epoch_enter(void);
+
+/**
+ * Stops reading shared data.
+ */
+void epoch_exit(void);
+
+/**
+ * Frees the object with the given function once no reader can still be
+ * reading it. The object must already be unreachable for new readers.
+ *
+ * Each thread keeps its own list of retired objects, and only frees them
+ * (without ever waiting for readers) when it calls epoch_retire or
+ * epoch_reclaim.
+ */
+void epoch_retire(void (*free_function)(void *object), void *object);
+
+/**
+ * Tries to advance the global epoch, and frees the objects retired by the
+ * calling thread that no reader can still be reading. This never blocks.
+ */
+void epoch_reclaim(void);
+
+#endif
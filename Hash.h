@@ -0,0 +1,21 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Hashes an integer key (such as an alarm ID or a time value) into a bucket
+ * index. The number of buckets must be a power of two.
+ *
+ * This is Fibonacci hashing: multiplying by 2^32 divided by the golden ratio
+ * spreads consecutive keys (which are very common for alarm IDs) evenly
+ * across the buckets.
+ */
+static inline size_t hash_key(int key, size_t number_of_buckets) {
+    uint32_t hash = (uint32_t) key * 2654435769u;
+
+    return (hash ^ (hash >> 16)) & (number_of_buckets - 1);
+}
+
+#endif
@@ -0,0 +1,109 @@
+#include "Latency_Histogram.h"
+
+/*******************************************************************************
+ *                           HELPER FUNCTIONS                                  *
+ ******************************************************************************/
+
+/**
+ * Returns the bucket of a value. Values below LATENCY_HISTOGRAM_SUB_BUCKETS
+ * have a bucket each. Above that, the bucket is given by the position of the
+ * highest bit that is set and the LATENCY_HISTOGRAM_SUB_BUCKET_BITS bits after
+ * it.
+ */
+static int bucket_for_value(uint64_t value) {
+    int highest_bit;
+
+    if (value < LATENCY_HISTOGRAM_SUB_BUCKETS) {
+        return (int) value;
+    }
+
+    highest_bit = 63 - __builtin_clzll(value);
+
+    return (highest_bit - LATENCY_HISTOGRAM_SUB_BUCKET_BITS + 1) * LATENCY_HISTOGRAM_SUB_BUCKETS
+        + (int) ((value >> (highest_bit - LATENCY_HISTOGRAM_SUB_BUCKET_BITS))
+                 & (LATENCY_HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+/**
+ * Returns the highest value that falls in a bucket.
+ */
+static uint64_t highest_value_in_bucket(int bucket) {
+    int power = bucket / LATENCY_HISTOGRAM_SUB_BUCKETS;
+    uint64_t sub_bucket = bucket % LATENCY_HISTOGRAM_SUB_BUCKETS;
+    int shift;
+
+    if (power == 0) {
+        return sub_bucket;
+    }
+
+    shift = power - 1;
+
+    return ((LATENCY_HISTOGRAM_SUB_BUCKETS + sub_bucket + 1) << shift) - 1;
+}
+
+/*******************************************************************************
+ *                              PUBLIC FUNCTIONS                               *
+ ******************************************************************************/
+
+void latency_histogram_record(latency_histogram_t *histogram, uint64_t nanoseconds) {
+    unsigned long max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+
+    atomic_fetch_add_explicit(
+        &histogram->counts[bucket_for_value(nanoseconds)],
+        1,
+        memory_order_relaxed
+    );
+    atomic_fetch_add_explicit(&histogram->sum, nanoseconds, memory_order_relaxed);
+
+    while (nanoseconds > max
+           && !atomic_compare_exchange_weak_explicit(
+                  &histogram->max,
+                  &max,
+                  nanoseconds,
+                  memory_order_relaxed,
+                  memory_order_relaxed)) {
+    }
+}
+
+latency_histogram_statistics_t latency_histogram_statistics(latency_histogram_t *histogram) {
+    static const double fractions[] = {0.50, 0.99, 0.999};
+    latency_histogram_statistics_t statistics = {0, 0, 0, 0, 0, 0};
+    unsigned long counts[LATENCY_HISTOGRAM_BUCKETS];
+    uint64_t *percentiles[] = {&statistics.p50, &statistics.p99, &statistics.p999};
+    unsigned long seen = 0;
+    int next = 0;
+
+    /*
+     * Take one copy of the counts, so that the count and the percentiles
+     * agree even while other threads keep recording.
+     */
+    for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+        counts[i] = atomic_load_explicit(&histogram->counts[i], memory_order_relaxed);
+        statistics.count += counts[i];
+    }
+    statistics.sum = atomic_load_explicit(&histogram->sum, memory_order_relaxed);
+    statistics.max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+
+    if (statistics.count == 0) {
+        return statistics;
+    }
+
+    for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS && next < 3; i++) {
+        seen += counts[i];
+        while (next < 3 && seen >= fractions[next] * statistics.count) {
+            *percentiles[next] = highest_value_in_bucket(i);
+            next++;
+        }
+    }
+
+    /*
+     * A bucket's highest value may be above the largest value recorded.
+     */
+    for (int i = 0; i < 3; i++) {
+        if (*percentiles[i] > statistics.max) {
+            *percentiles[i] = statistics.max;
+        }
+    }
+
+    return statistics;
+}
@@ -0,0 +1,79 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * Each power of two is split into 2^LATENCY_HISTOGRAM_SUB_BUCKET_BITS
+ * buckets, so a recorded value is known to within about 3%.
+ */
+#define LATENCY_HISTOGRAM_SUB_BUCKET_BITS 5
+#define LATENCY_HISTOGRAM_SUB_BUCKETS (1 << LATENCY_HISTOGRAM_SUB_BUCKET_BITS)
+#define LATENCY_HISTOGRAM_BUCKETS \
+    ((64 - LATENCY_HISTOGRAM_SUB_BUCKET_BITS) * LATENCY_HISTOGRAM_SUB_BUCKETS)
+
+/**
+ * A histogram of latencies in nanoseconds, with buckets that get wider as the
+ * values get larger (log-linear, like an HDR histogram), so that it covers
+ * every value from 1 ns up with the same relative precision in a fixed amount
+ * of memory.
+ *
+ * Any number of threads can record values at the same time, and any thread can
+ * read the histogram while they do. Recording only increments an atomic
+ * counter (and updates the maximum when it grows), so it never locks or waits
+ * for anything. A histogram that is all zeros (for example, a static one) is
+ * empty and ready to use.
+ */
+typedef struct latency_histogram_t {
+    const char *name;               // Only used when the histogram is printed.
+    atomic_ulong counts[LATENCY_HISTOGRAM_BUCKETS];
+    atomic_ulong sum;               // Of all the values recorded.
+    atomic_ulong max;
+} latency_histogram_t;
+
+/**
+ * A summary of a histogram. Percentiles are the highest value of the bucket
+ * that the percentile falls in, so they are never lower than the real value.
+ */
+typedef struct latency_histogram_statistics_t {
+    unsigned long count;
+    uint64_t sum;                   // In nanoseconds.
+    uint64_t p50;
+    uint64_t p99;
+    uint64_t p999;
+    uint64_t max;
+} latency_histogram_statistics_t;
+
+/**
+ * Returns the current time on the monotonic clock in nanoseconds, for timing
+ * the values to record.
+ */
+static inline uint64_t latency_clock_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+/**
+ * Adds a value (in nanoseconds) to a histogram.
+ */
+void latency_histogram_record(latency_histogram_t *histogram, uint64_t nanoseconds);
+
+/**
+ * Adds the time since the given start time (from latency_clock_now) to a
+ * histogram.
+ */
+static inline void latency_histogram_record_since(latency_histogram_t *histogram, uint64_t start) {
+    latency_histogram_record(histogram, latency_clock_now() - start);
+}
+
+/**
+ * Returns a summary of the values recorded in a histogram so far. Values that
+ * are recorded while this runs may or may not be counted.
+ */
+latency_histogram_statistics_t latency_histogram_statistics(latency_histogram_t *histogram);
+
+#endif
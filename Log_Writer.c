@@ -0,0 +1,569 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "errors.h"
+#include "Log_Writer.h"
+
+#define CACHE_LINE_SIZE 64
+
+/**
+ * Size of each thread's log buffer in bytes. It must be a power of two.
+ */
+#define LOG_BUFFER_SIZE 65536
+
+/**
+ * Size of the log writer thread's output buffer. Messages are copied into it
+ * and written out with one write() call once it is full (or there are no more
+ * messages to write).
+ */
+#define OUTPUT_BUFFER_SIZE 65536
+
+/**
+ * Set in the flags of a record whose text is not in the log buffer: the
+ * record holds an external_text_t instead.
+ */
+#define LOG_RECORD_EXTERNAL 1
+
+/**
+ * The header of each message in a log buffer. The text of the message follows
+ * it, padded to a multiple of 8 bytes.
+ */
+typedef struct log_record_header_t {
+    uint64_t sequence_number;   // Order the message was logged in.
+    uint32_t length;            // Length of the text (in the log buffer).
+    uint32_t flags;
+} log_record_header_t;
+
+/**
+ * The text of a message that is too long to format on the stack, which is
+ * allocated with malloc and freed by whoever writes (or drops) it.
+ */
+typedef struct external_text_t {
+    char *text;
+    size_t length;
+} external_text_t;
+
+/**
+ * A thread's log buffer: a single-producer, single-consumer ring of bytes.
+ * The thread that owns it is the producer and the log writer thread is the
+ * consumer. The positions count bytes, so they never wrap around in practice.
+ */
+typedef struct log_buffer_t {
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t write_position; // Producer only.
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t read_position;  // Writer only.
+    _Alignas(CACHE_LINE_SIZE) char data[LOG_BUFFER_SIZE];
+    atomic_bool closed;             // The owning thread has exited.
+    struct log_buffer_t *next;      // Next buffer in the list of buffers.
+} log_buffer_t;
+
+/**
+ * A message that the log writer thread has found in a log buffer.
+ */
+typedef struct pending_record_t {
+    uint64_t sequence_number;
+    log_buffer_t *buffer;
+    size_t position;            // Position of the record in the buffer.
+    size_t length;              // Length of the text (in the log buffer).
+    uint32_t flags;
+} pending_record_t;
+
+/*******************************************************************************
+ *                                LOG STATE                                    *
+ ******************************************************************************/
+
+/**
+ * Whether the log writer thread has been started.
+ */
+static bool started = false;
+
+static int output_fd;
+
+static log_overflow_policy overflow_policy;
+
+/**
+ * The spill file, and the mutex that threads lock to append to it.
+ */
+static FILE *spill_file;
+static pthread_mutex_t spill_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Each thread's log buffer.
+ */
+static pthread_key_t buffer_key;
+
+/**
+ * The list of every log buffer. Threads add their buffer when they log their
+ * first message. Only the log writer thread removes buffers from it (once
+ * their thread has exited and they are empty).
+ */
+static log_buffer_t *buffers = NULL;
+static pthread_mutex_t buffers_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * The next sequence number to give to a message.
+ */
+static atomic_uint_fast64_t next_sequence_number = 0;
+
+/**
+ * Used for waking up the log writer thread when there are new messages, and
+ * threads that are waiting for room in their log buffer (Log_Block policy).
+ */
+static pthread_mutex_t wakeup_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t messages_available = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t room_available = PTHREAD_COND_INITIALIZER;
+static atomic_bool writer_waiting = false;
+static atomic_int number_of_blocked_threads = 0;
+
+static atomic_size_t dropped_count = 0;
+static atomic_size_t spilled_count = 0;
+
+/*******************************************************************************
+ *                           HELPER FUNCTIONS                                  *
+ ******************************************************************************/
+
+/**
+ * Returns the number of bytes that a record with a text of the given length
+ * takes in a log buffer.
+ */
+static size_t record_size(size_t length) {
+    return sizeof(log_record_header_t) + ((length + 7) & ~(size_t) 7);
+}
+
+/**
+ * Copies bytes into a log buffer at the given position, wrapping around the
+ * end of the buffer.
+ */
+static void copy_to_buffer(log_buffer_t *buffer, size_t position, const void *source, size_t size) {
+    size_t offset = position & (LOG_BUFFER_SIZE - 1);
+    size_t first = LOG_BUFFER_SIZE - offset < size ? LOG_BUFFER_SIZE - offset : size;
+
+    memcpy(buffer->data + offset, source, first);
+    memcpy(buffer->data, (const char *) source + first, size - first);
+}
+
+/**
+ * Copies bytes out of a log buffer at the given position, wrapping around the
+ * end of the buffer.
+ */
+static void copy_from_buffer(log_buffer_t *buffer, size_t position, void *destination, size_t size) {
+    size_t offset = position & (LOG_BUFFER_SIZE - 1);
+    size_t first = LOG_BUFFER_SIZE - offset < size ? LOG_BUFFER_SIZE - offset : size;
+
+    memcpy(destination, buffer->data + offset, first);
+    memcpy((char *) destination + first, buffer->data, size - first);
+}
+
+/**
+ * Marks a thread's log buffer as closed when the thread exits. The log writer
+ * thread frees it once everything in it has been written.
+ */
+static void close_buffer(void *arg) {
+    log_buffer_t *buffer = arg;
+
+    atomic_store(&buffer->closed, true);
+}
+
+/**
+ * Returns the calling thread's log buffer, creating it the first time.
+ */
+static log_buffer_t *get_buffer() {
+    log_buffer_t *buffer = pthread_getspecific(buffer_key);
+
+    if (buffer == NULL) {
+        buffer = aligned_alloc(CACHE_LINE_SIZE, sizeof(log_buffer_t));
+        if (buffer == NULL) {
+            errno_abort("Aligned_alloc failed");
+        }
+        atomic_init(&buffer->write_position, 0);
+        atomic_init(&buffer->read_position, 0);
+        atomic_init(&buffer->closed, false);
+        pthread_setspecific(buffer_key, buffer);
+
+        pthread_mutex_lock(&buffers_mutex);
+        buffer->next = buffers;
+        buffers = buffer;
+        pthread_mutex_unlock(&buffers_mutex);
+    }
+
+    return buffer;
+}
+
+/**
+ * Returns true if the buffer has room for the given number of bytes.
+ */
+static bool has_room(log_buffer_t *buffer, size_t write_position, size_t size) {
+    return write_position + size - atomic_load(&buffer->read_position) <= LOG_BUFFER_SIZE;
+}
+
+/**
+ * Waits until the log writer thread has made room for the given number of
+ * bytes in the buffer (Log_Block policy).
+ *
+ * The thread counts itself as blocked before it checks the buffer again, and
+ * the log writer thread moves the read position before it checks the count,
+ * so one of them always sees the other.
+ */
+static void wait_for_room(log_buffer_t *buffer, size_t write_position, size_t size) {
+    pthread_mutex_lock(&wakeup_mutex);
+    atomic_fetch_add(&number_of_blocked_threads, 1);
+    while (!has_room(buffer, write_position, size)) {
+        pthread_cond_wait(&room_available, &wakeup_mutex);
+    }
+    atomic_fetch_sub(&number_of_blocked_threads, 1);
+    pthread_mutex_unlock(&wakeup_mutex);
+}
+
+/**
+ * Writes the whole output buffer to the output file descriptor.
+ */
+static void write_output(const char *output, size_t length) {
+    ssize_t written;
+
+    while (length > 0) {
+        written = write(output_fd, output, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            errno_abort("Write failed");
+        }
+        output += written;
+        length -= written;
+    }
+}
+
+static int compare_pending_records(const void *a, const void *b) {
+    uint64_t x = ((const pending_record_t *) a)->sequence_number;
+    uint64_t y = ((const pending_record_t *) b)->sequence_number;
+
+    return (x > y) - (x < y);
+}
+
+/*******************************************************************************
+ *                             LOG WRITER THREAD                               *
+ ******************************************************************************/
+
+/**
+ * Log writer thread.
+ *
+ * Each round, it finds every message in every log buffer, sorts them by
+ * sequence number, and writes them out in order. It stops at the first missing
+ * sequence number (a message that a thread is still copying into its buffer),
+ * so the messages are written in exactly the order they were logged.
+ */
+static void *log_writer_thread_routine(void *arg) {
+    static char output[OUTPUT_BUFFER_SIZE];
+    size_t output_length = 0;
+
+    pending_record_t *pending = NULL;
+    size_t number_of_pending = 0;
+    size_t pending_capacity = 0;
+
+    uint64_t next_to_write = 0;
+    log_record_header_t header;
+    external_text_t external;
+    log_buffer_t *buffer;
+    log_buffer_t **link;
+    size_t position;
+    size_t end;
+    size_t i;
+    bool any_messages;
+
+    while (1) {
+        /*
+         * Find every message in every buffer.
+         */
+        number_of_pending = 0;
+        pthread_mutex_lock(&buffers_mutex);
+        for (buffer = buffers; buffer != NULL; buffer = buffer->next) {
+            end = atomic_load_explicit(&buffer->write_position, memory_order_acquire);
+            position = atomic_load_explicit(&buffer->read_position, memory_order_relaxed);
+
+            while (position != end) {
+                if (number_of_pending == pending_capacity) {
+                    pending_capacity = pending_capacity == 0 ? 1024 : 2 * pending_capacity;
+                    pending = realloc(pending, pending_capacity * sizeof(pending_record_t));
+                    if (pending == NULL) {
+                        errno_abort("Realloc failed");
+                    }
+                }
+
+                copy_from_buffer(buffer, position, &header, sizeof(header));
+                pending[number_of_pending].sequence_number = header.sequence_number;
+                pending[number_of_pending].buffer = buffer;
+                pending[number_of_pending].position = position;
+                pending[number_of_pending].length = header.length;
+                pending[number_of_pending].flags = header.flags;
+                number_of_pending++;
+
+                position += record_size(header.length);
+            }
+        }
+        pthread_mutex_unlock(&buffers_mutex);
+
+        qsort(pending, number_of_pending, sizeof(pending_record_t), compare_pending_records);
+
+        /*
+         * Write the messages in order, up to the first missing one. The
+         * messages of each buffer are in order, so each buffer's space is
+         * given back in order too.
+         */
+        for (i = 0; i < number_of_pending && pending[i].sequence_number == next_to_write; i++) {
+            if (pending[i].flags & LOG_RECORD_EXTERNAL) {
+                copy_from_buffer(
+                    pending[i].buffer,
+                    pending[i].position + sizeof(log_record_header_t),
+                    &external,
+                    sizeof(external)
+                );
+
+                /*
+                 * It is written straight from its own memory, after what is
+                 * already in the output buffer.
+                 */
+                write_output(output, output_length);
+                output_length = 0;
+                write_output(external.text, external.length);
+                free(external.text);
+            } else {
+                if (output_length + pending[i].length > OUTPUT_BUFFER_SIZE) {
+                    write_output(output, output_length);
+                    output_length = 0;
+                }
+
+                copy_from_buffer(
+                    pending[i].buffer,
+                    pending[i].position + sizeof(log_record_header_t),
+                    output + output_length,
+                    pending[i].length
+                );
+                output_length += pending[i].length;
+            }
+
+            atomic_store(
+                &pending[i].buffer->read_position,
+                pending[i].position + record_size(pending[i].length)
+            );
+            next_to_write++;
+        }
+
+        write_output(output, output_length);
+        output_length = 0;
+
+        /*
+         * Wake up the threads waiting for room.
+         */
+        if (i > 0 && atomic_load(&number_of_blocked_threads) > 0) {
+            pthread_mutex_lock(&wakeup_mutex);
+            pthread_cond_broadcast(&room_available);
+            pthread_mutex_unlock(&wakeup_mutex);
+        }
+
+        /*
+         * Free the buffers of threads that have exited, once they are empty.
+         */
+        pthread_mutex_lock(&buffers_mutex);
+        link = &buffers;
+        while (*link != NULL) {
+            buffer = *link;
+            if (atomic_load(&buffer->closed)
+                && atomic_load(&buffer->write_position) == atomic_load(&buffer->read_position)) {
+                *link = buffer->next;
+                free(buffer);
+            } else {
+                link = &buffer->next;
+            }
+        }
+        pthread_mutex_unlock(&buffers_mutex);
+
+        if (i > 0) {
+            continue;
+        }
+
+        /*
+         * A message is missing because a thread is still copying it, which
+         * takes very little time.
+         */
+        if (number_of_pending > 0) {
+            sched_yield();
+            continue;
+        }
+
+        /*
+         * There are no messages, so wait for one. The writer says it is
+         * waiting before it checks the buffers again, and threads move their
+         * write position before they check whether the writer is waiting, so
+         * one of them always sees the other.
+         */
+        pthread_mutex_lock(&wakeup_mutex);
+        atomic_store(&writer_waiting, true);
+
+        any_messages = false;
+        pthread_mutex_lock(&buffers_mutex);
+        for (buffer = buffers; buffer != NULL && !any_messages; buffer = buffer->next) {
+            any_messages = atomic_load(&buffer->write_position)
+                != atomic_load(&buffer->read_position);
+        }
+        pthread_mutex_unlock(&buffers_mutex);
+
+        if (!any_messages) {
+            pthread_cond_wait(&messages_available, &wakeup_mutex);
+        }
+
+        atomic_store(&writer_waiting, false);
+        pthread_mutex_unlock(&wakeup_mutex);
+    }
+
+    return NULL;
+}
+
+/*******************************************************************************
+ *                              PUBLIC FUNCTIONS                               *
+ ******************************************************************************/
+
+void log_writer_start(int fd, log_overflow_policy policy, const char *spill_path) {
+    pthread_t thread;
+    int status;
+
+    output_fd = fd;
+    overflow_policy = policy;
+
+    if (policy == Log_Spill) {
+        spill_file = fopen(spill_path, "a");
+        if (spill_file == NULL) {
+            errno_abort("Open spill file");
+        }
+    }
+
+    status = pthread_key_create(&buffer_key, close_buffer);
+    if (status != 0) {
+        err_abort(status, "Create log buffer key");
+    }
+
+    /*
+     * Anything printed with printf so far must come out before the log.
+     */
+    fflush(stdout);
+
+    status = pthread_create(&thread, NULL, log_writer_thread_routine, NULL);
+    if (status != 0) {
+        err_abort(status, "Create log writer thread");
+    }
+
+    started = true;
+}
+
+void log_vprintf(const char *format, va_list args) {
+    char message[LOG_INLINE_MESSAGE_SIZE];
+    log_record_header_t header = {0};
+    external_text_t external = {NULL, 0};
+    log_buffer_t *buffer;
+    size_t write_position;
+    size_t size;
+    va_list copy;
+    int length;
+
+    if (!started) {
+        vprintf(format, args);
+        return;
+    }
+
+    /*
+     * Format the message on the stack, so nothing is shared yet. One that
+     * does not fit is formatted again into memory of its own, rather than
+     * cut off (which would lose its newline and run the next message onto
+     * the same line).
+     */
+    va_copy(copy, args);
+    length = vsnprintf(message, sizeof(message), format, copy);
+    va_end(copy);
+    if (length < 0) {
+        return;
+    }
+    if (length > LOG_INLINE_MESSAGE_SIZE - 1) {
+        external.text = malloc(length + 1);
+        if (external.text == NULL) {
+            errno_abort("Malloc failed");
+        }
+        external.length = vsnprintf(external.text, length + 1, format, args);
+        header.flags = LOG_RECORD_EXTERNAL;
+        length = sizeof(external);
+    }
+
+    buffer = get_buffer();
+    write_position = atomic_load_explicit(&buffer->write_position, memory_order_relaxed);
+    size = record_size(length);
+
+    /*
+     * If the log writer thread has fallen behind, follow the overflow policy.
+     */
+    if (!has_room(buffer, write_position, size)) {
+        switch (overflow_policy) {
+            case Log_Drop:
+                free(external.text);
+                atomic_fetch_add_explicit(&dropped_count, 1, memory_order_relaxed);
+                return;
+
+            case Log_Spill:
+                pthread_mutex_lock(&spill_mutex);
+                if (external.text != NULL) {
+                    fwrite(external.text, 1, external.length, spill_file);
+                } else {
+                    fwrite(message, 1, length, spill_file);
+                }
+                fflush(spill_file);
+                pthread_mutex_unlock(&spill_mutex);
+                free(external.text);
+                atomic_fetch_add_explicit(&spilled_count, 1, memory_order_relaxed);
+                return;
+
+            case Log_Block:
+            default:
+                wait_for_room(buffer, write_position, size);
+                break;
+        }
+    }
+
+    /*
+     * The sequence number is taken only once there is room for the message,
+     * so the log writer thread never waits for a message that will not come.
+     */
+    header.sequence_number = atomic_fetch_add(&next_sequence_number, 1);
+    header.length = length;
+
+    copy_to_buffer(buffer, write_position, &header, sizeof(header));
+    copy_to_buffer(
+        buffer,
+        write_position + sizeof(header),
+        external.text != NULL ? (const void *) &external : (const void *) message,
+        length
+    );
+    atomic_store(&buffer->write_position, write_position + size);
+
+    /*
+     * Wake up the log writer thread if it is waiting.
+     */
+    if (atomic_load(&writer_waiting)) {
+        pthread_mutex_lock(&wakeup_mutex);
+        pthread_cond_signal(&messages_available);
+        pthread_mutex_unlock(&wakeup_mutex);
+    }
+}
+
+void log_printf(const char *format, ...) {
+    va_list args;
+
+    va_start(args, format);
+    log_vprintf(format, args);
+    va_end(args);
+}
+
+size_t log_dropped_count(void) {
+    return atomic_load(&dropped_count);
+}
+
+size_t log_spilled_count(void) {
+    return atomic_load(&spilled_count);
+}
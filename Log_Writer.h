@@ -0,0 +1,58 @@
+#ifndef LOG_WRITER_H
+#define LOG_WRITER_H
+
+#include <stdarg.h>
+#include <stddef.h>
+
+/**
+ * What a thread does with a message when its log buffer is full (because the
+ * log writer thread has fallen behind).
+ */
+typedef enum log_overflow_policy {
+    Log_Block,      // Wait until the log writer thread makes room.
+    Log_Drop,       // Drop the message and count it.
+    Log_Spill       // Append the message to the spill file instead.
+} log_overflow_policy;
+
+/**
+ * Initializes the log and starts the log writer thread, which writes every
+ * message to the given file descriptor. The spill file is only used (and only
+ * opened) with the Log_Spill policy.
+ *
+ * Messages that are logged before this is called are printed directly with
+ * printf.
+ */
+void log_writer_start(int fd, log_overflow_policy policy, const char *spill_path);
+
+/**
+ * Logs a message, formatted as if you were calling printf.
+ *
+ * The message is formatted into the calling thread's own log buffer without
+ * locking anything, and written out later by the log writer thread. Messages
+ * from all the threads are written in the order this function was called in.
+ * A message can be any length: one longer than LOG_INLINE_MESSAGE_SIZE bytes
+ * is formatted into memory of its own, and only a pointer to it goes into the
+ * log buffer.
+ */
+void log_printf(const char *format, ...)
+    __attribute__((format(printf, 1, 2)));
+
+/**
+ * Same as log_printf, but takes a va_list.
+ */
+void log_vprintf(const char *format, va_list args);
+
+/**
+ * Returns the number of messages dropped so far (with the Log_Drop policy).
+ */
+size_t log_dropped_count(void);
+
+/**
+ * Returns the number of messages written to the spill file so far (with the
+ * Log_Spill policy).
+ */
+size_t log_spilled_count(void);
+
+#define LOG_INLINE_MESSAGE_SIZE 1024
+
+#endif
@@ -0,0 +1,227 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include "errors.h"
+#include "Message_Store.h"
+
+#define CACHE_LINE_SIZE 64
+
+/**
+ * The store is split into stripes by hash, each with its own lock and its own
+ * hash table, so threads interning different messages rarely wait for each
+ * other. This must be a power of two.
+ */
+#define MESSAGE_STORE_STRIPE_BITS 6
+#define MESSAGE_STORE_STRIPES (1 << MESSAGE_STORE_STRIPE_BITS)
+
+#define INITIAL_NUMBER_OF_BUCKETS 16
+
+/**
+ * One stripe of the store: a chained hash table of the messages whose hashes
+ * fall in this stripe.
+ */
+typedef struct message_stripe_t {
+    _Alignas(CACHE_LINE_SIZE) pthread_mutex_t mutex; // Protects the fields
+                                                     // below.
+    message_t **buckets;
+    size_t number_of_buckets;       // A power of two.
+    size_t number_of_messages;
+    size_t number_of_bytes;
+} message_stripe_t;
+
+static message_stripe_t stripes[MESSAGE_STORE_STRIPES];
+static pthread_once_t stripes_once = PTHREAD_ONCE_INIT;
+
+/*******************************************************************************
+ *                           HELPER FUNCTIONS                                  *
+ ******************************************************************************/
+
+static void init_stripes(void) {
+    for (int i = 0; i < MESSAGE_STORE_STRIPES; i++) {
+        pthread_mutex_init(&stripes[i].mutex, NULL);
+        stripes[i].buckets = calloc(INITIAL_NUMBER_OF_BUCKETS, sizeof(message_t *));
+        if (stripes[i].buckets == NULL) {
+            errno_abort("Calloc failed");
+        }
+        stripes[i].number_of_buckets = INITIAL_NUMBER_OF_BUCKETS;
+        stripes[i].number_of_messages = 0;
+        stripes[i].number_of_bytes = 0;
+    }
+}
+
+/**
+ * Hashes the text of a message (FNV-1a). The low bits choose the stripe and
+ * the bits above them choose the bucket in the stripe.
+ */
+static uint64_t hash_text(const char *text, size_t length) {
+    uint64_t hash = 14695981039346656037ull;
+
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char) text[i]) * 1099511628211ull;
+    }
+
+    return hash;
+}
+
+static message_stripe_t *stripe_for_hash(uint64_t hash) {
+    return &stripes[hash & (MESSAGE_STORE_STRIPES - 1)];
+}
+
+static message_t **bucket_for_hash(message_stripe_t *stripe, uint64_t hash) {
+    return &stripe->buckets[
+        (hash >> MESSAGE_STORE_STRIPE_BITS) & (stripe->number_of_buckets - 1)
+    ];
+}
+
+/**
+ * Doubles the number of buckets of a stripe. The stripe must be locked.
+ */
+static void grow_stripe(message_stripe_t *stripe) {
+    message_t **old_buckets = stripe->buckets;
+    size_t old_number_of_buckets = stripe->number_of_buckets;
+    message_t *message;
+    message_t **bucket;
+
+    stripe->buckets = calloc(2 * old_number_of_buckets, sizeof(message_t *));
+    if (stripe->buckets == NULL) {
+        errno_abort("Calloc failed");
+    }
+    stripe->number_of_buckets = 2 * old_number_of_buckets;
+
+    for (size_t i = 0; i < old_number_of_buckets; i++) {
+        while (old_buckets[i] != NULL) {
+            message = old_buckets[i];
+            old_buckets[i] = message->next;
+
+            bucket = bucket_for_hash(stripe, message->hash);
+            message->next = *bucket;
+            *bucket = message;
+        }
+    }
+
+    free(old_buckets);
+}
+
+/*******************************************************************************
+ *                              PUBLIC FUNCTIONS                               *
+ ******************************************************************************/
+
+message_t *message_intern(const char *text, size_t length) {
+    uint64_t hash = hash_text(text, length);
+    message_stripe_t *stripe;
+    message_t **bucket;
+    message_t *message;
+
+    pthread_once(&stripes_once, init_stripes);
+
+    stripe = stripe_for_hash(hash);
+    pthread_mutex_lock(&stripe->mutex);
+
+    bucket = bucket_for_hash(stripe, hash);
+    for (message = *bucket; message != NULL; message = message->next) {
+        if (message->hash == hash
+            && message->length == length
+            && memcmp(message->text, text, length) == 0) {
+            message_retain(message);
+            pthread_mutex_unlock(&stripe->mutex);
+            return message;
+        }
+    }
+
+    message = malloc(sizeof(message_t) + length + 1);
+    if (message == NULL) {
+        errno_abort("Malloc failed");
+    }
+    atomic_init(&message->reference_count, 1);
+    message->hash = hash;
+    message->length = length;
+    memcpy(message->text, text, length);
+    message->text[length] = 0;
+
+    message->next = *bucket;
+    *bucket = message;
+    stripe->number_of_messages++;
+    stripe->number_of_bytes += length;
+
+    /*
+     * Keep the chains short.
+     */
+    if (stripe->number_of_messages > 2 * stripe->number_of_buckets) {
+        grow_stripe(stripe);
+    }
+
+    pthread_mutex_unlock(&stripe->mutex);
+
+    return message;
+}
+
+void message_release(message_t *message) {
+    unsigned int count = atomic_load_explicit(
+        &message->reference_count,
+        memory_order_relaxed
+    );
+    message_stripe_t *stripe;
+    message_t **link;
+
+    /*
+     * While this is not the last reference, the message cannot be freed, so
+     * the count can be decremented without locking anything.
+     */
+    while (count > 1) {
+        if (atomic_compare_exchange_weak_explicit(
+                &message->reference_count,
+                &count,
+                count - 1,
+                memory_order_release,
+                memory_order_relaxed)) {
+            return;
+        }
+    }
+
+    /*
+     * This may be the last reference. The count only drops to zero with the
+     * stripe locked, and message_intern only finds the message with the stripe
+     * locked, so a message cannot be found again once it is being freed.
+     */
+    stripe = stripe_for_hash(message->hash);
+    pthread_mutex_lock(&stripe->mutex);
+
+    if (atomic_fetch_sub_explicit(&message->reference_count, 1, memory_order_acq_rel) == 1) {
+        link = bucket_for_hash(stripe, message->hash);
+        while (*link != message) {
+            link = &(*link)->next;
+        }
+        *link = message->next;
+
+        stripe->number_of_messages--;
+        stripe->number_of_bytes -= message->length;
+        free(message);
+    }
+
+    pthread_mutex_unlock(&stripe->mutex);
+}
+
+message_store_statistics_t message_store_statistics(void) {
+    message_store_statistics_t statistics = {0, 0};
+
+    pthread_once(&stripes_once, init_stripes);
+
+    for (int i = 0; i < MESSAGE_STORE_STRIPES; i++) {
+        pthread_mutex_lock(&stripes[i].mutex);
+        statistics.messages += stripes[i].number_of_messages;
+        statistics.bytes += stripes[i].number_of_bytes;
+        pthread_mutex_unlock(&stripes[i].mutex);
+    }
+
+    return statistics;
+}
+
+void message_store_print_statistics(FILE *stream) {
+    message_store_statistics_t statistics = message_store_statistics();
+
+    fprintf(
+        stream,
+        "Messages: Distinct = %zu Bytes = %zu\n",
+        statistics.messages,
+        statistics.bytes
+    );
+}
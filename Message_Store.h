@@ -0,0 +1,69 @@
+#ifndef MESSAGE_STORE_H
+#define MESSAGE_STORE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * An interned alarm message.
+ *
+ * The message store keeps one message_t for each distinct message text, so
+ * two messages are equal exactly when they are the same pointer. A message is
+ * reference counted: every holder (usually an alarm request) owns one
+ * reference, and the message is freed when the last one is released.
+ *
+ * The text never changes once the message has been interned, so any thread
+ * that holds a reference can read it without locking anything.
+ */
+typedef struct message_t {
+    atomic_uint reference_count;
+    uint64_t hash;
+    size_t length;                  // Not counting the terminating zero.
+    struct message_t *next;         // Next message in the same hash bucket.
+    char text[];                    // Zero-terminated.
+} message_t;
+
+/**
+ * A snapshot of the statistics of the message store.
+ */
+typedef struct message_store_statistics_t {
+    size_t messages;                // Distinct messages stored.
+    size_t bytes;                   // Bytes of text stored.
+} message_store_statistics_t;
+
+/**
+ * Returns the message with the given text (which does not need to be
+ * zero-terminated), adding it to the store if it is not there yet. The caller
+ * owns one reference to the message, which it must release with
+ * message_release.
+ */
+message_t *message_intern(const char *text, size_t length);
+
+/**
+ * Takes another reference to a message the caller already holds one to, and
+ * returns the message. This never locks anything.
+ */
+static inline message_t *message_retain(message_t *message) {
+    atomic_fetch_add_explicit(&message->reference_count, 1, memory_order_relaxed);
+    return message;
+}
+
+/**
+ * Releases a reference to a message, freeing the message if it was the last
+ * one.
+ */
+void message_release(message_t *message);
+
+/**
+ * Returns the current statistics of the message store.
+ */
+message_store_statistics_t message_store_statistics(void);
+
+/**
+ * Prints the statistics of the message store to the given stream.
+ */
+void message_store_print_statistics(FILE *stream);
+
+#endif
@@ -0,0 +1,190 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "errors.h"
+#include "Metrics_Server.h"
+
+#define REQUEST_BUFFER_SIZE 4096
+#define LISTEN_BACKLOG 16
+
+/**
+ * How long the server waits for a client to send its request, so that a
+ * client that connects and sends nothing does not block the others.
+ */
+#define REQUEST_TIMEOUT_SECONDS 1
+
+static int listen_socket;
+static metrics_writer_t metrics_writer;
+
+/*******************************************************************************
+ *                           HELPER FUNCTIONS                                  *
+ ******************************************************************************/
+
+/**
+ * Sends the whole buffer, giving up if the client has gone away. MSG_NOSIGNAL
+ * keeps a client that closed its end from killing the process with SIGPIPE.
+ */
+static void send_all(int client, const char *buffer, size_t length) {
+    ssize_t sent;
+
+    while (length > 0) {
+        sent = send(client, buffer, length, MSG_NOSIGNAL);
+        if (sent <= 0) {
+            if (sent < 0 && errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        buffer += sent;
+        length -= sent;
+    }
+}
+
+static void send_response(int client, const char *status, const char *content_type, const char *body, size_t length) {
+    char header[256];
+    int header_length = snprintf(
+        header,
+        sizeof(header),
+        "HTTP/1.1 %s\r\n"
+        "Content-Type: %s\r\n"
+        "Content-Length: %zu\r\n"
+        "Connection: close\r\n"
+        "\r\n",
+        status,
+        content_type,
+        length
+    );
+
+    send_all(client, header, header_length);
+    send_all(client, body, length);
+}
+
+/**
+ * Reads a request until the end of its header (only the request line is
+ * used). Returns false if the client sent nothing usable in time.
+ */
+static bool read_request(int client, char request[], size_t size) {
+    size_t length = 0;
+    ssize_t received;
+
+    while (length < size - 1) {
+        received = recv(client, request + length, size - 1 - length, 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            break;
+        }
+        length += received;
+        request[length] = 0;
+        if (strstr(request, "\r\n\r\n") != NULL || strstr(request, "\n\n") != NULL) {
+            return true;
+        }
+    }
+
+    request[length] = 0;
+
+    /*
+     * A request line on its own is enough.
+     */
+    return strchr(request, '\n') != NULL;
+}
+
+static void serve_client(int client) {
+    char request[REQUEST_BUFFER_SIZE];
+    char *body = NULL;
+    size_t length = 0;
+    FILE *stream;
+
+    if (!read_request(client, request, sizeof(request))) {
+        return;
+    }
+
+    if (strncmp(request, "GET ", strlen("GET ")) != 0) {
+        send_response(client, "405 Method Not Allowed", "text/plain", "Method Not Allowed\n",
+                      strlen("Method Not Allowed\n"));
+        return;
+    }
+
+    if (strncmp(request + strlen("GET "), "/metrics", strlen("/metrics")) != 0
+        || (request[strlen("GET /metrics")] != ' '
+            && request[strlen("GET /metrics")] != '?')) {
+        send_response(client, "404 Not Found", "text/plain", "Not Found\n",
+                      strlen("Not Found\n"));
+        return;
+    }
+
+    stream = open_memstream(&body, &length);
+    if (stream == NULL) {
+        errno_abort("Open_memstream failed");
+    }
+    metrics_writer(stream);
+    fclose(stream);
+
+    send_response(client, "200 OK", "text/plain; version=0.0.4; charset=utf-8", body, length);
+    free(body);
+}
+
+static void *metrics_server_thread_routine(void *arg) {
+    struct timeval timeout = {REQUEST_TIMEOUT_SECONDS, 0};
+    int client;
+
+    while (1) {
+        client = accept(listen_socket, NULL, NULL);
+        if (client < 0) {
+            continue;
+        }
+
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        serve_client(client);
+        close(client);
+    }
+
+    return NULL;
+}
+
+/*******************************************************************************
+ *                              PUBLIC FUNCTIONS                               *
+ ******************************************************************************/
+
+int metrics_server_start(int port, metrics_writer_t writer) {
+    struct sockaddr_in address;
+    socklen_t address_length = sizeof(address);
+    pthread_t thread;
+    int reuse = 1;
+    int status;
+
+    metrics_writer = writer;
+
+    listen_socket = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_socket < 0) {
+        errno_abort("Metrics socket failed");
+    }
+    setsockopt(listen_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+
+    if (bind(listen_socket, (struct sockaddr *) &address, sizeof(address)) != 0) {
+        errno_abort("Metrics bind failed");
+    }
+    if (listen(listen_socket, LISTEN_BACKLOG) != 0) {
+        errno_abort("Metrics listen failed");
+    }
+    if (getsockname(listen_socket, (struct sockaddr *) &address, &address_length) != 0) {
+        errno_abort("Metrics getsockname failed");
+    }
+
+    status = pthread_create(&thread, NULL, metrics_server_thread_routine, NULL);
+    if (status != 0) {
+        err_abort(status, "Create metrics server thread");
+    }
+    pthread_detach(thread);
+
+    return ntohs(address.sin_port);
+}
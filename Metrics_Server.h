@@ -0,0 +1,25 @@
+#ifndef METRICS_SERVER_H
+#define METRICS_SERVER_H
+
+#include <stdio.h>
+
+/**
+ * Writes the current metrics, in the Prometheus text format, to a stream.
+ */
+typedef void (*metrics_writer_t)(FILE *stream);
+
+/**
+ * Starts a thread that serves the metrics over HTTP on the given port of the
+ * loopback address (127.0.0.1), so only local programs such as a metrics agent
+ * can reach them. "GET /metrics" is answered with whatever the writer writes;
+ * any other path gets 404 Not Found. Returns the port (which is chosen by the
+ * system if the given port is 0).
+ *
+ * Requests are served one at a time on the server thread, so the writer is
+ * never called by two threads at once. The writer runs while the rest of the
+ * program keeps going, so it should only read values that can be read without
+ * locking (atomics).
+ */
+int metrics_server_start(int port, metrics_writer_t writer);
+
+#endif
@@ -4,22 +4,59 @@
 #include "types.h"
 #include "debug.h"
 #include "Command_Parser.h"
+#include "Alarm_List.h"
+#include "Time_Value_Index.h"
+#include "Timing_Wheel.h"
+#include "Ring_Buffer.h"
+#include "Object_Pool.h"
+#include "Alarm_Request.h"
+#include "Log_Writer.h"
+#include "Epoch.h"
+#include "Display_Snapshot.h"
+#include "Hash.h"
+#include "Latency_Histogram.h"
+#include "Metrics_Server.h"
+#include "Command_Server.h"
+#include "Write_Ahead_Log.h"
+#include "Checkpoint.h"
+#include "Worker_Pool.h"
 #include <semaphore.h>
+#include <getopt.h>
+#include <signal.h>
+#include <limits.h>
 
-#define USER_INPUT_BUFFER_SIZE 256
+#define BATCH_INPUT_BUFFER_SIZE 65536
+#define MAXIMUM_BATCH_SIZE 1024
 #define CIRCULAR_BUFFER_SIZE 4
 
 #define MAIN_THREAD_ID 1
 #define ALARM_THREAD_ID 2
-#define CONSUMER_THREAD_ID 3
-#define PERIODIC_DISPLAY_THREAD_START_ID 4
+#define CONSUMER_THREAD_ID 3 // ID of the first consumer thread. Periodic
+                             // display threads are numbered after the last.
+#define MAXIMUM_NUMBER_OF_CONSUMERS 64
+#define MAXIMUM_NUMBER_OF_DISPLAY_WORKERS 1024
+#define MAXIMUM_CONSUMER_BATCH_SIZE 64
+#define DEFAULT_SPILL_FILE "alarm_output.spill"
+#define DEFAULT_WAL_SYNC_COUNT 1024
+#define ALARM_IDS_STRING_SIZE 128
+
+/**
+ * Values of the command line options that have no short form.
+ */
+#define WAL_SYNC_INTERVAL_OPTION 256
+#define WAL_SYNC_COUNT_OPTION 257
+
+/**
+ * Length of a tick of the display timing wheel, in milliseconds.
+ */
+#define TIMING_WHEEL_TICK_MILLISECONDS 1
 
 
 /**
  * Make a copy of an alarm request.
  *
- * Note that the alarm request that is returned is malloced, so it must be freed
- * later.
+ * Note that the alarm request that is returned is allocated from the alarm
+ * request pool, so it must be freed later.
  *
  * This function is useful because we may need to delete alarm requests in the
  * alarm list while the consumer thread still needs references to those alarm
@@ -29,10 +66,7 @@ alarm_request_t *copy_alarm_request(alarm_request_t *alarm_request) {
     /*
      * Allocate memory for the copy of the alarm request
      */
-    alarm_request_t *alarm_request_copy = malloc(sizeof(alarm_request_t));
-    if (alarm_request_copy == NULL) {
-        errno_abort("Malloc failed");
-    }
+    alarm_request_t *alarm_request_copy = allocate_alarm_request();
 
     /*
      * Fill in data
@@ -40,173 +74,190 @@ alarm_request_t *copy_alarm_request(alarm_request_t *alarm_request) {
     alarm_request_copy->alarm_id = alarm_request->alarm_id;
     alarm_request_copy->type = alarm_request->type;
     alarm_request_copy->time = alarm_request->time;
-    strncpy(
-        alarm_request_copy->message,
-        alarm_request->message,
-        strlen(alarm_request->message)
-    );
+    alarm_request_copy->message = message_retain(alarm_request->message);
     alarm_request_copy->creation_time = alarm_request->creation_time;
+    alarm_request_copy->sequence_number = alarm_request->sequence_number;
     alarm_request_copy->next = NULL;
+    alarm_request_copy->prev = NULL;
+    alarm_request_copy->id_hash_next = NULL;
+    alarm_request_copy->id_hash_prev = NULL;
+    alarm_request_copy->queue_next = NULL;
+    alarm_request_copy->bulk_next = NULL;
     alarm_request_copy->change_status = alarm_request->change_status;
 
     return alarm_request_copy;
 }
 
-/*******************************************************************************
- *      HELPER FUNCTIONS FOR MODIFYING LISTS (USED BY DIFFERENT THREADS)       *
- ******************************************************************************/
-
 /**
- * A.3.2. Inserts the alarm request in its specified position in the alarm list
- * (sorted by their time values).
+ * Writes the alarm IDs of an alarm request and of the ones linked behind it
+ * through their bulk_next pointers (the alarm requests of a bulk request) to
+ * the buffer, and returns how many alarm requests there are. They are written
+ * the way they are given in a command, with runs of consecutive alarm IDs as
+ * ranges (e.g. "5,9,12-40"). If they do not fit, the buffer ends with "...".
  */
-void insert_to_alarm_list(alarm_request_t *list_header, alarm_request_t *alarm_request) {
-    alarm_request_t *current = list_header;
-    alarm_request_t *next = list_header->next;
+size_t format_alarm_ids(alarm_request_t *alarm_request, char buffer[], size_t size) {
+    size_t count = 0;
+    size_t length = 0;
+    int first;
+    int last;
+    int written;
 
-    // Find where to insert it by comparing alarm_id. The
-    // list should always be sorted by alarm_id.
-    while (next != NULL) {
-        if (alarm_request->time < next->time) {
-            // Insert before next
-            current->next = alarm_request;
-            alarm_request->next = next;
-            return;
-        } 
-        else {
-            current = next;
-            next = next->next;
+    buffer[0] = 0;
+
+    while (alarm_request != NULL) {
+        first = last = alarm_request->alarm_id;
+        count++;
+        alarm_request = alarm_request->bulk_next;
+
+        while (alarm_request != NULL
+               && last != INT_MAX
+               && alarm_request->alarm_id == last + 1) {
+            last++;
+            count++;
+            alarm_request = alarm_request->bulk_next;
+        }
+
+        if (length >= size) {
+            continue;
+        }
+
+        if (first == last) {
+            written = snprintf(buffer + length, size - length, "%s%d",
+                               length > 0 ? "," : "", first);
+        } else {
+            written = snprintf(buffer + length, size - length, "%s%d-%d",
+                               length > 0 ? "," : "", first, last);
+        }
+
+        if (length + written < size) {
+            length += written;
+        } else {
+            strcpy(buffer + size - sizeof("..."), "...");
+            length = size;
         }
     }
 
-    // Insert at the end of the list
-    current->next = alarm_request;
-    alarm_request->next = NULL;
+    return count;
 }
 
+/*******************************************************************************
+ *                          PIPELINE STAGE LATENCIES                           *
+ ******************************************************************************/
+
 /**
- * A.3.3.2. Removes all alarm requests with the given alarm id from the list of
- * alarms.
- *
- * Note that THIS METHOD WILL FREE ALARM REQUESTS THAT ARE FOUND, so don't keep
- * references to the alarm list entries.
- *
- * Note that the alarm list mutex MUST BE LOCKED by the caller of this method.
+ * Latency histograms of the stages of the pipeline, which the Stats command
+ * prints. They are always on: the threads record into them without locking
+ * anything (see Latency_Histogram.h), and printing them does not stop them.
  */
-void remove_alarm_requests_from_list(alarm_request_t *list_header, int alarm_id) {
-    alarm_request_t *alarm_node = list_header->next;
-    alarm_request_t *alarm_prev = list_header;
-    alarm_request_t *alarm_temp;
+latency_histogram_t parse_histogram = {.name = "Parse"};
+latency_histogram_t alarm_list_mutex_wait_histogram = {.name = "Alarm_List_Mutex_Wait"};
+latency_histogram_t alarm_thread_handling_histogram = {.name = "Alarm_Thread_Handling"};
+latency_histogram_t circular_buffer_wait_histogram = {.name = "Circular_Buffer_Wait"};
+latency_histogram_t consumer_apply_histogram = {.name = "Consumer_Apply"};
+latency_histogram_t display_lateness_histogram = {.name = "Display_Lateness"};
 
-    /*
-     * Keeps on searching the list until it finds the correct ID
-     */
-    while (alarm_node != NULL) {
-        if (alarm_node->alarm_id == alarm_id) {
-            /*
-             * We have found an alarm request with the given ID, so  remove it
-             * from the list and free it.
-             */
-            alarm_prev->next = alarm_node->next;
+/**
+ * The stage histograms in pipeline order.
+ */
+latency_histogram_t *stage_histograms[] = {
+    &parse_histogram,
+    &alarm_list_mutex_wait_histogram,
+    &alarm_thread_handling_histogram,
+    &circular_buffer_wait_histogram,
+    &consumer_apply_histogram,
+    &display_lateness_histogram
+};
 
-            alarm_temp = alarm_node;
-            alarm_node = alarm_node->next;
-            free(alarm_temp);
+/*******************************************************************************
+ *                                  METRICS                                    *
+ ******************************************************************************/
 
-            /*
-             * Don't increment alarm node because it has already been
-             * incremented during the removal above.
-             */
-            continue;
-        }
+/**
+ * Counters and gauges that the metrics server exports (see write_metrics).
+ * They are atomic, so the metrics server reads them without locking anything.
+ */
+atomic_ulong accepted_requests[3];      // By request type.
+atomic_ulong bad_commands;              // Input that was not a command.
+atomic_ulong rejected_requests;         // Requests for an alarm that already
+                                        // existed (Start_Alarm) or did not
+                                        // exist (the others).
+atomic_ulong display_firings;           // Alarm messages printed by periodic
+                                        // displays.
+atomic_int live_periodic_displays;      // Created and not yet finished.
+atomic_size_t alarm_list_length;        // Copy of alarm_list.length, updated
+                                        // whenever it changes.
 
-        alarm_node = alarm_node->next;
-        alarm_prev = alarm_prev->next;
-    }
-}
+/*******************************************************************************
+ *      DATA SHARED BETWEEN CONSUMER THREAD AND PERIODIC DISPLAY THREADS       *
+ ******************************************************************************/
 
 /**
- * A.3.3.3. Removes all alarm requests with the given alarm id from the list of
- * alarms, except for the given alarm request. The time value of the old alarm
- * request that was removed is returned (so that the alarm thread can use it to
- * check for periodic display threads). If no alarms were removed, then -1 is
- * returned.
+ * A consumer thread and the shard of the alarm display list that it owns.
  *
- * Note that THIS METHOD WILL FREE ALARM REQUESTS THAT ARE FOUND, so don't keep
- * references to the alarm list entries.
- *
- * Note that the alarm list mutex MUST BE LOCKED by the caller of this method.
+ * Every alarm ID belongs to exactly one consumer, so all the requests for one
+ * alarm go through the same circular buffer and the same consumer thread, in
+ * the order the alarm thread handled them.
  */
-int remove_old_alarm_requests_from_list(alarm_request_t *list_header, int alarm_id, alarm_request_t *newest_alarm_request) {
-    alarm_request_t *alarm_node = list_header->next;
-    alarm_request_t *alarm_prev = list_header;
-    alarm_request_t *alarm_temp;
-    int old_time_value = -1;
-
-    /*
-     * Keeps on searching the list until it finds the correct ID
-     */
-    while (alarm_node != NULL) {
-        if (alarm_node->alarm_id == alarm_id) {
-            /*
-             * We have found an alarm request with the given ID. If it is not
-             * the most recent alarm request, then remove it from the list and
-             * free it. Also save the old request's time value so that it can be
-             * returned.
-             */
-            if (alarm_node != newest_alarm_request) {
-                old_time_value = alarm_node->time;
-                alarm_prev->next = alarm_node->next;
-
-                alarm_temp = alarm_node;
-                alarm_node = alarm_node->next;
-                free(alarm_temp);
-
-                /*
-                 * Don't increment alarm node because it has already been
-                 * incremented during the removal above.
-                 */
-                continue;
-            }
-        }
+typedef struct consumer_t {
+    ring_buffer_t circular_buffer;  // From the alarm thread to this consumer.
+    alarm_list_t display_list;      // This consumer's shard of the alarm
+                                    // display list (only this consumer
+                                    // reads or changes it).
+    _Atomic(display_snapshot_t *) snapshot; // Latest published snapshot of
+                                            // the shard.
+    unsigned long last_bucket_version;      // Only used by this consumer.
+    unsigned long newest_sequence_number;   // Only used by this consumer.
+    atomic_size_t display_list_length;      // Length of the shard in the
+                                            // latest snapshot (for metrics).
+    int thread_id;
+    pthread_t thread;
+} consumer_t;
 
-        alarm_node = alarm_node->next;
-        alarm_prev = alarm_prev->next;
-    }
+/**
+ * The consumers. The alarm display list is the union of their shards. They
+ * are initialized by the main thread before any other threads are created.
+ */
+consumer_t *consumers;
+int number_of_consumers = 1;
 
-    return old_time_value;
+/**
+ * Returns the consumer that owns the given alarm ID.
+ */
+consumer_t *consumer_for_alarm(int alarm_id) {
+    return &consumers[(unsigned int) alarm_id % number_of_consumers];
 }
 
-/*******************************************************************************
- *      DATA SHARED BETWEEN CONSUMER THREAD AND PERIODIC DISPLAY THREADS       *
- ******************************************************************************/
 /**
- * Header of the list of alarms for the alarm display list.
+ * Returns the alarm request with the given alarm ID in the alarm display list,
+ * given the snapshots of all the shards, or NULL if there is none.
  */
-alarm_request_t alarm_display_list_header = {0};
+alarm_request_t *find_displayed_alarm(display_snapshot_t **snapshots, int alarm_id) {
+    return find_in_display_snapshot(
+        snapshots[(unsigned int) alarm_id % number_of_consumers],
+        alarm_id
+    );
+}
 
 /**
- * The number of readers (peroidic display threads) currently reading from the
- * alarm display list.
+ * Whether periodic displays run on the display timing wheel's thread instead
+ * of on the display worker pool. It is set by the main thread before any
+ * other threads are created.
  */
-int reader_count = 0;
+bool timing_wheel_mode = false;
 
 /**
- * Semaphore for readers (periodic display threads) updating the reader count.
+ * The timing wheel that decides when the periods of the periodic displays are
+ * due. In timing wheel mode, it also runs them.
  */
-sem_t reader_count_sem;
+timing_wheel_t display_timing_wheel;
 
 /**
- * Semaphore for controlling access to the alarm display list.
- *
- * This should solve the reader-writer problem. Only one thread should have this
- * semaphore locked at a time. If it is a writer thread (consumer), then other
- * writer threads should not be allowed to lock the semaphore. If it is a reader
- * thread (periodic display thread) it should allow other readers to access the
- * alarm display list, but should not allow the writer to acces the alarm
- * display list.
+ * The worker pool that runs the periods of the periodic displays (unless in
+ * timing wheel mode), and its number of workers, which is set by the main
+ * thread before any other threads are created.
  */
-sem_t alarm_display_list_sem;
+worker_pool_t display_worker_pool;
+int number_of_display_workers = 0;     // 0 means one per processor.
 
 /*******************************************************************************
  *               HELPER FUNCTIONS FOR PERIODIC DISPLAY THREAD                  *
@@ -219,29 +270,23 @@ sem_t alarm_display_list_sem;
  * 2 = Change_Alarm but time has been changed
  * 3 = Change_Alarm but message has been changed
 */
-int search_alarm_list(int id, alarm_request_t *current) {
-    alarm_request_t *thread_node = alarm_display_list_header.next;
-    alarm_request_t *thread_prev = &alarm_display_list_header;
-
-    while(thread_node != NULL) {
-        if (thread_node->alarm_id == id) {
-            if (thread_node->time != current->time) {
-                // Time has been changed
-                current->change_status = true;
-                return(2);
-            }
-            else if (strcmp(thread_node->message, current->message)) {
-                // Message has been changed
-                strcpy(current->message, thread_node->message);
-                return(3);
-            }
-            // Alarm exists, nothing changed
-            return(1);
+int search_alarm_list(display_snapshot_t **snapshots, int id, alarm_request_t *current) {
+    alarm_request_t *thread_node = find_displayed_alarm(snapshots, id);
+
+    if (thread_node != NULL) {
+        if (thread_node->time != current->time) {
+            // Time has been changed
+            current->change_status = true;
+            return(2);
         }
-        else {
-            thread_node = thread_node->next;
-            thread_prev = thread_prev->next;
+        else if (thread_node->message != current->message) {
+            // Message has been changed
+            message_release(current->message);
+            current->message = message_retain(thread_node->message);
+            return(3);
         }
+        // Alarm exists, nothing changed
+        return(1);
     }
 
     // Alarm doesn't exist, has been cancelled
@@ -256,18 +301,12 @@ int search_alarm_list(int id, alarm_request_t *current) {
  * so that the default periodic display thread message is printed for
  * every call after.
 */
-void change_alarm_display_status(int id) {
-    alarm_request_t *thread_node = alarm_display_list_header.next;
+void change_alarm_display_status(display_snapshot_t **snapshots, int id) {
+    alarm_request_t *thread_node = find_displayed_alarm(snapshots, id);
 
-    // Loop through the alarms, change the status of the specified one
-    while(thread_node != NULL) {
-        if(thread_node->alarm_id == id) {
-            thread_node->change_status = false;
-            break;
-        }
-        else {
-            thread_node = thread_node->next;
-        }
+    // Change the status of the specified alarm
+    if (thread_node != NULL) {
+        atomic_store_explicit(&thread_node->change_status, false, memory_order_relaxed);
     }
 }
 
@@ -303,334 +342,446 @@ bool should_add_to_list(alarm_request_t *list_header, alarm_request_t *alarm_req
  ******************************************************************************/
 
 /**
- * A.3.5. Periodic display thread.
+ * A periodic display: the alarms with one time value, printed every time
+ * value seconds. Its timer on the display timing wheel expires when each
+ * period is due, and the period runs either on the display worker pool,
+ * through its task, or on the display timing wheel's thread. Either way, one
+ * period of a display has finished before its next one is scheduled, so a
+ * display never runs on two threads at once.
+ *
+ * A display runs until the alarm thread has retired it (there are no more
+ * live alarms with its time value) and it has no more alarms to print. Before
+ * it is retired, it keeps running through periods in which it finds no
+ * alarms, because the consumers may not have published the alarms yet.
+ */
+typedef struct periodic_display_t {
+    int thread_id;
+    int time;
+    alarm_request_t list_header; // Alarms that this display prints.
+    wheel_timer_t timer;
+    worker_task_t task;          // Not used in timing wheel mode.
+    struct periodic_display_t *next_new; // See new_periodic_displays.
+    atomic_bool retired;         // Set by retire_periodic_display_thread.
+
+    /*
+     * What the display saw in each shard in its last period: the version of
+     * the bucket with its time value, and the newest sequence number.
+     */
+    unsigned long bucket_versions[MAXIMUM_NUMBER_OF_CONSUMERS];
+    unsigned long newest_sequence_numbers[MAXIMUM_NUMBER_OF_CONSUMERS];
+} periodic_display_t;
+
+/**
+ * Pools that periodic displays, and the data of periodic display threads kept
+ * in the time value index, are allocated from. They are initialized by the
+ * main thread before any other threads are created.
  */
-void *periodic_display_thread_routine(void *arg) {
-    int thread_id  = ((periodic_display_thread_t*) arg)->thread_id;
-    int targetTime = ((periodic_display_thread_t*) arg)->time;
+object_pool_t periodic_display_pool;
+object_pool_t periodic_display_thread_pool;
 
-    DEBUG_PRINTF("Periodic display thread %d running.\n", thread->thread_id);
+/**
+ * Returns the number of microseconds from the given time to now (negative if
+ * the time is in the future), on the monotonic clock.
+ */
+long microseconds_since(const struct timespec *time) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
 
-    // List of alarms for the periodic display thread
-    alarm_request_t periodic_display_list_header = {0};
-    alarm_request_t *current_node = &periodic_display_list_header;
-    alarm_request_t *next_node = periodic_display_list_header.next;
+    return (now.tv_sec - time->tv_sec) * 1000000L
+        + (now.tv_nsec - time->tv_nsec) / 1000;
+}
 
+/**
+ * A.3.5. One period of a periodic display, which was due at the given time (on
+ * the monotonic clock). How late it runs is printed with each alarm message.
+ *
+ * Returns false once the display has been retired and has no more alarms, in
+ * which case it must not run again.
+ */
+bool periodic_display_tick(periodic_display_t *display, const struct timespec *deadline) {
+    long lateness = microseconds_since(deadline);
+    display_snapshot_t *snapshots[MAXIMUM_NUMBER_OF_CONSUMERS];
+    bool changed[MAXIMUM_NUMBER_OF_CONSUMERS];
+    display_snapshot_t *snapshot;
+    display_bucket_t *bucket;
+    unsigned long version;
     alarm_request_t *thread_node;
     alarm_request_t *copy;
+    bool was_empty = display->list_header.next == NULL;
+    bool retired = atomic_load_explicit(&display->retired, memory_order_acquire);
 
     int request;
 
-    while(1) {
-        sleep(targetTime);
+    latency_histogram_record(
+        &display_lateness_histogram,
+        lateness > 0 ? (uint64_t) lateness * 1000 : 0
+    );
 
-        thread_node = alarm_display_list_header.next;
+    /*
+     * Take the latest snapshot of every shard, and use them for the whole
+     * period, so that the period sees one view of the alarm display list.
+     */
+    epoch_enter();
+    for (int i = 0; i < number_of_consumers; i++) {
+        snapshots[i] = atomic_load_explicit(&consumers[i].snapshot, memory_order_acquire);
+    }
 
-        sem_wait(&reader_count_sem);
-        reader_count += 1;
-        if (reader_count == 1) {
-            sem_wait(&alarm_display_list_sem);
-        }
-        sem_post(&reader_count_sem);
-
-        // Loop through alarm list, add any with the specified time
-        while(thread_node != NULL) {
-            if (thread_node->time == targetTime) {
-                if (should_add_to_list(&periodic_display_list_header, thread_node) == true) {
-                    // List is empty, insert at head
-                    if (periodic_display_list_header.next == NULL) {
-                        copy = copy_alarm_request(thread_node);
-                        copy->next = NULL;
-                        periodic_display_list_header.next = copy;
-                    }
-                    else {
-                        copy = copy_alarm_request(thread_node);
-                        copy->next = periodic_display_list_header.next;
-                        periodic_display_list_header.next = copy;
-                    }
-                }
-                thread_node = thread_node->next;
-            }
-            else {
-                thread_node = thread_node->next;
-            }
+    // Loop through every shard of the alarm display list, add any with the
+    // specified time. Only the shards in which the bucket with the specified
+    // time has changed since the last period need to be looked at, and in
+    // those, only the alarms that are newer than the newest one seen in the
+    // last period (the consumer applies requests in sequence number order).
+    // A retired display adds none: every alarm with its time value that is
+    // still live was started after it was retired, and belongs to the
+    // periodic display created for it then.
+    for (int i = 0; i < number_of_consumers; i++) {
+        snapshot = snapshots[i];
+        bucket = find_display_bucket(snapshot, display->time);
+        version = bucket != NULL ? bucket->version : 0;
+
+        changed[i] = version != display->bucket_versions[i];
+        display->bucket_versions[i] = version;
+
+        if (bucket == NULL || !changed[i] || retired) {
+            display->newest_sequence_numbers[i] = snapshot->newest_sequence_number;
+            continue;
         }
 
-        /**
-         * A.3.5.1 Periodically prints the messages of all the alarms with
-         * the same Time value every Time seconds.
-         */
-        alarm_request_t *current = periodic_display_list_header.next;
-        alarm_request_t *prev = &periodic_display_list_header;
-        request = 0;
-        while (current != NULL) {
-            request = search_alarm_list(current->alarm_id, current);
-
-            // Alarm exists, print standard periodic message
-            if (request == 1) {
-                /**
-                 * A.3.5.4 New display thread starts to print alarm because
-                 * the time has been changed.
-                */
-                if (current->change_status == true) {
-                    printf(
-                        "Display thread %d Has Taken Over Printing Message of Alarm(%d) at %ld: New Changed Time = %d Message = %s\n",
-                        thread_id,
-                        current->alarm_id,
-                        time(NULL),
-                        current->time,
-                        current->message);
-                    current->change_status = false;
-                    change_alarm_display_status(current->alarm_id);
+        for (size_t j = find_newer_in_display_bucket(
+                 snapshot,
+                 bucket,
+                 display->newest_sequence_numbers[i]);
+             j < bucket->first + bucket->length;
+             j++) {
+            thread_node = snapshot->alarm_requests[j];
+
+            // A bucket has one alarm request per alarm ID, so there is
+            // nothing to check while the list was empty.
+            if (was_empty || should_add_to_list(&display->list_header, thread_node) == true) {
+                // List is empty, insert at head
+                if (display->list_header.next == NULL) {
+                    copy = copy_alarm_request(thread_node);
+                    copy->next = NULL;
+                    display->list_header.next = copy;
                 }
-                /**
-                 * A.3.5.1 Default print message.
-                */
                 else {
-                    printf(
-                        "ALARM MESSAGE (%d) PRINTED BY ALARM DISPLAY THREAD %d at %ld: TIME = %d MESSAGE = %s\n",
-                        current->alarm_id,
-                        thread_id,
-                        time(NULL),
-                        current->time,
-                        current->message);
+                    copy = copy_alarm_request(thread_node);
+                    copy->next = display->list_header.next;
+                    display->list_header.next = copy;
                 }
-                current = current->next;
-                prev = prev->next;
-            }
-            /**
-             * A.3.5.2 Alarm has been cancelled by Consumer Thread,
-             * periodic display thread stops printing it.
-            */
-            else if (request == 0) {
-                printf(
-                    "Display thread %d Has Stopped Printing Message of Alarm(%d) at %ld: Time = %d Message = %s\n",
-                    thread_id,
-                    current->alarm_id,
-                    time(NULL),
-                    current->time,
-                    current->message);
-                // Remove alarm from periodic display list
-                prev->next = current->next;
-                current = current->next;
             }
+        }
+
+        display->newest_sequence_numbers[i] = snapshot->newest_sequence_number;
+    }
+
+    /**
+     * A.3.5.1 Periodically prints the messages of all the alarms with
+     * the same Time value every Time seconds.
+     */
+    alarm_request_t *current = display->list_header.next;
+    alarm_request_t *prev = &display->list_header;
+    request = 0;
+    while (current != NULL) {
+        // If the alarm's bucket has not changed, neither has the alarm
+        if (changed[(unsigned int) current->alarm_id % number_of_consumers]) {
+            request = search_alarm_list(snapshots, current->alarm_id, current);
+        } else {
+            request = 1;
+        }
+
+        // Alarm exists, print standard periodic message
+        if (request == 1) {
             /**
-             * A.3.5.3 Change_Alarm has been invoked and the time has been
-              changed, so the current thread must stop printing it.
+             * A.3.5.4 New display thread starts to print alarm because
+             * the time has been changed.
             */
-            else if (request == 2) {
-                printf(
-                    "Display thread %d Has Stopped Printing Message of Alarm(%d) at %ld: Time = %d Message = %s\n",
-                    thread_id,
+            if (current->change_status == true) {
+                log_printf(
+                    "Display thread %d Has Taken Over Printing Message of Alarm(%d) at %ld: New Changed Time = %s Message = %s\n",
+                    display->thread_id,
                     current->alarm_id,
                     time(NULL),
-                    current->time,
-                    current->message);
-                // Remove alarm from periodic display list
-                prev->next = current->next;
-                current = current->next;
+                    TIME_STRING(current->time),
+                    current->message->text);
+                current->change_status = false;
+                change_alarm_display_status(snapshots, current->alarm_id);
             }
             /**
-             * A.3.5.5 Change_Alarm has been invoked and the message has
-             * been changed, so the current thread prints that it's printing
-             * a new message.
+             * A.3.5.1 Default print message.
             */
-            else if (request == 3) { 
-                printf(
-                    "Display thread %d Starting to Print Changed Message Alarm(%d) at %ld: Time = %d Message = %s\n",
-                    thread_id,
+            else {
+                atomic_fetch_add_explicit(&display_firings, 1, memory_order_relaxed);
+                log_printf(
+                    "ALARM MESSAGE (%d) PRINTED BY ALARM DISPLAY THREAD %d at %ld: TIME = %s MESSAGE = %s LATENESS = %ld us\n",
                     current->alarm_id,
+                    display->thread_id,
                     time(NULL),
-                    current->time,
-                    current->message);
-                current = current->next;
-                prev = prev->next;
-            }
-            // Error message
-            else {
-                printf("Periodic display thread could not get alarm request.\n");
-                current = current->next;
-                prev = prev->next;
+                    TIME_STRING(current->time),
+                    current->message->text,
+                    lateness);
             }
-
+            current = current->next;
+            prev = prev->next;
         }
-
-        sem_wait(&reader_count_sem);
-        reader_count -= 1;
-        if (reader_count == 0) {
-            sem_post(&alarm_display_list_sem);
+        /**
+         * A.3.5.2 Alarm has been cancelled by Consumer Thread,
+         * periodic display thread stops printing it.
+        */
+        else if (request == 0) {
+            log_printf(
+                "Display thread %d Has Stopped Printing Message of Alarm(%d) at %ld: Time = %s Message = %s\n",
+                display->thread_id,
+                current->alarm_id,
+                time(NULL),
+                TIME_STRING(current->time),
+                current->message->text);
+            // Remove alarm from periodic display list
+            prev->next = current->next;
+            free_alarm_request(current);
+            current = prev->next;
         }
-        sem_post(&reader_count_sem);
-
         /**
-         * A.3.5.6 Thread is empty, so it terminates.
+         * A.3.5.3 Change_Alarm has been invoked and the time has been
+          changed, so the current thread must stop printing it.
         */
-        if (periodic_display_list_header.next == NULL) {
-            printf(
-                "No More Alarms With Time = %d Display Thread %d exiting at %ld\n",
-                targetTime,
-                thread_id,
-                time(NULL));
-            break;
+        else if (request == 2) {
+            log_printf(
+                "Display thread %d Has Stopped Printing Message of Alarm(%d) at %ld: Time = %s Message = %s\n",
+                display->thread_id,
+                current->alarm_id,
+                time(NULL),
+                TIME_STRING(current->time),
+                current->message->text);
+            // Remove alarm from periodic display list
+            prev->next = current->next;
+            free_alarm_request(current);
+            current = prev->next;
         }
+        /**
+         * A.3.5.5 Change_Alarm has been invoked and the message has
+         * been changed, so the current thread prints that it's printing
+         * a new message.
+        */
+        else if (request == 3) { 
+            log_printf(
+                "Display thread %d Starting to Print Changed Message Alarm(%d) at %ld: Time = %s Message = %s\n",
+                display->thread_id,
+                current->alarm_id,
+                time(NULL),
+                TIME_STRING(current->time),
+                current->message->text);
+            current = current->next;
+            prev = prev->next;
+        }
+        // Error message
+        else {
+            log_printf("Periodic display thread could not get alarm request.\n");
+            current = current->next;
+            prev = prev->next;
+        }
+
     }
 
+    epoch_exit();
+
+    /**
+     * A.3.5.6 Thread is empty and has been retired, so it terminates.
+    */
+    if (display->list_header.next == NULL && retired) {
+        log_printf(
+            "No More Alarms With Time = %s Display Thread %d exiting at %ld\n",
+            TIME_STRING(display->time),
+            display->thread_id,
+            time(NULL));
+        return false;
+    }
 
-    return NULL;
+    return true;
 }
 
-/*******************************************************************************
- *           DATA SHARED BETWEEN CONSUMER THREAD AND ALARM THREAD              *
- ******************************************************************************/
-
 /**
- * Circular buffer used to store alarms.
+ * A.3.5. Runs the period of a periodic display that is due, then schedules
+ * the next period one time value after this one was due (so the display does
+ * not drift, however long each period takes), or frees the display once it
+ * has been retired and has no more alarms. If a period runs so late that the
+ * next ones are already due, those are skipped rather than run back to back.
  */
-alarm_request_t* circularBuffer[CIRCULAR_BUFFER_SIZE] = {0};
+void run_periodic_display(periodic_display_t *display) {
+    struct timespec deadline = timing_wheel_expiry_time(&display_timing_wheel, &display->timer);
 
-/**
- * Size of the circular buffer used to store alarms. 
- */
-int circularBufferSize = 0;
+    if (periodic_display_tick(display, &deadline)) {
+        timing_wheel_reschedule(&display_timing_wheel, &display->timer, display->time);
+    } else {
+        atomic_fetch_sub_explicit(&live_periodic_displays, 1, memory_order_relaxed);
+        object_pool_free(&periodic_display_pool, display);
+    }
+}
 
 /**
- * Integer used to keep track of where to write 
+ * Runs a period of a periodic display on a display worker.
  */
-int writeIndex = 0;
+void periodic_display_task(worker_task_t *task) {
+    run_periodic_display(task->arg);
+}
 
 /**
- * Integer used to keep track of which index in the circular buffer to read from
+ * Called by the display timing wheel's thread when a period of a periodic
+ * display is due: hands the period to the display worker pool, so that the
+ * wheel's thread goes straight back to keeping time, and periods that are due
+ * together run in parallel.
  */
-int readIndex = 0;
+void periodic_display_timer_callback(wheel_timer_t *timer) {
+    periodic_display_t *display = timer->arg;
+
+    worker_pool_submit(&display_worker_pool, &display->task);
+}
 
 /**
- * Mutex controlling access to the circular buffer. Any thread that updates or
- * reads from the circular buffer must have this mutex locked.
+ * Runs a period of a periodic display on the display timing wheel's thread
+ * (in timing wheel mode).
  */
-pthread_mutex_t circular_buffer_mutex = PTHREAD_MUTEX_INITIALIZER;
+void periodic_display_wheel_callback(wheel_timer_t *timer) {
+    run_periodic_display(timer->arg);
+}
 
-/**
- * Semaphore representing the number of empty spaces in the buffer.
- *
- * This semaphore should be initialized to the size of the circular buffer
- * because the buffer is initially empty.
- *
- * Whenever an item is added to the circular buffer, the semaphore value
- * decreases. This means the producer (alarm thread) will call `wait` on this
- * semaphore. Once the semaphore value reaches 0, producers threads will block
- * until a consumer thread consumes an item from the buffer and calls `signal`
- * on this semaphore.
+/*******************************************************************************
+ *           DATA SHARED BETWEEN CONSUMER THREAD AND ALARM THREAD              *
+ ******************************************************************************/
+
+/*
+ * Each consumer has a circular buffer (in its consumer_t) used to pass alarm
+ * requests from the alarm thread (the only producer) to the consumer thread
+ * (the only consumer).
  */
-sem_t circular_buffer_empty_sem;
 
 /**
- * Semaphore representing the number of full spaces in the buffer.
- *
- * This semaphore should be initialized to 0 because the buffer is initially
- * empty.
- *
- * Whenever an item is consumed from the circular buffer, the semaphore value
- * decreases. This means the consumer (consumer thread) will call `wait` on this
- * semaphore. Once the semaphore value reaches 0, consumer threads will block
- * until a producer thread adds an item to the buffer and calls `signal` on this
- * semahpore.
+ * The number of alarm requests that each circular buffer can hold. It is set
+ * by the main thread before any other threads are created.
  */
-sem_t circular_buffer_full_sem;
+size_t circular_buffer_capacity = CIRCULAR_BUFFER_SIZE;
 
 /*******************************************************************************
  *                     HELPER FUNCTIONS FOR CONSUMER THREAD                    *
  ******************************************************************************/
 
 /**
- * A.3.4.5. Prints the contents of the circular buffer.
+ * A.3.4.5. Prints the contents of a consumer's circular buffer.
  *
- * This uses the read index as the start and the write index as the end, and
- * iterates through the elements in between, printing each one. This works
- * because when an alarm request is added to the buffer the write index is
- * incremented, and when an alarm is taken from the buffer the read index is
- * incremented.
+ * This iterates from the read position to the write position, printing each
+ * alarm request in between.
  *
- * Note that THE MUTEX FOR THE CIRCULAR BUFFER MUST BE LOCKED by the caller of
- * this method.
+ * Note that this must be called by the consumer's thread. The view is consistent
+ * because the write position is read once, the alarm thread never changes the
+ * slots before it, and only the consumer thread frees slots.
  */
-void print_circular_buffer() {
+void print_circular_buffer(consumer_t *consumer) {
+    ring_buffer_t *circular_buffer = &consumer->circular_buffer;
+    size_t read_position = atomic_load_explicit(
+        &circular_buffer->read_position,
+        memory_order_relaxed
+    );
+    size_t write_position = atomic_load_explicit(
+        &circular_buffer->write_position,
+        memory_order_acquire
+    );
     alarm_request_t *alarm_request;
 
-    printf("[");
+    log_printf("[");
 
-    for (int i = readIndex; i != writeIndex; i = (i + 1) % CIRCULAR_BUFFER_SIZE) {
-        if (circularBuffer[i] != NULL) {
-            alarm_request = circularBuffer[i];
+    for (size_t i = read_position; i != write_position; i++) {
+        alarm_request = ring_buffer_item_at(circular_buffer, i);
 
-            printf(
-                "{Index: %d, AlarmId: %d, Type: %s, Time: %d, Message: %s}",
-                i,
-                alarm_request->alarm_id,
-                request_type_string(alarm_request),
-                alarm_request->time,
-                alarm_request->message
-            );
+        log_printf(
+            "{Index: %zu, AlarmId: %d, Type: %s, Time: %s, Message: %s}",
+            i % circular_buffer->capacity,
+            alarm_request->alarm_id,
+            request_type_string(alarm_request),
+            TIME_STRING(alarm_request->time),
+            alarm_request->message->text
+        );
 
-            if ((i + 1) % CIRCULAR_BUFFER_SIZE != writeIndex) {
-                printf(", ");
-            }
+        if (i + 1 != write_position) {
+            log_printf(", ");
         }
     }
 
-    printf("]\n");
+    log_printf("]\n");
 }
 
 /**
- * Gets an item from the circular buffer. This will wait on a semaphore for
- * requests to consume if the buffer is empty.
+ * Frees an alarm request or a snapshot that has been retired (see
+ * publish_display_snapshot).
  */
-alarm_request_t *get_item_from_circular_buffer() {
-    /*
-     * Wait on the full semaphore. If there are no elements in the buffer
-     * (semaphore value is 0), then this call will block until an item is added
-     * to the buffer and this semaphore is signaled.
-     */
-    sem_wait(&circular_buffer_full_sem);
+void free_retired_alarm_request(void *alarm_request) {
+    free_alarm_request(alarm_request);
+}
 
-    /*
-     * Lock the circular buffer mutex to ensure mututal exclusion on the buffer.
-     */
-    pthread_mutex_lock(&circular_buffer_mutex);
+void free_retired_display_snapshot(void *snapshot) {
+    free(snapshot);
+}
 
-    /*
-     * Get item from buffer
-     */
-    alarm_request_t *alarm_request = circularBuffer[readIndex];
+/**
+ * The alarm requests that the calling consumer thread has removed from its
+ * private alarm list since it last published a snapshot, linked through their
+ * next fields. The latest snapshot may still contain them, so they are only
+ * retired once a snapshot without them has been published.
+ */
+_Thread_local alarm_request_t *removed_display_alarm_requests = NULL;
 
-    /*
-     * Remove item from buffer
-     */
-    circularBuffer[readIndex] = NULL;
+/**
+ * Used instead of free_alarm_request by the consumers' private alarm lists:
+ * the removed alarm request is retired when the consumer next publishes a
+ * snapshot.
+ */
+void remove_display_alarm_request(alarm_request_t *alarm_request) {
+    alarm_request->next = removed_display_alarm_requests;
+    removed_display_alarm_requests = alarm_request;
+}
 
-    /*
-     * Increment read index
-     */
-    readIndex = (readIndex + 1) % CIRCULAR_BUFFER_SIZE;
+/**
+ * Publishes a new snapshot of the consumer's shard of the alarm display list,
+ * and retires the old one.
+ *
+ * This takes time proportional to the size of the shard, which is why the
+ * consumer publishes once per batch of requests rather than once per request.
+ */
+void publish_display_snapshot(consumer_t *consumer) {
+    display_snapshot_t *old_snapshot = atomic_exchange(
+        &consumer->snapshot,
+        build_display_snapshot(
+            &consumer->display_list,
+            atomic_load_explicit(&consumer->snapshot, memory_order_relaxed),
+            &consumer->last_bucket_version,
+            &consumer->newest_sequence_number
+        )
+    );
 
-    /*
-     * Unlock the circular buffer mutex to allow other threads to access the
-     * buffer.
-     */
-    pthread_mutex_unlock(&circular_buffer_mutex);
+    alarm_request_t *alarm_request;
 
-    /*
-     * Signal the empty semaphore to signal that there is one more empty spot in
-     * the buffer.
-     */
-    sem_post(&circular_buffer_empty_sem);
+    atomic_store_explicit(
+        &consumer->display_list_length,
+        consumer->display_list.length,
+        memory_order_relaxed
+    );
 
-    return alarm_request;
+    if (old_snapshot != NULL) {
+        epoch_retire(free_retired_display_snapshot, old_snapshot);
+    }
+
+    while (removed_display_alarm_requests != NULL) {
+        alarm_request = removed_display_alarm_requests;
+        removed_display_alarm_requests = alarm_request->next;
+        epoch_retire(free_retired_alarm_request, alarm_request);
+    }
 }
 
 /**
- * Consume the alarm request that was retrieved from the circular buffer.
+ * Consume the alarm request that was retrieved from the consumer's circular
+ * buffer, applying it to the consumer's shard of the alarm display list. The
+ * message about it is only printed if print_message is true.
  */
-void consume_alarm_request(alarm_request_t *alarm_request) {
+void consume_alarm_request(consumer_t *consumer, alarm_request_t *alarm_request, bool print_message) {
     /*
      * Save alarm ID in case the alarm request is freed
      */
@@ -644,22 +795,25 @@ void consume_alarm_request(alarm_request_t *alarm_request) {
             /*
              * A.3.4.2. Insert alarm request into alarm display list
              */
-            insert_to_alarm_list(&alarm_display_list_header, alarm_request);
+            insert_to_alarm_list(&consumer->display_list, alarm_request);
 
             /*
              * A.3.4.2. Print message that alarm request has been inserted
              * into alarm display list
              */
-            printf(
-                "Consumer Thread has Inserted Alarm_Request_Type %s "
-                "Request(%d) at %ld: Time = %d Message = %s into Alarm "
-                "Display List.\n",
-                request_type_string(alarm_request),
-                alarm_id,
-                time(NULL),
-                alarm_request->time,
-                alarm_request->message
-            );
+            if (print_message) {
+                log_printf(
+                    "Consumer Thread %d has Inserted Alarm_Request_Type %s "
+                    "Request(%d) at %ld: Time = %s Message = %s into Alarm "
+                    "Display List.\n",
+                    consumer->thread_id,
+                    request_type_string(alarm_request),
+                    alarm_id,
+                    time(NULL),
+                    TIME_STRING(alarm_request->time),
+                    alarm_request->message->text
+                );
+            }
 
             break;
 
@@ -668,7 +822,7 @@ void consume_alarm_request(alarm_request_t *alarm_request) {
              * A.3.4.3. Remove old requests with the same alarm ID
              */
             remove_old_alarm_requests_from_list(
-                &alarm_display_list_header,
+                &consumer->display_list,
                 alarm_request->alarm_id,
                 alarm_request
             );
@@ -676,25 +830,27 @@ void consume_alarm_request(alarm_request_t *alarm_request) {
             /*
              * A.3.4.3. Insert alarm request into alarm display list
              */
-            insert_to_alarm_list(&alarm_display_list_header, alarm_request);
+            insert_to_alarm_list(&consumer->display_list, alarm_request);
 
             /*
              * A.3.4.3. Print message that old alarm requests have been
              * removed and new alarm request has been inserted into alarm
              * display list
              */
-            printf(
-                "Consumer Thread %d at %ld has Removed All Previous Alarm "
-                "Requests With Alarm ID %d From Alarm Display List and Has "
-                "Inserted Retrieved Change Alarm Request(%d) Time = %d "
-                "Message = %s into Alarm Display List.\n",
-                CONSUMER_THREAD_ID,
-                time(NULL),
-                alarm_id,
-                alarm_id,
-                alarm_request->time,
-                alarm_request->message
-            );
+            if (print_message) {
+                log_printf(
+                    "Consumer Thread %d at %ld has Removed All Previous Alarm "
+                    "Requests With Alarm ID %d From Alarm Display List and Has "
+                    "Inserted Retrieved Change Alarm Request(%d) Time = %s "
+                    "Message = %s into Alarm Display List.\n",
+                    consumer->thread_id,
+                    time(NULL),
+                    alarm_id,
+                    alarm_id,
+                    TIME_STRING(alarm_request->time),
+                    alarm_request->message->text
+                );
+            }
 
             break;
 
@@ -702,84 +858,161 @@ void consume_alarm_request(alarm_request_t *alarm_request) {
             /*
              * A.3.4.4. Remove alarm requests from alarm display list
              */
-            remove_alarm_requests_from_list(&alarm_display_list_header, alarm_id);
+            remove_alarm_requests_from_list(&consumer->display_list, alarm_request);
 
             /*
              * A.3.4.4. Print message that alarm requests have been
              * cancelled and removed from the alarm display list
              */
-            printf(
-                "Consumer Thread %d Has Cancelled and Removed All Alarm "
-                "Requests With Alarm ID (%d) from Alarm Display List at "
-                "%ld.\n",
-                CONSUMER_THREAD_ID,
-                alarm_id,
-                time(NULL)
-            );
+            if (print_message) {
+                log_printf(
+                    "Consumer Thread %d Has Cancelled and Removed All Alarm "
+                    "Requests With Alarm ID (%d) from Alarm Display List at "
+                    "%ld.\n",
+                    consumer->thread_id,
+                    alarm_id,
+                    time(NULL)
+                );
+            }
+
+            /*
+             * The Cancel_Alarm request itself is not kept in the alarm
+             * display list.
+             */
+            free_alarm_request(alarm_request);
 
             break;
 
         default:
-            printf("Consumer thread found error: invalid alarm request type!\n");
+            log_printf("Consumer thread found error: invalid alarm request type!\n");
             return;
     }
 
 }
 
+/**
+ * Consumes the alarm requests of a bulk request (the given one and the ones
+ * linked behind it), which the alarm thread put in the circular buffer as one
+ * item. They are applied to the shard of the alarm display list in one pass,
+ * and one message is printed for all of them.
+ */
+void consume_bulk_alarm_request(consumer_t *consumer, alarm_request_t *alarm_request) {
+    const char *type = request_type_string(alarm_request);
+    char alarm_ids[ALARM_IDS_STRING_SIZE];
+    size_t count = format_alarm_ids(alarm_request, alarm_ids, sizeof(alarm_ids));
+    alarm_request_t *next_alarm_request;
+
+    while (alarm_request != NULL) {
+        /*
+         * Get the next one first, because consuming a Cancel_Alarm request
+         * frees it.
+         */
+        next_alarm_request = alarm_request->bulk_next;
+        alarm_request->bulk_next = NULL;
+        consume_alarm_request(consumer, alarm_request, false);
+        alarm_request = next_alarm_request;
+    }
+
+    log_printf(
+        "Consumer Thread %d has Applied %zu Alarm_Request_Type %s "
+        "Requests(%s) to Alarm Display List at %ld.\n",
+        consumer->thread_id,
+        count,
+        type,
+        alarm_ids,
+        time(NULL)
+    );
+}
+
 /*******************************************************************************
  *                             CONSUMER THREAD                                 *
  ******************************************************************************/
 
 /**
  * A.3.4. Consumer thread.
+ *
+ * The argument is the thread's consumer.
  */
 void *consumer_thread_routine(void *arg) {
-    DEBUG_MESSAGE("Consumer thread running.");
+    consumer_t *consumer = arg;
+
+    DEBUG_PRINTF("Consumer thread %d running.\n", consumer->thread_id);
 
     alarm_request_t *alarm_request;
+    char alarm_ids[ALARM_IDS_STRING_SIZE];
+    size_t index;
+    int batch_size;
+    uint64_t start;
 
     while (1) {
         /*
-         * Get an alarm request from the circular buffer
+         * Get an alarm request from the circular buffer. This blocks while the
+         * buffer is empty.
          */
-        alarm_request = get_item_from_circular_buffer();
+        alarm_request = ring_buffer_get(&consumer->circular_buffer, &index);
 
         /*
-         * A.3.4.1. Print message that an alarm request has been retrieved from
-         * the circular buffer
+         * Apply it, and any more that are already in the circular buffer (up
+         * to a batch), to the private alarm list of the shard.
          */
-        printf(
-            "Consumer Thread has Retrieved Alarm_Request_Type %s Request(%d) "
-            "at %ld: Time = %d Message = %s from Circular_Buffer Index: %d\n",
-            request_type_string(alarm_request),
-            alarm_request->alarm_id,
-            time(NULL),
-            alarm_request->time,
-            alarm_request->message,
-            (readIndex + (CIRCULAR_BUFFER_SIZE - 1)) % CIRCULAR_BUFFER_SIZE
-        );
+        batch_size = 0;
+        do {
+            /*
+             * A.3.4.1. Print message that an alarm request has been retrieved
+             * from the circular buffer
+             */
+            if (alarm_request->bulk_next != NULL) {
+                log_printf(
+                    "Consumer Thread %d has Retrieved %zu Alarm_Request_Type %s "
+                    "Requests(%s) at %ld from Circular_Buffer Index: %zu\n",
+                    consumer->thread_id,
+                    format_alarm_ids(alarm_request, alarm_ids, sizeof(alarm_ids)),
+                    request_type_string(alarm_request),
+                    alarm_ids,
+                    time(NULL),
+                    index
+                );
+            } else {
+                log_printf(
+                    "Consumer Thread %d has Retrieved Alarm_Request_Type %s "
+                    "Request(%d) at %ld: Time = %s Message = %s from "
+                    "Circular_Buffer Index: %zu\n",
+                    consumer->thread_id,
+                    request_type_string(alarm_request),
+                    alarm_request->alarm_id,
+                    time(NULL),
+                    TIME_STRING(alarm_request->time),
+                    alarm_request->message->text,
+                    index
+                );
+            }
 
-        sem_wait(&alarm_display_list_sem);
-        DEBUG_PRINT_ALARM_REQUEST(alarm_request);
-        consume_alarm_request(alarm_request);
-        sem_post(&alarm_display_list_sem);
+            DEBUG_PRINT_ALARM_REQUEST(alarm_request);
+            start = latency_clock_now();
+            if (alarm_request->bulk_next != NULL) {
+                consume_bulk_alarm_request(consumer, alarm_request);
+            } else {
+                consume_alarm_request(consumer, alarm_request, true);
+            }
+            latency_histogram_record_since(&consumer_apply_histogram, start);
 
-        /*
-         * Lock the circular buffer mutex to ensure mututal exclusion on the
-         * buffer.
-         */
-        pthread_mutex_lock(&circular_buffer_mutex);
+            /*
+             * A.3.4.5. Print the contents of the circular buffer
+             */
+            print_circular_buffer(consumer);
 
-        /*
-         * A.3.4.5. Print the contents of the circular buffer
-         */
-        print_circular_buffer();
+            batch_size++;
+        } while (batch_size < MAXIMUM_CONSUMER_BATCH_SIZE
+                 && (alarm_request = ring_buffer_try_get(
+                         &consumer->circular_buffer,
+                         &index)) != NULL);
 
         /*
-         * Unlock the circular buffer mutex to allow other threads to access the
-         * buffer.
+         * Publish the new state of the shard to the periodic display threads,
+         * then free whatever they can no longer be reading.
          */
-        pthread_mutex_unlock(&circular_buffer_mutex);
+        publish_display_snapshot(consumer);
+        epoch_reclaim();
     }
 
     return NULL;
@@ -790,10 +1023,11 @@ void *consumer_thread_routine(void *arg) {
  ******************************************************************************/
 
 /**
- * Header of the alarm list. The is the data structure that is shared between
- * the main thread and the alarm thread.
+ * The alarm list. The is the data structure that is shared between the main
+ * thread and the alarm thread. It is initialized by the main thread before any
+ * other threads are created.
  */
-alarm_request_t alarm_list_header = {0};
+alarm_list_t alarm_list;
 
 /**
  * Mutex for the alarm list. Any thread reading or modifying the alarm list must
@@ -807,283 +1041,248 @@ pthread_mutex_t alarm_list_mutex = PTHREAD_MUTEX_INITIALIZER;
  */
 pthread_cond_t alarm_list_cond = PTHREAD_COND_INITIALIZER;
 
+/**
+ * Sequence number of the last alarm request that the main thread inserted into
+ * the alarm list. Every alarm request that is inserted gets the next sequence
+ * number, so the sequence numbers give the order that the requests arrived in.
+ */
+unsigned long last_inserted_sequence_number = 0;
+
+/**
+ * Queue of alarm requests that the main thread has inserted into the alarm
+ * list but that the alarm thread has not handled yet, in the order of their
+ * sequence numbers (oldest first). The requests are linked through their
+ * queue_next pointers.
+ *
+ * The main thread adds every request that it inserts to the back of the
+ * queue, and the alarm thread takes the whole queue each time it wakes up, so
+ * no request is missed however many arrive before the alarm thread runs.
+ */
+alarm_request_t *alarm_request_queue_head = NULL;
+alarm_request_t *alarm_request_queue_tail = NULL;
+
+/**
+ * The write-ahead log, if there is one. The main thread appends every request
+ * it accepts into the alarm list while the alarm list mutex is locked, so the
+ * records are in the order of the sequence numbers.
+ */
+write_ahead_log_t write_ahead_log;
+bool write_ahead_log_enabled = false;
+
+/**
+ * The file that the Checkpoint command writes the alarm list to, and that it
+ * is loaded from at startup, or NULL if there is none. It is set by the main
+ * thread before any other threads are created.
+ */
+const char *checkpoint_path = NULL;
+
 /*******************************************************************************
  *                      DATA SPECIFIC TO ALARM THREAD                          *
  ******************************************************************************/
 
 /**
- * Header of the list of periodic display threads.
+ * Index from time value to the number of live alarms with that time value and
+ * the data of the periodic display thread for that time value. It is
+ * initialized by the main thread before any other threads are created.
  */
-periodic_display_thread_t thread_list_header = {0};
+time_value_index_t time_value_index;
 
 /**
  * The number of periodic display threads that the alarm thread has created.
+ * Only the alarm thread changes it; it is atomic so that the metrics server
+ * can read it.
  */
-int number_of_periodic_display_threads = 0;
+atomic_int number_of_periodic_display_threads = 0;
 
 /*******************************************************************************
  *                      HELPER FUNCTIONS FOR ALARM THREAD                      *
  ******************************************************************************/
 
 /**
- * A.3.3.1 Returns a pointer to the most recently-added alarm request in the
- * alarm list. If the alarm list is empty, then NULL is returned.
- *
- * This is done by traversing the entire alarm list and finding the alarm
- * request with the greated creation time (most recently created).
+ * A.3.3.1 Takes every alarm request from the alarm request queue and returns
+ * the first one (the others follow it through their queue_next pointers). The
+ * queue is empty afterwards. If the queue was already empty, then NULL is
+ * returned.
  *
  * Note that the alarm list mutex must be locked by the caller of this method.
  */
-alarm_request_t *get_most_recent_alarm_request() {
-    alarm_request_t *alarm_request = alarm_list_header.next;
-    alarm_request_t *newest_alarm_request = alarm_list_header.next;
-
-    while (alarm_request != NULL) {
-        if (alarm_request->creation_time > newest_alarm_request->creation_time) {
-            newest_alarm_request = alarm_request;
-        }
+alarm_request_t *take_alarm_request_queue() {
+    alarm_request_t *alarm_request = alarm_request_queue_head;
 
-        alarm_request = alarm_request->next;
-    }
+    alarm_request_queue_head = NULL;
+    alarm_request_queue_tail = NULL;
 
-    return newest_alarm_request;
+    return alarm_request;
 }
 
 
-/**
- * A.3.3.4. Checks if any alarm requests in the alarm list have the given time
- * value.
- *
- * Returns true if there exists at least one alarm request in the alarm list
- * that has the given time value, false otherwise.
- */
-bool does_time_exist_in_alarm_list(int time) {
-    alarm_request_t *alarm_node = alarm_list_header.next;
-
-    while (alarm_node != NULL) {
-        if (alarm_node->time == time) {
-            return true;
-        }
-
-        alarm_node = alarm_node->next;
-    }
-
-    return false;
-}
-
 /**
  * A.3.3.6. Prints all the alarm requests in the alarm list. Note that the alarm
  * list is sorted by the time values of the alarm requests, so the alarm
  * requests will be printed in order of time values.
  */
 void print_alarm_list() {
-    alarm_request_t *alarm_request = alarm_list_header.next;
+    alarm_request_t *alarm_request = alarm_list.header.next;
 
-    printf("[");
+    log_printf("[");
 
     while (alarm_request != NULL) {
-        printf(
-            "{AlarmId: %d, Type: %s, Time: %d, Message: %s}",
+        log_printf(
+            "{AlarmId: %d, Type: %s, Time: %s, Message: %s}",
             alarm_request->alarm_id,
             request_type_string(alarm_request),
-            alarm_request->time,
-            alarm_request->message
+            TIME_STRING(alarm_request->time),
+            alarm_request->message->text
         );
         if (alarm_request->next != NULL) {
-            printf(", ");
+            log_printf(", ");
         }
 
         alarm_request = alarm_request->next;
     }
 
-    printf("]\n");
+    log_printf("]\n");
 }
 
 /**
- * A.3.3.5. Adds an alarm to the circular buffer.
+ * A.3.3.5. Adds an alarm to the circular buffer of the consumer that owns its
+ * alarm ID.
  *
- * This is the producer part of the bounded-buffer problem. It waits on the
- * empty semaphore to decrement it, adds the item to the buffer, then signals
- * the full semaphore to increment it. A third semaphore controls access to the
- * buffer. This also increments the write index.
+ * This is the producer part of the bounded-buffer problem. It blocks only
+ * while the buffer is full, until the consumer thread takes an item from it.
  */
 void write_to_circular_buffer(alarm_request_t *alarm_request) {
-    /*
-     * Wait on the emptry semaphore. If the buffer is full (semaphore value is
-     * 0), then this call will block until an item is taken from the buffer and
-     * this semaphore is signaled.
-     */
-    sem_wait(&circular_buffer_empty_sem);
-
-    /*
-     * Lock the circular buffer mutex to ensure mututal exclusion on the
-     * buffer.
-     */
-    pthread_mutex_lock(&circular_buffer_mutex);
-
-    /*
-     * A.3.3.5. Put the alarm request in the circular buffer
-     */
-    circularBuffer[writeIndex] = alarm_request;
-
-    /*
-     * Increment the write index
-     */
-    writeIndex = (writeIndex + 1) % CIRCULAR_BUFFER_SIZE;
+    uint64_t start = latency_clock_now();
 
-    /*
-     * Unlock the circular buffer mutex to allow other threads to access the
-     * buffer.
-     */
-    pthread_mutex_unlock(&circular_buffer_mutex);
+    ring_buffer_put(
+        &consumer_for_alarm(alarm_request->alarm_id)->circular_buffer,
+        alarm_request
+    );
 
-    /*
-     * Signal the full semaphore to signal that there is one more item in the
-     * buffer.
-     */
-    sem_post(&circular_buffer_full_sem);
+    latency_histogram_record_since(&circular_buffer_wait_histogram, start);
 }
 
 /**
- * A.3.3.4. Checks if a thread in the thread list exists for the given time
- * value.
+ * Retires the data of a periodic display thread once no live alarms have its
+ * time value anymore. The data may be NULL, in which case nothing happens.
  *
- * Returns true if a thread with that time value does exist in the thread list,
- * false otherwise.
+ * Note that this does not stop the periodic display, just tells it that it
+ * has been retired and frees the data corresponding to it. The display stops
+ * by itself (and frees its own periodic_display_t) at the first period after
+ * that in which it has no more alarms to display. It cannot stop before it
+ * has been retired, so the display is still there to be told.
  */
-bool does_thread_exist(int time) {
-    periodic_display_thread_t *thread = thread_list_header.next;
-
-    while (thread != NULL) {
-        if (thread->time == time) {
-            return true;
-        }
-
-        thread = thread->next;
+void retire_periodic_display_thread(periodic_display_thread_t *thread) {
+    if (thread == NULL) {
+        return;
     }
 
-    return false;
+    atomic_store_explicit(&thread->display->retired, true, memory_order_release);
+    object_pool_free(&periodic_display_thread_pool, thread);
 }
 
 /**
- * Adds a thread to the thread list.
+ * Periodic displays that the alarm thread has created and not started yet,
+ * linked through next_new. The alarm thread starts them with
+ * start_new_periodic_displays once the requests they were created for are in
+ * the consumers' circular buffers, because with a period of a millisecond,
+ * the first period could otherwise come before a consumer has had any chance
+ * to publish those alarms.
  */
-void add_thread_to_list(periodic_display_thread_t *thread) {
-    if (thread_list_header.next == NULL) {
-        // If the thread list is empty, make the new thread the only element in
-        // the list.
-        thread_list_header.next = thread;
-    } else {
-        // If the thread list is not empty, insert the new thread as the first
-        // element of the list.
-        thread->next = thread_list_header.next;
-        thread_list_header.next = thread;
-    }
-    // Increment number of periodic display threads
-    number_of_periodic_display_threads++;
-}
+periodic_display_t *new_periodic_displays = NULL;
 
 /**
- * Removes all threads with the given time value from the list of threads.
- *
- * Note that THIS METHOD WILL FREE THREAD DATA THAT ARE FOUND, so don't keep
- * references to the thread list entries.
+ * Schedules the first period of every periodic display that the alarm thread
+ * has created since it last called this, one time value from now.
  */
-void remove_thread_from_list(int time) {
-    periodic_display_thread_t *thread_node = thread_list_header.next;
-    periodic_display_thread_t *thread_prev = &thread_list_header;
-    periodic_display_thread_t *thread_temp;
-
-    while (thread_node != NULL) {
-        if (thread_node->time == time) {
-            thread_prev->next = thread_node->next;
-
-            thread_temp = thread_node;
-            thread_node = thread_node->next;
-            free(thread_temp);
-
-            /*
-             * Don't increment alarm node because it has already been
-             * incremented during the removal above.
-             */
-            continue;
-        }
-
-        thread_node = thread_node->next;
-        thread_prev = thread_prev->next;
+void start_new_periodic_displays(void) {
+    periodic_display_t *display;
+
+    while (new_periodic_displays != NULL) {
+        display = new_periodic_displays;
+        new_periodic_displays = display->next_new;
+        display->next_new = NULL;
+        timing_wheel_schedule(&display_timing_wheel, &display->timer, display->time);
     }
 }
 
 /**
- * A.3.3.4. Creates a new periodic display thread and adds the data
- * representation of the thread to the thread list.
+ * A.3.3.4. Creates a new periodic display thread and returns the data
+ * representation of the thread (to be kept in the time value index). The
+ * periodic display does not run until start_new_periodic_displays is called.
  */
-void create_periodic_display_thread(alarm_request_t *alarm_request) {
+periodic_display_thread_t *create_periodic_display_thread(alarm_request_t *alarm_request) {
     /*
      * Allocate data for the new thread
      */
-    periodic_display_thread_t *thread = malloc(sizeof(periodic_display_thread_t));
-    if (thread == NULL) {
-        errno_abort("Malloc failed");
-    }
+    periodic_display_thread_t *thread = object_pool_allocate(&periodic_display_thread_pool);
 
     /*
-     * Give time value and ID for the new thread
+     * The periodic display belongs to its own timer and task, because the
+     * alarm thread may retire (and free) the data in the time value index
+     * before the periodic display has finished.
      */
-    thread->time = alarm_request->time;
-    thread->thread_id = PERIODIC_DISPLAY_THREAD_START_ID
-        + number_of_periodic_display_threads;
+    periodic_display_t *display = object_pool_allocate(&periodic_display_pool);
+    memset(display, 0, sizeof(periodic_display_t));
 
     /*
-     * A.3.3.4. Create the new periodic display thread
+     * Give time value and ID for the new thread
      */
-    pthread_create(
-        &thread->thread,
-        NULL,
-        periodic_display_thread_routine,
-        thread
-    );
+    thread->time = alarm_request->time;
+    thread->thread_id = CONSUMER_THREAD_ID + number_of_consumers
+        + number_of_periodic_display_threads;
+    number_of_periodic_display_threads++;
+    atomic_fetch_add_explicit(&live_periodic_displays, 1, memory_order_relaxed);
+    display->thread_id = thread->thread_id;
+    display->time = thread->time;
+    atomic_init(&display->retired, false);
+    thread->display = display;
 
     /*
-     * Add the newly-created thread to the list of threads
+     * A.3.3.4. No thread is created for the new periodic display: its periods
+     * run on the display worker pool (or on the timing wheel's thread), once
+     * it has been started.
      */
-    add_thread_to_list(thread);
+    display->task.run = periodic_display_task;
+    display->task.arg = display;
+    display->timer.callback = timing_wheel_mode
+        ? periodic_display_wheel_callback
+        : periodic_display_timer_callback;
+    display->timer.arg = display;
+    display->next_new = new_periodic_displays;
+    new_periodic_displays = display;
 
     /*
      * A.3.3.4. Print success message
      */
-    printf(
+    log_printf(
         "Alarm Thread Created New Periodic display thread %d For Alarm(%d) at "
-        "%ld: For New Time Value = %d Message = %s\n",
+        "%ld: For New Time Value = %s Message = %s\n",
         thread->thread_id,
         alarm_request->alarm_id,
         time(NULL),
-        alarm_request->time,
-        alarm_request->message
+        TIME_STRING(alarm_request->time),
+        alarm_request->message->text
     );
-}
 
-void handle_alarm_list_update() {
-    /*
-     * Make sure alarm list is not empty
-     */
-    if (alarm_list_header.next == NULL) {
-        printf("Alarm thread found error: alarm list is empty!\n");
-        return;
-    }
+    return thread;
+}
 
-    /*
-     * A.3.3.1 Get the most recent alarm request
-     */
-    alarm_request_t *newest_alarm_request = get_most_recent_alarm_request();
+/**
+ * Applies an alarm request that the main thread inserted into the alarm list:
+ * removes the alarm requests that it replaces from the alarm list, updates
+ * the time value index, and creates or retires periodic displays. The
+ * messages about it are only printed if print_messages is true. Returns false
+ * if the alarm request has an invalid type.
+ *
+ * Note that the alarm list mutex must be locked by the caller of this method.
+ */
+bool update_alarm_list(alarm_request_t *newest_alarm_request, bool print_messages) {
     int newest_alarm_id = newest_alarm_request->alarm_id;
 
     int old_time_value;
 
-    /*
-     * Make a copy of the alarm request to give to the consumer thread
-     */
-    alarm_request_t *alarm_request_copy = copy_alarm_request(newest_alarm_request);
+    time_value_entry_t *time_value_entry;
 
     /*
      * Take action depending on the type of the alarm request
@@ -1091,60 +1290,79 @@ void handle_alarm_list_update() {
     switch (newest_alarm_request->type) {
         case Start_Alarm:
             /*
-             * A.3.3.4. If no thread in the thread list exists for the time
-             * value of the alarm request, then create a periodic display thread
-             * to handle requests with that time value.
+             * Count the new alarm for its time value.
+             */
+            time_value_entry = add_alarm_to_time_value(
+                &time_value_index,
+                newest_alarm_request->time
+            );
+
+            /*
+             * A.3.3.4. If no thread exists for the time value of the alarm
+             * request, then create a periodic display thread to handle
+             * requests with that time value.
              */
-            if (does_thread_exist(newest_alarm_request->time) == false) {
-                create_periodic_display_thread(newest_alarm_request);
+            if (time_value_entry->thread == NULL) {
+                time_value_entry->thread = create_periodic_display_thread(newest_alarm_request);
             }
 
             break;
 
         case Change_Alarm:
+            /*
+             * Count the alarm for its new time value. This is done before the
+             * old time value is released, so that a Change_Alarm request that
+             * keeps the same time value does not retire the thread.
+             */
+            time_value_entry = add_alarm_to_time_value(
+                &time_value_index,
+                newest_alarm_request->time
+            );
+
             /*
              * A.3.3.3.  Remove old alarm requests from list
              */
             old_time_value = remove_old_alarm_requests_from_list(
-                &alarm_list_header,
+                &alarm_list,
                 newest_alarm_id,
                 newest_alarm_request
             );
 
             /*
-             * If there are no longer any alarm requests with the given time
-             * value in the alarm list, then remove the periodic display thread
-             * corresponding to that time value.
-             *
-             * Note that this does not destory the thread, just the data
-             * corresponding to it.
+             * If there are no longer any live alarms with the old time value,
+             * then retire the periodic display thread corresponding to that
+             * time value.
              */
-            if (does_time_exist_in_alarm_list(old_time_value) == false) {
-                remove_thread_from_list(old_time_value);
+            if (old_time_value != -1) {
+                retire_periodic_display_thread(
+                    remove_alarm_from_time_value(&time_value_index, old_time_value)
+                );
             }
 
             /*
              * A.3.3.3. Print success message.
              */
-            printf(
-                "Alarm Thread %d at %ld Has Removed All Alarm Requests "
-                "With Alarm ID %d From Alarm List Except The Most Recent "
-                "Change Alarm Request(%d) Time = %d Message = %s\n",
-                0,
-                time(NULL),
-                newest_alarm_id,
-                newest_alarm_id,
-                newest_alarm_request->time,
-                newest_alarm_request->message
-            );
+            if (print_messages) {
+                log_printf(
+                    "Alarm Thread %d at %ld Has Removed All Alarm Requests "
+                    "With Alarm ID %d From Alarm List Except The Most Recent "
+                    "Change Alarm Request(%d) Time = %s Message = %s\n",
+                    0,
+                    time(NULL),
+                    newest_alarm_id,
+                    newest_alarm_id,
+                    TIME_STRING(newest_alarm_request->time),
+                    newest_alarm_request->message->text
+                );
+            }
 
             /*
-             * A.3.3.4. If no thread in the thread list exists for the time
-             * value of the alarm request, then create a periodic display thread
-             * to handle requests with that time value.
+             * A.3.3.4. If no thread exists for the time value of the alarm
+             * request, then create a periodic display thread to handle
+             * requests with that time value.
              */
-            if (does_thread_exist(newest_alarm_request->time) == false) {
-                create_periodic_display_thread(newest_alarm_request);
+            if (time_value_entry->thread == NULL) {
+                time_value_entry->thread = create_periodic_display_thread(newest_alarm_request);
             }
 
             break;
@@ -1159,42 +1377,132 @@ void handle_alarm_list_update() {
             /*
              * A.3.3.2. Remove alarm requests from list with the given alarm ID
              */
-            remove_alarm_requests_from_list(&alarm_list_header, newest_alarm_id);
+            remove_alarm_requests_from_list(&alarm_list, newest_alarm_request);
 
             /*
              * A.3.3.2. Print success message
              */
-            printf(
-                "Alarm Thread %d Has Cancelled and Removed All Alarm Requests "
-                "With Alarm ID %d from Alarm List at %ld\n",
-                0,
-                newest_alarm_id,
-                time(NULL)
-            );
+            if (print_messages) {
+                log_printf(
+                    "Alarm Thread %d Has Cancelled and Removed All Alarm Requests "
+                    "With Alarm ID %d from Alarm List at %ld\n",
+                    0,
+                    newest_alarm_id,
+                    time(NULL)
+                );
+            }
 
             /*
-             * If there are no longer any alarm requests with the given time
-             * value in the alarm list, then remove the periodic display thread
-             * corresponding to that time value.
-             *
-             * Note that this does not destory the thread, just the data
-             * corresponding to it.
+             * If there are no longer any live alarms with the given time
+             * value, then retire the periodic display thread corresponding to
+             * that time value.
              */
-            if (does_time_exist_in_alarm_list(old_time_value) == false) {
-                remove_thread_from_list(old_time_value);
-            }
+            retire_periodic_display_thread(
+                remove_alarm_from_time_value(&time_value_index, old_time_value)
+            );
 
             break;
 
         default:
-            printf("Alarm thread found error: invalid alarm request type!\n");
-            return;
+            log_printf("Alarm thread found error: invalid alarm request type!\n");
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * Handles an alarm request that the main thread inserted into the alarm list.
+ *
+ * Note that the alarm list mutex must be locked by the caller of this method.
+ */
+void handle_alarm_list_update(alarm_request_t *newest_alarm_request) {
+    /*
+     * Make a copy of the alarm request to give to the consumer thread
+     */
+    alarm_request_t *alarm_request_copy = copy_alarm_request(newest_alarm_request);
+
+    if (!update_alarm_list(newest_alarm_request, true)) {
+        free_alarm_request(alarm_request_copy);
+        return;
     }
 
     /*
-     * A.3.3.5. Add the alarm request to the circular buffer
+     * A.3.3.5. Add the alarm request to the circular buffer, then start the
+     * periodic display created for it, if any
      */
     write_to_circular_buffer(alarm_request_copy);
+    start_new_periodic_displays();
+
+    /*
+     * A.3.3.6. Print all the alarm requests currently in the alarm list
+     */
+    print_alarm_list();
+}
+
+/**
+ * Handles the alarm requests of a bulk request (the given one and the ones
+ * linked behind it) that the main thread inserted into the alarm list, as
+ * one unit: they are applied to the alarm list in one pass, the copies for
+ * each consumer are linked together and put in its circular buffer as one
+ * item, and one message is printed for all of them (and the alarm list is
+ * printed once).
+ *
+ * Note that the alarm list mutex must be locked by the caller of this method.
+ */
+void handle_bulk_alarm_list_update(alarm_request_t *alarm_request) {
+    alarm_request_t *first_copies[MAXIMUM_NUMBER_OF_CONSUMERS] = {NULL};
+    alarm_request_t *last_copies[MAXIMUM_NUMBER_OF_CONSUMERS];
+    alarm_request_t *alarm_request_copy;
+    alarm_request_t *next_alarm_request;
+    const char *type = request_type_string(alarm_request);
+    char alarm_ids[ALARM_IDS_STRING_SIZE];
+    size_t count = format_alarm_ids(alarm_request, alarm_ids, sizeof(alarm_ids));
+    unsigned int shard;
+
+    while (alarm_request != NULL) {
+        /*
+         * Get the next one first, because handling a Cancel_Alarm request
+         * frees it.
+         */
+        next_alarm_request = alarm_request->bulk_next;
+        alarm_request->bulk_next = NULL;
+
+        alarm_request_copy = copy_alarm_request(alarm_request);
+        if (update_alarm_list(alarm_request, false)) {
+            shard = (unsigned int) alarm_request_copy->alarm_id % number_of_consumers;
+            if (first_copies[shard] == NULL) {
+                first_copies[shard] = alarm_request_copy;
+            } else {
+                last_copies[shard]->bulk_next = alarm_request_copy;
+            }
+            last_copies[shard] = alarm_request_copy;
+        } else {
+            free_alarm_request(alarm_request_copy);
+        }
+
+        alarm_request = next_alarm_request;
+    }
+
+    log_printf(
+        "Alarm Thread Has Handled %zu Alarm_Request_Type %s Requests(%s) "
+        "in Alarm List at %ld\n",
+        count,
+        type,
+        alarm_ids,
+        time(NULL)
+    );
+
+    /*
+     * A.3.3.5. Add the alarm requests to the circular buffers, then start the
+     * periodic displays created for them
+     */
+    for (int i = 0; i < number_of_consumers; i++) {
+        if (first_copies[i] != NULL) {
+            write_to_circular_buffer(first_copies[i]);
+        }
+    }
+    start_new_periodic_displays();
 
     /*
      * A.3.3.6. Print all the alarm requests currently in the alarm list
@@ -1212,6 +1520,10 @@ void handle_alarm_list_update() {
 void *alarm_thread_routine(void *arg) {
     DEBUG_MESSAGE("Alarm thread running.");
 
+    alarm_request_t *alarm_request;
+    alarm_request_t *next_alarm_request;
+    uint64_t start;
+
     /*
      * Lock the alarm list mutex
      */
@@ -1221,17 +1533,36 @@ void *alarm_thread_routine(void *arg) {
         /*
          * A.3.3.1. Wait for changes to the alarm list
          */
-        pthread_cond_wait(&alarm_list_cond, &alarm_list_mutex);
+        while (alarm_request_queue_head == NULL) {
+            pthread_cond_wait(&alarm_list_cond, &alarm_list_mutex);
+        }
 
         /*
-         * Handle the update to the alarm list
+         * Handle every update to the alarm list since the last wakeup, oldest
+         * first. The main thread may have inserted a whole batch of requests
+         * before this thread woke up.
          */
-        handle_alarm_list_update();
+        alarm_request = take_alarm_request_queue();
+        while (alarm_request != NULL) {
+            /*
+             * Get the next request first, because handling a Cancel_Alarm
+             * request frees it.
+             */
+            next_alarm_request = alarm_request->queue_next;
+            alarm_request->queue_next = NULL;
+
+            start = latency_clock_now();
+            if (alarm_request->bulk_next != NULL) {
+                handle_bulk_alarm_list_update(alarm_request);
+            } else {
+                handle_alarm_list_update(alarm_request);
+            }
+            latency_histogram_record_since(&alarm_thread_handling_histogram, start);
 
-        /*
-         * Unlock alarm list mutex
-         */
-        pthread_mutex_unlock(&alarm_list_mutex);
+            alarm_request = next_alarm_request;
+        }
+
+        atomic_store_explicit(&alarm_list_length, alarm_list.length, memory_order_relaxed);
     }
 
     return NULL;
@@ -1241,44 +1572,115 @@ void *alarm_thread_routine(void *arg) {
  *                     HELPER FUNCTIONS FOR MAIN THREAD                        *
  ******************************************************************************/
 
+/**
+ * Prints the response to a command, formatted as if you were calling printf.
+ * If the command came from a client of the command server (rather than from
+ * standard input, in which case the client is NULL), the response is also
+ * sent back to that client.
+ */
+void print_response(command_client_t *client, const char *format, ...) {
+    va_list args;
+
+    va_start(args, format);
+    if (client != NULL) {
+        va_list copy;
+
+        va_copy(copy, args);
+        command_client_vprintf(client, format, copy);
+        va_end(copy);
+    }
+    log_vprintf(format, args);
+    va_end(args);
+}
+
 /**
  * Finds an alarm in the list using a specified ID
  *
  * Alarm list has to be locked by the caller of this method
  *
- * Goes through the linked list, when specified ID is found, pointer
- * to that alarm will be returned.
+ * Looks up the most recently inserted alarm request with the specified ID in
+ * the alarm ID index (the alarm thread may not have removed the older ones
+ * yet). If it is a Cancel_Alarm request, then the alarm has been
+ * cancelled and NULL is returned, otherwise a pointer to it is returned.
  *
  * If the specified ID is not found, return NULL.
  */
 alarm_request_t* find_alarm_by_id(int id) {
-    alarm_request_t *alarm_node = alarm_list_header.next;
-    
-    //Loop through the list
-    while(alarm_node != NULL) {
-        //if ID is found, return pointer to it
-        if(alarm_node-> alarm_id == id) {
-            return alarm_node;
-        }
-        //if ID is NOT found, go to next node
-        else {
-            alarm_node = alarm_node->next;
-        }
+    alarm_request_t *newest_alarm_node = find_newest_alarm_request(&alarm_list, id);
+
+    //If the alarm has been cancelled, it does not exist anymore
+    if (newest_alarm_node != NULL && newest_alarm_node->type == Cancel_Alarm) {
+        return NULL;
     }
-    //If the entire list was searched and specified ID was not
-    //found, return NULL.
-    return NULL;
+
+    //If the specified ID was not found, this is NULL.
+    return newest_alarm_node;
+}
+
+/**
+ * Returns true if a request can be added to the alarm list, given the newest
+ * alarm request with its alarm ID (see find_alarm_by_id): a Start_Alarm
+ * request needs an alarm ID that does not exist yet, and the other requests
+ * one that does.
+ */
+bool is_request_valid(alarm_request_t *alarm_request, alarm_request_t *old_alarm_request) {
+    return (alarm_request->type == Start_Alarm) == (old_alarm_request == NULL);
+}
+
+/**
+ * Inserts a valid request into the alarm list with the next sequence number,
+ * given the newest alarm request with its alarm ID (see find_alarm_by_id).
+ *
+ * Note that the alarm list mutex must be locked by the caller of this method.
+ */
+void insert_request(alarm_request_t *alarm_request, alarm_request_t *old_alarm_request) {
+    /*
+     * If the alarm request is a Cancel_Alarm request, then it will not have the
+     * time and message values from the user. In this case, copy the time and
+     * message values from the older request from the alarm list.
+     */
+    if (alarm_request->type == Cancel_Alarm) {
+        alarm_request->time = old_alarm_request->time;
+        message_release(alarm_request->message);
+        alarm_request->message = message_retain(old_alarm_request->message);
+    }
+
+    /*
+     * A.3.2. Insert alarm request to alarm list
+     */
+    alarm_request->sequence_number = ++last_inserted_sequence_number;
+    insert_to_alarm_list(&alarm_list, alarm_request);
+}
+
+/**
+ * Adds an alarm request (with any alarm requests linked behind it through
+ * their bulk_next pointers) to the back of the queue for the alarm thread.
+ *
+ * Note that the alarm list mutex must be locked by the caller of this method.
+ */
+void enqueue_alarm_request(alarm_request_t *alarm_request) {
+    alarm_request->queue_next = NULL;
+    if (alarm_request_queue_tail == NULL) {
+        alarm_request_queue_head = alarm_request;
+    } else {
+        alarm_request_queue_tail->queue_next = alarm_request;
+    }
+    alarm_request_queue_tail = alarm_request;
 }
 
 /**
  * Handles a request.
  *
- * A request is handled by adding the request to the alarm list.
+ * A request is handled by adding the request to the alarm list, giving it the
+ * next sequence number and adding it to the back of the alarm request queue.
+ * Returns true if the request was added, or false if it was rejected (in which
+ * case the caller still owns the request). The response is also sent to the
+ * client that sent the request, if any.
  *
  * Note that the alarm list mutex must be locked by the caller of this method
  * (because it updates the alarm list).
  */
-void handle_request(alarm_request_t *alarm_request) {
+bool handle_request(alarm_request_t *alarm_request, command_client_t *client) {
     /*
      * Get alarm requests with the given ID from the alarm list
      */
@@ -1289,12 +1691,13 @@ void handle_request(alarm_request_t *alarm_request) {
      * an existing alarm request with that same ID.
      */
     if (alarm_request->type == Start_Alarm && old_alarm_request != NULL) {
-        printf(
+        print_response(
+            client,
             "Alarm with ID %d already exists, so request type Start_Alarm "
             "cannot be performed\n",
             alarm_request->alarm_id
         );
-        return;
+        return false;
     }
 
     /*
@@ -1302,154 +1705,755 @@ void handle_request(alarm_request_t *alarm_request) {
      * an existing alarm request with that same ID.
      */
     if (alarm_request->type != Start_Alarm && old_alarm_request == NULL) {
-        printf(
+        print_response(
+            client,
             "Alarm with ID %d does not exist, so request type %s cannot be "
             "performed on alarm ID %d\n",
             alarm_request->alarm_id,
             request_type_string(alarm_request),
             alarm_request->alarm_id
         );
-        return;
-    }
-
-    /*
-     * If the alarm request is a Cancel_Alarm request, then it will not have the
-     * time and message values from the user. In this case, copy the time and
-     * message values from the older request from the alarm list.
-     */
-    if (alarm_request->type == Cancel_Alarm) {
-        alarm_request->time = old_alarm_request->time;
-        strncpy(
-            alarm_request->message,
-            old_alarm_request->message,
-            strlen(old_alarm_request->message)
-        );
+        return false;
     }
 
-    /*
-     * A.3.2. Insert alarm request to alarm list
-     */
-    insert_to_alarm_list(&alarm_list_header, alarm_request);
+    insert_request(alarm_request, old_alarm_request);
+    enqueue_alarm_request(alarm_request);
 
     /*
      * A.3.2. Print success message
      */
-    printf(
+    print_response(
+        client,
         "Main Thread has Inserted Alarm_Request_Type %s Request(%d) at "
-        "%ld: Time = %d Message = %s into Alarm List\n",
+        "%ld: Time = %s Message = %s into Alarm List\n",
         request_type_string(alarm_request),
         alarm_request->alarm_id,
         time(NULL),
-        alarm_request->time,
-        alarm_request->message
+        TIME_STRING(alarm_request->time),
+        alarm_request->message->text
     );
+
+    return true;
 }
 
 /**
- * Handles a request in a thread-safe way. This is done by locking the alarm
- * list mutex, handling the request, then unlocking the alarm list mutex.
+ * Handles a bulk request (the given alarm request and the ones linked behind
+ * it through their bulk_next pointers).
  *
- * A request is handled by adding the request to the alarm list.
+ * Each of its alarm requests is checked and inserted into the alarm list as if
+ * it were a request of its own, in order, but the ones that are added stay
+ * linked together, and only the first of them goes into the alarm request
+ * queue, so the alarm thread and the consumers handle them as one unit. The
+ * rejected ones are freed. One line is printed (and sent to the client, if
+ * any) for the ones that were added, and one for the ones that were rejected,
+ * instead of one per alarm. Returns the first alarm request that was added
+ * (with the others linked behind it), or NULL if none was.
+ *
+ * Note that the alarm list mutex must be locked by the caller of this method.
  */
-void handle_request_thread_safe(alarm_request_t *alarm_request) {
+alarm_request_t *handle_bulk_request(alarm_request_t *alarm_request, command_client_t *client) {
+    alarm_request_t *first_added = NULL;
+    alarm_request_t *last_added = NULL;
+    alarm_request_t *first_rejected = NULL;
+    alarm_request_t *last_rejected = NULL;
+    alarm_request_t *old_alarm_request;
+    alarm_request_t *next_alarm_request;
+    char alarm_ids[ALARM_IDS_STRING_SIZE];
+    size_t count;
+
+    while (alarm_request != NULL) {
+        next_alarm_request = alarm_request->bulk_next;
+        alarm_request->bulk_next = NULL;
+
+        old_alarm_request = find_alarm_by_id(alarm_request->alarm_id);
+        if (is_request_valid(alarm_request, old_alarm_request)) {
+            insert_request(alarm_request, old_alarm_request);
+            if (first_added == NULL) {
+                first_added = alarm_request;
+            } else {
+                last_added->bulk_next = alarm_request;
+            }
+            last_added = alarm_request;
+        } else {
+            if (first_rejected == NULL) {
+                first_rejected = alarm_request;
+            } else {
+                last_rejected->bulk_next = alarm_request;
+            }
+            last_rejected = alarm_request;
+        }
+
+        alarm_request = next_alarm_request;
+    }
+
+    if (first_added != NULL) {
+        enqueue_alarm_request(first_added);
+
+        count = format_alarm_ids(first_added, alarm_ids, sizeof(alarm_ids));
+        if (first_added->type == Cancel_Alarm) {
+            print_response(
+                client,
+                "Main Thread has Inserted %zu Alarm_Request_Type %s "
+                "Requests(%s) at %ld into Alarm List\n",
+                count,
+                request_type_string(first_added),
+                alarm_ids,
+                time(NULL)
+            );
+        } else {
+            print_response(
+                client,
+                "Main Thread has Inserted %zu Alarm_Request_Type %s "
+                "Requests(%s) at %ld: Time = %s Message = %s into Alarm List\n",
+                count,
+                request_type_string(first_added),
+                alarm_ids,
+                time(NULL),
+                TIME_STRING(first_added->time),
+                first_added->message->text
+            );
+        }
+    }
+
+    if (first_rejected != NULL) {
+        count = format_alarm_ids(first_rejected, alarm_ids, sizeof(alarm_ids));
+        atomic_fetch_add_explicit(&rejected_requests, count, memory_order_relaxed);
+
+        if (first_rejected->type == Start_Alarm) {
+            print_response(
+                client,
+                "%zu Alarms with IDs (%s) already exist, so request type "
+                "Start_Alarm cannot be performed on them\n",
+                count,
+                alarm_ids
+            );
+        } else {
+            print_response(
+                client,
+                "%zu Alarms with IDs (%s) do not exist, so request type %s "
+                "cannot be performed on them\n",
+                count,
+                alarm_ids,
+                request_type_string(first_rejected)
+            );
+        }
+
+        while (first_rejected != NULL) {
+            next_alarm_request = first_rejected->bulk_next;
+            free_alarm_request(first_rejected);
+            first_rejected = next_alarm_request;
+        }
+    }
+
+    return first_added;
+}
+
+/**
+ * Handles a batch of requests in a thread-safe way. This is done by locking
+ * the alarm list mutex, handling every request in the order they are given,
+ * signalling the alarm thread once, then unlocking the alarm list mutex.
+ *
+ * Requests that are rejected are freed. Clients holds the client that sent each
+ * request, or is NULL if they all came from standard input.
+ *
+ * If there is a write-ahead log, the accepted requests are appended to it,
+ * and this waits (after unlocking the alarm list mutex) until they are
+ * durable, so the main thread does not go on to the next commands before
+ * then. Every request of the batch shares the same sync.
+ */
+void handle_request_batch_thread_safe(
+    alarm_request_t *alarm_requests[],
+    command_client_t *clients[],
+    int number_of_alarm_requests
+) {
+    bool any_handled = false;
+    unsigned long lsn = 0;              // Of the last request logged.
+    uint64_t start = latency_clock_now();
+    command_client_t *client;
+    alarm_request_t *added;             // Alarm requests added for one
+                                        // request (several for a bulk one).
+
     /*
      * Lock mutex
      */
     pthread_mutex_lock(&alarm_list_mutex);
+    latency_histogram_record_since(&alarm_list_mutex_wait_histogram, start);
 
     /*
-     * Handle request
+     * Handle requests
      */
-    handle_request(alarm_request);
+    for (int i = 0; i < number_of_alarm_requests; i++) {
+        client = clients != NULL ? clients[i] : NULL;
 
-    /*
-     * Signal the alarm thread to wake up
-     */
-    pthread_cond_broadcast(&alarm_list_cond);
+        if (alarm_requests[i]->bulk_next != NULL) {
+            added = handle_bulk_request(alarm_requests[i], client);
+        } else if (handle_request(alarm_requests[i], client)) {
+            added = alarm_requests[i];
+        } else {
+            atomic_fetch_add_explicit(&rejected_requests, 1, memory_order_relaxed);
+            free_alarm_request(alarm_requests[i]);
+            added = NULL;
+        }
+
+        /*
+         * The alarm thread cannot free them before the mutex is unlocked.
+         */
+        for (; added != NULL; added = added->bulk_next) {
+            any_handled = true;
+            atomic_fetch_add_explicit(&accepted_requests[added->type], 1, memory_order_relaxed);
+            if (write_ahead_log_enabled) {
+                lsn = wal_append(&write_ahead_log, added);
+            }
+        }
+    }
+
+    atomic_store_explicit(&alarm_list_length, alarm_list.length, memory_order_relaxed);
+
+    /*
+     * Signal the alarm thread to wake up
+     */
+    if (any_handled) {
+        pthread_cond_broadcast(&alarm_list_cond);
+    }
 
     /*
      * Unlock mutex
      */
     pthread_mutex_unlock(&alarm_list_mutex);
+
+    if (lsn > 0) {
+        wal_wait_durable(&write_ahead_log, lsn);
+    }
+}
+
+/**
+ * Handles a request in a thread-safe way. This is done by locking the alarm
+ * list mutex, handling the request, then unlocking the alarm list mutex.
+ *
+ * A request is handled by adding the request to the alarm list.
+ */
+void handle_request_thread_safe(alarm_request_t *alarm_request) {
+    handle_request_batch_thread_safe(&alarm_request, NULL, 1);
+}
+
+/**
+ * Writes every alarm in the alarm list to the checkpoint file (the Checkpoint
+ * command), and sends the result to the client that sent the command, if any.
+ *
+ * The alarm list mutex is only locked while the alarms are copied out of the
+ * list (each copy holds a reference to the message, so the alarm thread may
+ * free the requests in the meantime); the file is written after it is
+ * unlocked. If there is a write-ahead log, it is emptied once the checkpoint
+ * is durable, since everything in it is in the checkpoint. The main thread is
+ * the only thread that appends to the log, so nothing is appended in between.
+ * If the process stops after the checkpoint is written but before the log is
+ * emptied, the log is replayed on top of the checkpoint at startup, which ends
+ * with the same alarms.
+ */
+void write_checkpoint(command_client_t *client) {
+    checkpoint_alarm_t *alarms;
+    size_t number_of_alarms = 0;
+    alarm_request_t *alarm_request;
+    bool clean;
+    uint64_t start = latency_clock_now();
+    uint64_t lock_time;
+    int status;
+
+    if (checkpoint_path == NULL) {
+        print_response(client, "Checkpoint failed: no checkpoint file was given (see -C)\n");
+        return;
+    }
+
+    pthread_mutex_lock(&alarm_list_mutex);
+    lock_time = latency_clock_now();
+
+    alarms = malloc((alarm_list.length > 0 ? alarm_list.length : 1) * sizeof(checkpoint_alarm_t));
+    if (alarms == NULL) {
+        errno_abort("Malloc failed");
+    }
+
+    /*
+     * Once the alarm thread has handled every request in the queue, the list
+     * holds exactly one request per alarm, and no Cancel_Alarm requests.
+     * Otherwise, only the newest request of each alarm is live.
+     */
+    clean = alarm_request_queue_head == NULL;
+    for (alarm_request = alarm_list.header.next;
+         alarm_request != NULL;
+         alarm_request = alarm_request->next) {
+        if (!clean
+            && (alarm_request->type == Cancel_Alarm
+                || find_newest_alarm_request(&alarm_list, alarm_request->alarm_id) != alarm_request)) {
+            continue;
+        }
+        alarms[number_of_alarms].alarm_id = alarm_request->alarm_id;
+        alarms[number_of_alarms].time = alarm_request->time;
+        alarms[number_of_alarms].type = alarm_request->type;
+        alarms[number_of_alarms].message = message_retain(alarm_request->message);
+        number_of_alarms++;
+    }
+
+    pthread_mutex_unlock(&alarm_list_mutex);
+    lock_time = latency_clock_now() - lock_time;
+
+    status = checkpoint_write(checkpoint_path, alarms, number_of_alarms);
+    if (status == 0 && write_ahead_log_enabled) {
+        wal_truncate(&write_ahead_log);
+    }
+
+    for (size_t i = 0; i < number_of_alarms; i++) {
+        message_release(alarms[i].message);
+    }
+    free(alarms);
+
+    if (status != 0) {
+        print_response(client, "Checkpoint failed: %s: %s\n", checkpoint_path, strerror(status));
+        return;
+    }
+
+    print_response(
+        client,
+        "Checkpoint: Alarms = %zu File = %s Time = %.3f ms Locked = %.3f ms\n",
+        number_of_alarms,
+        checkpoint_path,
+        (latency_clock_now() - start) / 1e6,
+        lock_time / 1e6
+    );
 }
 
 /*******************************************************************************
- *                                 MAIN THREAD                                 *
+ *                             STATISTICS THREAD                               *
  ******************************************************************************/
 
 /**
- * A.3.2. Main thread.
- *
- * The main thread is responsible for creating one alarm thread and one consumer
- * thread, receiving and parsing user input into alarm requests, and adding
- * alarm requests to the alarm list.
+ * Prints the statistics of every object pool, and how many log messages were
+ * dropped or spilled, to standard error.
  */
-int main() {
-    char input[USER_INPUT_BUFFER_SIZE]; // Buffer to store user input.
+void print_statistics() {
+    object_pool_print_statistics(&alarm_request_pool, stderr);
+    object_pool_print_statistics(&periodic_display_thread_pool, stderr);
+    object_pool_print_statistics(&periodic_display_pool, stderr);
+    message_store_print_statistics(stderr);
+    fprintf(
+        stderr,
+        "Log: Dropped = %zu Spilled = %zu\n",
+        log_dropped_count(),
+        log_spilled_count()
+    );
+    if (!timing_wheel_mode) {
+        fprintf(
+            stderr,
+            "Display workers: %d Periods run = %lu Stolen = %lu\n",
+            display_worker_pool.number_of_workers,
+            atomic_load_explicit(&display_worker_pool.tasks_run, memory_order_relaxed),
+            atomic_load_explicit(&display_worker_pool.tasks_stolen, memory_order_relaxed)
+        );
+    }
+}
 
-    alarm_request_t *alarm_request;     // Most recent alarm request (data
-                                        // structure representing the user's
-                                        // request).
+/**
+ * Prints the count and the latency percentiles of every stage of the pipeline
+ * (the Stats command), in microseconds, and sends them to the client that sent
+ * the command, if any. The other threads keep recording while this runs.
+ */
+void print_stage_statistics(command_client_t *client) {
+    latency_histogram_statistics_t statistics;
+
+    for (size_t i = 0; i < sizeof(stage_histograms) / sizeof(stage_histograms[0]); i++) {
+        statistics = latency_histogram_statistics(stage_histograms[i]);
+        print_response(
+            client,
+            "Stats: Stage = %s Count = %lu P50 = %.3f us P99 = %.3f us "
+            "P999 = %.3f us Max = %.3f us\n",
+            stage_histograms[i]->name,
+            statistics.count,
+            statistics.p50 / 1000.0,
+            statistics.p99 / 1000.0,
+            statistics.p999 / 1000.0,
+            statistics.max / 1000.0
+        );
+    }
+}
 
-    pthread_t alarm_thread;             // Alarm thread.
+/**
+ * Writes the metrics in the Prometheus text format (for the metrics server).
+ * Everything is read from atomics, so this never locks the alarm list or
+ * waits for any other thread.
+ */
+void write_metrics(FILE *stream) {
+    static const char *request_types[] = {"Start_Alarm", "Change_Alarm", "Cancel_Alarm"};
+    static const double quantiles[] = {0.5, 0.99, 0.999};
+    latency_histogram_statistics_t statistics;
+    uint64_t values[3];
+
+    fprintf(stream, "# HELP alarm_list_length Alarm requests in the alarm list.\n");
+    fprintf(stream, "# TYPE alarm_list_length gauge\n");
+    fprintf(stream, "alarm_list_length %zu\n",
+            atomic_load_explicit(&alarm_list_length, memory_order_relaxed));
+
+    fprintf(stream, "# HELP alarm_display_list_length Alarm requests in each consumer's shard of the alarm display list.\n");
+    fprintf(stream, "# TYPE alarm_display_list_length gauge\n");
+    for (int i = 0; i < number_of_consumers; i++) {
+        fprintf(stream, "alarm_display_list_length{consumer=\"%d\"} %zu\n",
+                consumers[i].thread_id,
+                atomic_load_explicit(&consumers[i].display_list_length, memory_order_relaxed));
+    }
 
-    pthread_t consumer_thread;          // Consumer thread.
+    fprintf(stream, "# HELP alarm_circular_buffer_occupancy Alarm requests in each consumer's circular buffer.\n");
+    fprintf(stream, "# TYPE alarm_circular_buffer_occupancy gauge\n");
+    for (int i = 0; i < number_of_consumers; i++) {
+        fprintf(stream, "alarm_circular_buffer_occupancy{consumer=\"%d\"} %zu\n",
+                consumers[i].thread_id,
+                ring_buffer_occupancy(&consumers[i].circular_buffer));
+    }
 
-    DEBUG_PRINT_START_MESSAGE();
+    fprintf(stream, "# HELP alarm_circular_buffer_capacity Alarm requests each circular buffer can hold.\n");
+    fprintf(stream, "# TYPE alarm_circular_buffer_capacity gauge\n");
+    fprintf(stream, "alarm_circular_buffer_capacity %zu\n", circular_buffer_capacity);
+
+    fprintf(stream, "# HELP alarm_periodic_display_threads Periodic display threads created so far.\n");
+    fprintf(stream, "# TYPE alarm_periodic_display_threads gauge\n");
+    fprintf(stream, "alarm_periodic_display_threads %d\n",
+            atomic_load_explicit(&number_of_periodic_display_threads, memory_order_relaxed));
+
+    fprintf(stream, "# HELP alarm_live_periodic_displays Periodic displays that are still running.\n");
+    fprintf(stream, "# TYPE alarm_live_periodic_displays gauge\n");
+    fprintf(stream, "alarm_live_periodic_displays %d\n",
+            atomic_load_explicit(&live_periodic_displays, memory_order_relaxed));
+
+    if (!timing_wheel_mode) {
+        fprintf(stream, "# HELP alarm_display_periods_total Periods of periodic displays run by the display workers.\n");
+        fprintf(stream, "# TYPE alarm_display_periods_total counter\n");
+        fprintf(stream, "alarm_display_periods_total %lu\n",
+                atomic_load_explicit(&display_worker_pool.tasks_run, memory_order_relaxed));
+
+        fprintf(stream, "# HELP alarm_display_periods_stolen_total Periods run by a display worker other than the one they were handed to.\n");
+        fprintf(stream, "# TYPE alarm_display_periods_stolen_total counter\n");
+        fprintf(stream, "alarm_display_periods_stolen_total %lu\n",
+                atomic_load_explicit(&display_worker_pool.tasks_stolen, memory_order_relaxed));
+    }
+
+    fprintf(stream, "# HELP alarm_requests_total Requests accepted into the alarm list.\n");
+    fprintf(stream, "# TYPE alarm_requests_total counter\n");
+    for (int i = 0; i < 3; i++) {
+        fprintf(stream, "alarm_requests_total{type=\"%s\"} %lu\n",
+                request_types[i],
+                atomic_load_explicit(&accepted_requests[i], memory_order_relaxed));
+    }
+
+    fprintf(stream, "# HELP alarm_rejected_commands_total Commands that were not accepted.\n");
+    fprintf(stream, "# TYPE alarm_rejected_commands_total counter\n");
+    fprintf(stream, "alarm_rejected_commands_total{reason=\"bad_command\"} %lu\n",
+            atomic_load_explicit(&bad_commands, memory_order_relaxed));
+    fprintf(stream, "alarm_rejected_commands_total{reason=\"invalid_alarm_id\"} %lu\n",
+            atomic_load_explicit(&rejected_requests, memory_order_relaxed));
+
+    fprintf(stream, "# HELP alarm_display_firings_total Alarm messages printed by periodic displays.\n");
+    fprintf(stream, "# TYPE alarm_display_firings_total counter\n");
+    fprintf(stream, "alarm_display_firings_total %lu\n",
+            atomic_load_explicit(&display_firings, memory_order_relaxed));
+
+    fprintf(stream, "# HELP alarm_stage_latency_seconds Time taken by each stage of the pipeline (see Stats).\n");
+    fprintf(stream, "# TYPE alarm_stage_latency_seconds summary\n");
+    for (size_t i = 0; i < sizeof(stage_histograms) / sizeof(stage_histograms[0]); i++) {
+        statistics = latency_histogram_statistics(stage_histograms[i]);
+        values[0] = statistics.p50;
+        values[1] = statistics.p99;
+        values[2] = statistics.p999;
+        for (int j = 0; j < 3; j++) {
+            fprintf(stream, "alarm_stage_latency_seconds{stage=\"%s\",quantile=\"%g\"} %.9f\n",
+                    stage_histograms[i]->name, quantiles[j], values[j] / 1e9);
+        }
+        fprintf(stream, "alarm_stage_latency_seconds_sum{stage=\"%s\"} %.9f\n",
+                stage_histograms[i]->name, statistics.sum / 1e9);
+        fprintf(stream, "alarm_stage_latency_seconds_count{stage=\"%s\"} %lu\n",
+                stage_histograms[i]->name, statistics.count);
+    }
+}
+
+/**
+ * Statistics thread. Every time the process gets SIGUSR1, it prints the
+ * statistics. The argument is the set of signals to wait for, which must be
+ * blocked in every thread.
+ */
+void *statistics_thread_routine(void *arg) {
+    sigset_t *signals = arg;
+    int signal;
+
+    while (1) {
+        if (sigwait(signals, &signal) == 0) {
+            print_statistics();
+        }
+    }
+
+    return NULL;
+}
+
+/*******************************************************************************
+ *                                 MAIN THREAD                                 *
+ ******************************************************************************/
+
+/**
+ * Requests that have been parsed but not handled yet, in the order they were
+ * read, with the client of the command server that sent each one (NULL for
+ * standard input).
+ */
+typedef struct request_batch_t {
+    alarm_request_t *alarm_requests[MAXIMUM_BATCH_SIZE];
+    command_client_t *clients[MAXIMUM_BATCH_SIZE];
+    int size;
+} request_batch_t;
+
+/**
+ * Handles the requests in a batch and empties it.
+ */
+void handle_batch(request_batch_t *batch) {
+    if (batch->size > 0) {
+        handle_request_batch_thread_safe(batch->alarm_requests, batch->clients, batch->size);
+        batch->size = 0;
+    }
+}
+
+/**
+ * Parses one line of batch input (from standard input, or from a client of
+ * the command server) and adds the request to the batch. If the batch is
+ * full, it is handled and emptied. If the line is the Stats command, the stage
+ * statistics are printed instead, and if it is the Checkpoint command, a
+ * checkpoint is written.
+ */
+void add_line_to_batch(char line[], command_client_t *client, request_batch_t *batch) {
+    alarm_request_t *alarm_request;
+    uint64_t start;
 
     /*
-     * Initialize the circular buffer empty semaphore to the size of the buffer.
+     * The requests before the Stats command are handled first, so that it
+     * counts them in the main thread's stages.
      */
-    sem_init(&circular_buffer_empty_sem, 0, CIRCULAR_BUFFER_SIZE);
+    if (is_stats_command(line)) {
+        handle_batch(batch);
+        print_stage_statistics(client);
+        return;
+    }
 
     /*
-     * Initialize the circular buffer full semaphore to 0.
+     * Likewise, the checkpoint includes the requests before it.
      */
-    sem_init(&circular_buffer_full_sem, 0, 0);
-
-    sem_init(&alarm_display_list_sem, 0, 1);
+    if (is_checkpoint_command(line)) {
+        handle_batch(batch);
+        write_checkpoint(client);
+        return;
+    }
 
-    sem_init(&reader_count_sem, 0, 1);
+    start = latency_clock_now();
+    alarm_request = parse_request(line);
+    latency_histogram_record_since(&parse_histogram, start);
 
     /*
-     * A.3.2. Create alarm thread.
+     * A.3.2. If alarm_request is NULL, then the request was invalid.
      */
-    pthread_create(&alarm_thread, NULL, alarm_thread_routine, NULL);
+    if (alarm_request == NULL) {
+        /*
+         * The requests before it are handled first, so that the responses
+         * come out in the order of the commands.
+         */
+        handle_batch(batch);
+        atomic_fetch_add_explicit(&bad_commands, 1, memory_order_relaxed);
+        print_response(client, "Bad command\n");
+        return;
+    }
 
-    DEBUG_MESSAGE("Alarm thread created");
+    batch->alarm_requests[batch->size] = alarm_request;
+    batch->clients[batch->size] = client;
+    batch->size++;
 
-    /*
-     * A.3.2. Create consumer thread.
-     */
-    pthread_create(&consumer_thread, NULL, consumer_thread_routine, NULL);
+    if (batch->size == MAXIMUM_BATCH_SIZE) {
+        handle_batch(batch);
+    }
+}
+
+/**
+ * Reads requests from standard input without prompting until the end of the
+ * input is reached.
+ *
+ * Input is read in large blocks and split into lines. All the requests in a
+ * block are handled as one batch, so the alarm list mutex is locked and the
+ * alarm thread is woken up once per block instead of once per request. The
+ * requests in a batch are handled in the order they were read.
+ */
+void read_batch_input() {
+    size_t input_capacity = BATCH_INPUT_BUFFER_SIZE; // Grows while a line is
+                                                     // longer than it, up to
+                                                     // COMMAND_MAXIMUM_LINE_SIZE.
+
+    char *input = malloc(input_capacity + 1);       // Buffer for blocks of
+                                                    // input (+1 so that a
+                                                    // full buffer can be
+                                                    // terminated).
+
+    static request_batch_t batch;                   // Requests that have been
+                                                    // parsed but not handled.
+
+    size_t input_size = 0;                          // Number of bytes in the
+                                                    // input buffer.
+
+    bool discarding = false;                        // The line being read is
+                                                    // too long, so it is
+                                                    // dropped up to its
+                                                    // newline.
+
+    ssize_t bytes_read;
+    char *line;
+    char *newline;
+
+    if (input == NULL) {
+        errno_abort("Malloc failed");
+    }
+
+    while (1) {
+        bytes_read = read(
+            STDIN_FILENO,
+            input + input_size,
+            input_capacity - input_size
+        );
+
+        if (bytes_read < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            errno_abort("Read failed");
+        }
+
+        /*
+         * End of input. The last line may not end with a newline.
+         */
+        if (bytes_read == 0) {
+            if (input_size > 0 && !discarding) {
+                input[input_size] = 0;
+                add_line_to_batch(input, NULL, &batch);
+            }
+            break;
+        }
+
+        input_size += bytes_read;
+        line = input;
+
+        if (discarding) {
+            newline = memchr(input, '\n', input_size);
+            if (newline == NULL) {
+                input_size = 0;
+                continue;
+            }
+            discarding = false;
+            line = newline + 1;
+        }
+
+        /*
+         * Split the block into lines and parse each of them.
+         */
+        while ((newline = memchr(line, '\n', input + input_size - line)) != NULL) {
+            *newline = 0;
+            add_line_to_batch(line, NULL, &batch);
+            line = newline + 1;
+        }
+
+        /*
+         * Move the incomplete last line to the start of the buffer.
+         */
+        input_size = input + input_size - line;
+        memmove(input, line, input_size);
+
+        /*
+         * If the line fills the whole buffer, make the buffer larger, unless
+         * the line is already too long. No part of a line that is too long
+         * is parsed, because the parser would take any part of it (even the
+         * middle of a message) as a command of its own.
+         */
+        if (input_size == input_capacity) {
+            if (input_capacity < COMMAND_MAXIMUM_LINE_SIZE) {
+                input_capacity *= 2;
+                if (input_capacity > COMMAND_MAXIMUM_LINE_SIZE) {
+                    input_capacity = COMMAND_MAXIMUM_LINE_SIZE;
+                }
+                input = realloc(input, input_capacity + 1);
+                if (input == NULL) {
+                    errno_abort("Realloc failed");
+                }
+            } else {
+                handle_batch(&batch);
+                atomic_fetch_add_explicit(&bad_commands, 1, memory_order_relaxed);
+                log_printf("Line too long\n");
+                discarding = true;
+                input_size = 0;
+            }
+        }
+
+        /*
+         * Handle the requests from this block as one batch.
+         */
+        handle_batch(&batch);
+    }
+
+    handle_batch(&batch);
+    free(input);
+}
+
+/**
+ * Reads requests from standard input one line at a time, prompting the user
+ * for each of them.
+ */
+void read_interactive_input() {
+    char *input = NULL;                 // Buffer to store user input, which
+    size_t input_capacity = 0;          // getline makes as large as each line.
+    ssize_t input_length;
+
+    alarm_request_t *alarm_request;     // Most recent alarm request (data
+                                        // structure representing the user's
+                                        // request).
 
-    DEBUG_MESSAGE("Consumer thread created");
+    uint64_t start;
 
     while (1) {
-        printf("Alarm > ");
+        log_printf("Alarm > ");
 
         /*
          * A.3.2. Get a request from user input. If NULL, then the user did not
          * enter a command.
          */
-        if (fgets(input, USER_INPUT_BUFFER_SIZE, stdin) == NULL) {
-            printf("Bad command\n");
+        input_length = getline(&input, &input_capacity, stdin);
+        if (input_length < 0) {
+            atomic_fetch_add_explicit(&bad_commands, 1, memory_order_relaxed);
+            log_printf("Bad command\n");
             continue;
         }
 
         // Replace newline with null terminating character
-        input[strcspn(input, "\n")] = 0;
+        if (input_length > 0 && input[input_length - 1] == '\n') {
+            input[input_length - 1] = 0;
+        }
+
+        if (is_stats_command(input)) {
+            print_stage_statistics(NULL);
+            continue;
+        }
+
+        if (is_checkpoint_command(input)) {
+            write_checkpoint(NULL);
+            continue;
+        }
 
         /*
          * A.3.2. Parse user's request.
          */
+        start = latency_clock_now();
         alarm_request = parse_request(input);
+        latency_histogram_record_since(&parse_histogram, start);
 
         /*
          * A.3.2. If alarm_request is NULL, then the request was invalid.
          */
         if (alarm_request == NULL) {
-            printf("Bad command\n");
+            atomic_fetch_add_explicit(&bad_commands, 1, memory_order_relaxed);
+            log_printf("Bad command\n");
             continue;
         } else {
             /*
@@ -1458,6 +2462,576 @@ int main() {
             handle_request_thread_safe(alarm_request);
         }
 
-        DEBUG_PRINT_ALARM_LIST(&alarm_list_header);
+        DEBUG_PRINT_ALARM_LIST(&alarm_list.header);
+    }
+}
+
+/**
+ * Loads the alarms in the checkpoint at the given path, if there is one, and
+ * returns how many there were. They go into the alarm list, the time value
+ * index and the alarm display list, and a periodic display is created for
+ * each time value, as if every alarm had been started through the pipeline.
+ *
+ * This does not go through the pipeline, though: a checkpoint has one alarm
+ * per alarm ID, sorted by time value, so the alarm list and each shard of the
+ * alarm display list are built in one pass (see bulk_insert_to_alarm_list),
+ * and each distinct message is interned once. It must be called before the
+ * alarm thread and the consumer threads are created, and the consumers must
+ * publish their snapshots afterwards.
+ */
+size_t load_checkpoint(const char *path) {
+    checkpoint_t checkpoint;
+    const checkpoint_record_t *record;
+    message_t **messages;
+    alarm_request_t **alarm_requests;
+    alarm_request_t **display_requests;     // Grouped by consumer.
+    size_t shard_starts[MAXIMUM_NUMBER_OF_CONSUMERS + 1];
+    size_t shard_ends[MAXIMUM_NUMBER_OF_CONSUMERS];
+    alarm_request_t *alarm_request;
+    time_value_entry_t *time_value_entry;
+    alarm_time_group_t *group;
+    size_t number_of_alarms;
+    size_t shard;
+    time_t now = time(NULL);
+
+    if (!checkpoint_map(&checkpoint, path)) {
+        return 0;
+    }
+    number_of_alarms = checkpoint.number_of_alarms;
+
+    messages = malloc((checkpoint.number_of_messages > 0 ? checkpoint.number_of_messages : 1)
+                      * sizeof(message_t *));
+    alarm_requests = malloc((number_of_alarms > 0 ? number_of_alarms : 1) * sizeof(alarm_request_t *));
+    display_requests = malloc((number_of_alarms > 0 ? number_of_alarms : 1) * sizeof(alarm_request_t *));
+    if (messages == NULL || alarm_requests == NULL || display_requests == NULL) {
+        errno_abort("Malloc failed");
+    }
+
+    for (size_t i = 0; i < checkpoint.number_of_messages; i++) {
+        messages[i] = message_intern(
+            checkpoint.text + checkpoint.messages[i].offset,
+            checkpoint.messages[i].length
+        );
+    }
+
+    /*
+     * Each consumer's copies go in a range of their own, in the same order
+     * (so they are sorted by time value too).
+     */
+    memset(shard_starts, 0, sizeof(shard_starts));
+    for (size_t i = 0; i < number_of_alarms; i++) {
+        shard_starts[(unsigned int) checkpoint.records[i].alarm_id % number_of_consumers + 1]++;
+    }
+    for (int i = 0; i < number_of_consumers; i++) {
+        shard_starts[i + 1] += shard_starts[i];
+        shard_ends[i] = shard_starts[i];
+    }
+
+    for (size_t i = 0; i < number_of_alarms; i++) {
+        record = &checkpoint.records[i];
+
+        alarm_request = allocate_alarm_request();
+        alarm_request->alarm_id = record->alarm_id;
+        alarm_request->time = record->time;
+        alarm_request->type = record->type;
+        atomic_init(&alarm_request->change_status, false);
+        alarm_request->sequence_number = i + 1;
+        alarm_request->message = message_retain(messages[record->message]);
+        alarm_request->creation_time = now;
+        alarm_request->queue_next = NULL;
+        alarm_request->bulk_next = NULL;
+        alarm_requests[i] = alarm_request;
+
+        shard = (unsigned int) record->alarm_id % number_of_consumers;
+        display_requests[shard_ends[shard]++] = copy_alarm_request(alarm_request);
+
+        add_alarm_to_time_value(&time_value_index, alarm_request->time);
+    }
+
+    if (!bulk_insert_to_alarm_list(&alarm_list, alarm_requests, number_of_alarms)) {
+        fprintf(stderr, "%s is not a valid checkpoint: an alarm ID appears twice\n", path);
+        exit(1);
+    }
+    for (int i = 0; i < number_of_consumers; i++) {
+        bulk_insert_to_alarm_list(
+            &consumers[i].display_list,
+            display_requests + shard_starts[i],
+            shard_ends[i] - shard_starts[i]
+        );
+    }
+
+    last_inserted_sequence_number = number_of_alarms;
+    atomic_store_explicit(&alarm_list_length, alarm_list.length, memory_order_relaxed);
+
+    for (size_t i = 0; i < checkpoint.number_of_messages; i++) {
+        message_release(messages[i]);
+    }
+    free(messages);
+    free(alarm_requests);
+    free(display_requests);
+    checkpoint_unmap(&checkpoint);
+
+    /*
+     * One periodic display per time value, created for the first alarm with
+     * that time value (the one after the last alarm of the group before).
+     */
+    for (group = alarm_list.time_group_header.next; group != NULL; group = group->next) {
+        alarm_request = group->prev == &alarm_list.time_group_header
+            ? alarm_list.header.next
+            : group->prev->last->next;
+        time_value_entry = find_time_value(&time_value_index, group->time);
+        time_value_entry->thread = create_periodic_display_thread(alarm_request);
+    }
+    start_new_periodic_displays();
+
+    return number_of_alarms;
+}
+
+/**
+ * Adds a request replayed from the write-ahead log to the batch of replayed
+ * requests (the argument).
+ */
+void replay_alarm_request(alarm_request_t *alarm_request, void *arg) {
+    request_batch_t *batch = arg;
+
+    batch->alarm_requests[batch->size] = alarm_request;
+    batch->clients[batch->size] = NULL;
+    batch->size++;
+
+    if (batch->size == MAXIMUM_BATCH_SIZE) {
+        handle_batch(batch);
+    }
+}
+
+/**
+ * Requests from the clients of the command server that have been parsed but
+ * not handled yet.
+ */
+request_batch_t client_batch;
+
+/**
+ * Adds a line from a client of the command server to the batch.
+ */
+void handle_client_line(command_client_t *client, char line[]) {
+    add_line_to_batch(line, client, &client_batch);
+}
+
+/**
+ * Handles the requests that the clients of the command server sent in one
+ * round as one batch, so the alarm list mutex is locked and the alarm thread
+ * is woken up once per round however many clients sent requests.
+ */
+void handle_client_round(void) {
+    handle_batch(&client_batch);
+}
+
+/**
+ * Prints how to run the program.
+ */
+void print_usage(const char *program_name) {
+    fprintf(
+        stderr,
+        "Usage: %s [-b | -i] [-w | -d workers] [-c capacity] [-n consumers]\n"
+        "          [-l block | drop | spill] [-s spill_file] [-m port]\n"
+        "          [-u socket_path] [-t port] [-W log_file\n"
+        "          [--wal-sync-interval=milliseconds] [--wal-sync-count=count]]\n"
+        "          [-C checkpoint_file]\n"
+        "  -b, --batch         read commands in batches without prompting\n"
+        "                      (default when standard input is not a terminal)\n"
+        "  -i, --interactive   prompt for one command at a time\n"
+        "                      (default when standard input is a terminal)\n"
+        "  -w, --timing-wheel  run every periodic display on the timing wheel\n"
+        "                      thread instead of on the display workers\n"
+        "  -d, --display-workers=workers\n"
+        "                      number of threads that run the periodic displays\n"
+        "                      (default one per processor, at most %d)\n"
+        "  -c, --buffer-capacity=capacity\n"
+        "                      number of alarm requests the circular buffer\n"
+        "                      can hold (default %d)\n"
+        "  -n, --consumers=consumers\n"
+        "                      number of consumer threads, each owning the\n"
+        "                      alarm IDs that are equal to its number modulo\n"
+        "                      the number of consumers (default 1, at most %d)\n"
+        "  -l, --log-policy=block|drop|spill\n"
+        "                      what a thread does with output when the output\n"
+        "                      writer has fallen behind: wait for it (default),\n"
+        "                      drop the output and count it, or write it to\n"
+        "                      the spill file instead\n"
+        "  -s, --spill-file=spill_file\n"
+        "                      file for the spill policy (default %s)\n"
+        "  -m, --metrics-port=port\n"
+        "                      serve Prometheus metrics at\n"
+        "                      http://127.0.0.1:port/metrics\n"
+        "  -u, --unix-socket=socket_path\n"
+        "                      take commands from clients that connect to a\n"
+        "                      Unix domain socket instead of standard input\n"
+        "  -t, --tcp-port=port take commands from clients that connect to\n"
+        "                      127.0.0.1:port instead of standard input\n"
+        "  -W, --write-ahead-log=log_file\n"
+        "                      append every accepted request to log_file, and\n"
+        "                      replay the requests already in it at startup\n"
+        "  --wal-sync-interval=milliseconds\n"
+        "                      longest time a request waits in the log before\n"
+        "                      it is synced to disk (default 0: as soon as the\n"
+        "                      previous sync is done)\n"
+        "  --wal-sync-count=count\n"
+        "                      sync as soon as this many requests are waiting\n"
+        "                      (default %d)\n"
+        "  -C, --checkpoint=checkpoint_file\n"
+        "                      load the alarms in checkpoint_file at startup,\n"
+        "                      and write them to it on the Checkpoint command\n",
+        program_name,
+        MAXIMUM_NUMBER_OF_DISPLAY_WORKERS,
+        CIRCULAR_BUFFER_SIZE,
+        MAXIMUM_NUMBER_OF_CONSUMERS,
+        DEFAULT_SPILL_FILE,
+        DEFAULT_WAL_SYNC_COUNT
+    );
+}
+
+/**
+ * A.3.2. Main thread.
+ *
+ * The main thread is responsible for creating one alarm thread and the consumer
+ * threads, receiving and parsing user input into alarm requests, and adding
+ * alarm requests to the alarm list.
+ */
+int main(int argc, char *argv[]) {
+    pthread_t alarm_thread;             // Alarm thread.
+
+    pthread_t statistics_thread;        // Statistics thread.
+
+    static sigset_t statistics_signals; // Signals that the statistics thread
+                                        // waits for.
+
+    bool batch_mode = !isatty(STDIN_FILENO); // Whether to read input in
+                                             // batches.
+
+    static const struct option options[] = {
+        {"batch", no_argument, NULL, 'b'},
+        {"interactive", no_argument, NULL, 'i'},
+        {"timing-wheel", no_argument, NULL, 'w'},
+        {"display-workers", required_argument, NULL, 'd'},
+        {"buffer-capacity", required_argument, NULL, 'c'},
+        {"consumers", required_argument, NULL, 'n'},
+        {"log-policy", required_argument, NULL, 'l'},
+        {"spill-file", required_argument, NULL, 's'},
+        {"metrics-port", required_argument, NULL, 'm'},
+        {"unix-socket", required_argument, NULL, 'u'},
+        {"tcp-port", required_argument, NULL, 't'},
+        {"write-ahead-log", required_argument, NULL, 'W'},
+        {"wal-sync-interval", required_argument, NULL, WAL_SYNC_INTERVAL_OPTION},
+        {"wal-sync-count", required_argument, NULL, WAL_SYNC_COUNT_OPTION},
+        {"checkpoint", required_argument, NULL, 'C'},
+        {NULL, 0, NULL, 0}
+    };
+    int option;
+    char *end;
+    long capacity;
+    long consumer_count;
+    long worker_count;
+    log_overflow_policy log_policy = Log_Block;
+    const char *spill_file = DEFAULT_SPILL_FILE;
+    long metrics_port = -1;             // No metrics server unless set.
+    const char *unix_socket_path = NULL; // No command server unless either
+    long tcp_port = -1;                  // of these is set.
+    const char *wal_path = NULL;        // No write-ahead log unless set.
+    long wal_sync_interval = 0;
+    long wal_sync_count = DEFAULT_WAL_SYNC_COUNT;
+    static request_batch_t replay_batch;
+    unsigned long replayed;
+    size_t loaded;
+    uint64_t load_start;
+
+    /*
+     * Parse command line options.
+     */
+    while ((option = getopt_long(argc, argv, "biwd:c:n:l:s:m:u:t:W:C:", options, NULL)) != -1) {
+        switch (option) {
+            case 'b':
+                batch_mode = true;
+                break;
+            case 'i':
+                batch_mode = false;
+                break;
+            case 'w':
+                timing_wheel_mode = true;
+                break;
+            case 'd':
+                worker_count = strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || worker_count < 1
+                    || worker_count > MAXIMUM_NUMBER_OF_DISPLAY_WORKERS) {
+                    fprintf(stderr, "Invalid number of display workers: %s\n", optarg);
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                number_of_display_workers = worker_count;
+                break;
+            case 'c':
+                capacity = strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || capacity < 1) {
+                    fprintf(stderr, "Invalid buffer capacity: %s\n", optarg);
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                circular_buffer_capacity = capacity;
+                break;
+            case 'n':
+                consumer_count = strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || consumer_count < 1
+                    || consumer_count > MAXIMUM_NUMBER_OF_CONSUMERS) {
+                    fprintf(stderr, "Invalid number of consumers: %s\n", optarg);
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                number_of_consumers = consumer_count;
+                break;
+            case 'l':
+                if (strcmp(optarg, "block") == 0) {
+                    log_policy = Log_Block;
+                } else if (strcmp(optarg, "drop") == 0) {
+                    log_policy = Log_Drop;
+                } else if (strcmp(optarg, "spill") == 0) {
+                    log_policy = Log_Spill;
+                } else {
+                    fprintf(stderr, "Invalid log policy: %s\n", optarg);
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 's':
+                spill_file = optarg;
+                break;
+            case 'm':
+                metrics_port = strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || metrics_port < 0
+                    || metrics_port > 65535) {
+                    fprintf(stderr, "Invalid metrics port: %s\n", optarg);
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'u':
+                unix_socket_path = optarg;
+                break;
+            case 't':
+                tcp_port = strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || tcp_port < 0 || tcp_port > 65535) {
+                    fprintf(stderr, "Invalid TCP port: %s\n", optarg);
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'W':
+                wal_path = optarg;
+                break;
+            case 'C':
+                checkpoint_path = optarg;
+                break;
+            case WAL_SYNC_INTERVAL_OPTION:
+                wal_sync_interval = strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || wal_sync_interval < 0
+                    || wal_sync_interval > INT_MAX) {
+                    fprintf(stderr, "Invalid sync interval: %s\n", optarg);
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case WAL_SYNC_COUNT_OPTION:
+                wal_sync_count = strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || wal_sync_count < 1) {
+                    fprintf(stderr, "Invalid sync count: %s\n", optarg);
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                break;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+
+    /*
+     * Block SIGUSR1 before any other threads are created (so they inherit the
+     * mask), so that only the statistics thread receives it.
+     */
+    sigemptyset(&statistics_signals);
+    sigaddset(&statistics_signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &statistics_signals, NULL);
+
+    /*
+     * Start the log writer thread, which writes all the output, so that no
+     * thread waits for standard output while it holds a lock.
+     */
+    log_writer_start(STDOUT_FILENO, log_policy, spill_file);
+
+    DEBUG_PRINT_START_MESSAGE();
+
+    /*
+     * Initialize the object pools.
+     */
+    alarm_request_pool_init();
+    object_pool_init(
+        &periodic_display_thread_pool,
+        "periodic_display_thread_t",
+        sizeof(periodic_display_thread_t)
+    );
+    object_pool_init(
+        &periodic_display_pool,
+        "periodic_display_t",
+        sizeof(periodic_display_t)
+    );
+
+    /*
+     * Initialize the alarm list.
+     */
+    alarm_list_init(&alarm_list);
+
+    /*
+     * Initialize the consumers: each has a circular buffer with the capacity
+     * from the command line, and a shard of the alarm display list. The
+     * circular buffers' positions are aligned to cache lines, so the consumers
+     * are too.
+     */
+    consumers = aligned_alloc(
+        RING_BUFFER_CACHE_LINE_SIZE,
+        number_of_consumers * sizeof(consumer_t)
+    );
+    if (consumers == NULL) {
+        errno_abort("Aligned_alloc failed");
+    }
+    for (int i = 0; i < number_of_consumers; i++) {
+        ring_buffer_init(&consumers[i].circular_buffer, circular_buffer_capacity);
+        alarm_list_init(&consumers[i].display_list);
+        consumers[i].display_list.free_request = remove_display_alarm_request;
+        atomic_init(&consumers[i].snapshot, NULL);
+        atomic_init(&consumers[i].display_list_length, 0);
+        consumers[i].last_bucket_version = 0;
+        consumers[i].newest_sequence_number = 0;
+        consumers[i].thread_id = CONSUMER_THREAD_ID + i;
+    }
+
+    /*
+     * Initialize the time value index.
+     */
+    time_value_index_init(&time_value_index);
+
+    /*
+     * Start the display timing wheel, which decides when the periods of the
+     * periodic displays are due, and the display worker pool, which runs
+     * them (unless in timing wheel mode). These are the only threads that
+     * periodic displays ever use, however many there are.
+     */
+    timing_wheel_init(&display_timing_wheel, TIMING_WHEEL_TICK_MILLISECONDS);
+    timing_wheel_start(&display_timing_wheel);
+    if (!timing_wheel_mode) {
+        worker_pool_start(
+            &display_worker_pool,
+            number_of_display_workers > 0
+                ? number_of_display_workers
+                : worker_pool_default_size()
+        );
+    }
+
+    /*
+     * Load the checkpoint, if there is one, and publish the first snapshot of
+     * every shard of the alarm display list (with the loaded alarms in it).
+     */
+    if (checkpoint_path != NULL) {
+        load_start = latency_clock_now();
+        loaded = load_checkpoint(checkpoint_path);
+        fprintf(stderr, "Loaded %zu alarms from %s in %.3f ms\n",
+                loaded, checkpoint_path, (latency_clock_now() - load_start) / 1e6);
+    }
+    for (int i = 0; i < number_of_consumers; i++) {
+        publish_display_snapshot(&consumers[i]);
+    }
+
+    /*
+     * A.3.2. Create alarm thread.
+     */
+    pthread_create(&alarm_thread, NULL, alarm_thread_routine, NULL);
+
+    DEBUG_MESSAGE("Alarm thread created");
+
+    /*
+     * A.3.2. Create consumer threads.
+     */
+    for (int i = 0; i < number_of_consumers; i++) {
+        pthread_create(
+            &consumers[i].thread,
+            NULL,
+            consumer_thread_routine,
+            &consumers[i]
+        );
+    }
+
+    DEBUG_MESSAGE("Consumer threads created");
+
+    /*
+     * Create statistics thread.
+     */
+    pthread_create(
+        &statistics_thread,
+        NULL,
+        statistics_thread_routine,
+        &statistics_signals
+    );
+
+    /*
+     * Replay the write-ahead log, if there is one, through the same path as
+     * new requests, which rebuilds the alarm list, the alarm display list
+     * and the periodic displays. The replayed requests are not logged again;
+     * logging starts after them.
+     */
+    if (wal_path != NULL) {
+        replayed = wal_open(
+            &write_ahead_log,
+            wal_path,
+            (int) wal_sync_interval,
+            wal_sync_count,
+            replay_alarm_request,
+            &replay_batch
+        );
+        handle_batch(&replay_batch);
+        write_ahead_log_enabled = true;
+        fprintf(stderr, "Replayed %lu requests from %s\n", replayed, wal_path);
+    }
+
+    /*
+     * Start the metrics server, if a port was given.
+     */
+    if (metrics_port >= 0) {
+        fprintf(stderr, "Serving metrics at http://127.0.0.1:%d/metrics\n",
+                metrics_server_start((int) metrics_port, write_metrics));
+    }
+
+    /*
+     * In server mode, the main thread takes commands from the clients of the
+     * command server instead of from standard input.
+     */
+    if (unix_socket_path != NULL || tcp_port >= 0) {
+        tcp_port = command_server_listen(unix_socket_path, (int) tcp_port);
+        if (unix_socket_path != NULL) {
+            fprintf(stderr, "Taking commands on %s\n", unix_socket_path);
+        }
+        if (tcp_port >= 0) {
+            fprintf(stderr, "Taking commands on 127.0.0.1:%ld\n", tcp_port);
+        }
+        command_server_run(handle_client_line, handle_client_round);
+    }
+
+    if (batch_mode) {
+        read_batch_input();
+
+        /*
+         * All the input has been read, but the alarms keep being displayed
+         * until the program is stopped, so only the main thread exits.
+         */
+        pthread_exit(NULL);
     }
+
+    read_interactive_input();
+
+    return 0;
 }
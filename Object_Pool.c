@@ -0,0 +1,252 @@
+#include <pthread.h>
+#include <stdalign.h>
+#include "errors.h"
+#include "Object_Pool.h"
+
+#define SLAB_SIZE 65536
+
+/**
+ * The number of objects moved between a thread's cache and the pool's shared
+ * free list at once. A thread's cache holds at most twice this many objects.
+ */
+#define CACHE_BATCH_SIZE 32
+
+/**
+ * A free object. The first bytes of a free object link it to the next one.
+ */
+typedef struct free_object_t {
+    struct free_object_t *next;
+} free_object_t;
+
+/**
+ * A thread's cache of free objects for one pool.
+ */
+typedef struct object_cache_t {
+    object_pool_t *pool;
+    free_object_t *free_list;
+    size_t length;
+} object_cache_t;
+
+/*******************************************************************************
+ *                           HELPER FUNCTIONS                                  *
+ ******************************************************************************/
+
+/**
+ * Allocates a new slab and adds its objects to the pool's shared free list.
+ *
+ * Note that the pool's mutex must be locked by the caller of this method.
+ */
+static void add_slab(object_pool_t *pool) {
+    char *slab = malloc(pool->objects_per_slab * pool->object_size);
+    free_object_t *object;
+
+    if (slab == NULL) {
+        errno_abort("Malloc failed");
+    }
+
+    for (size_t i = pool->objects_per_slab; i > 0; i--) {
+        object = (free_object_t *) (slab + (i - 1) * pool->object_size);
+        object->next = pool->free_list;
+        pool->free_list = object;
+    }
+
+    pool->number_of_slabs++;
+}
+
+/**
+ * Moves up to a batch of objects from the pool's shared free list to the
+ * cache, allocating a new slab if the shared free list is empty.
+ */
+static void refill_cache(object_cache_t *cache) {
+    object_pool_t *pool = cache->pool;
+    free_object_t *object;
+
+    pthread_mutex_lock(&pool->mutex);
+
+    if (pool->free_list == NULL) {
+        add_slab(pool);
+    }
+
+    while (cache->length < CACHE_BATCH_SIZE && pool->free_list != NULL) {
+        object = pool->free_list;
+        pool->free_list = object->next;
+        object->next = cache->free_list;
+        cache->free_list = object;
+        cache->length++;
+    }
+
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+/**
+ * Moves the given number of objects from the cache to the pool's shared free
+ * list.
+ */
+static void flush_cache(object_cache_t *cache, size_t number_of_objects) {
+    object_pool_t *pool = cache->pool;
+    free_object_t *first = cache->free_list;
+    free_object_t *last = first;
+
+    if (number_of_objects == 0) {
+        return;
+    }
+
+    /*
+     * Unlink the objects from the cache before locking the pool.
+     */
+    for (size_t i = 1; i < number_of_objects; i++) {
+        last = last->next;
+    }
+    cache->free_list = last->next;
+    cache->length -= number_of_objects;
+
+    pthread_mutex_lock(&pool->mutex);
+    last->next = pool->free_list;
+    pool->free_list = first;
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+/**
+ * Gives a thread's cache back to the pool when the thread exits.
+ */
+static void destroy_cache(void *arg) {
+    object_cache_t *cache = arg;
+
+    flush_cache(cache, cache->length);
+    free(cache);
+}
+
+/**
+ * Returns the calling thread's cache for the pool, creating it the first time.
+ */
+static object_cache_t *get_cache(object_pool_t *pool) {
+    object_cache_t *cache = pthread_getspecific(pool->cache_key);
+
+    if (cache == NULL) {
+        cache = malloc(sizeof(object_cache_t));
+        if (cache == NULL) {
+            errno_abort("Malloc failed");
+        }
+        cache->pool = pool;
+        cache->free_list = NULL;
+        cache->length = 0;
+        pthread_setspecific(pool->cache_key, cache);
+    }
+
+    return cache;
+}
+
+/*******************************************************************************
+ *                              PUBLIC FUNCTIONS                               *
+ ******************************************************************************/
+
+void object_pool_init(object_pool_t *pool, const char *name, size_t object_size) {
+    int status;
+
+    /*
+     * Every object must be big enough to link it into a free list, and
+     * aligned like memory from malloc.
+     */
+    if (object_size < sizeof(free_object_t)) {
+        object_size = sizeof(free_object_t);
+    }
+    object_size = (object_size + alignof(max_align_t) - 1)
+        & ~(alignof(max_align_t) - 1);
+
+    pool->name = name;
+    pool->object_size = object_size;
+    pool->objects_per_slab = object_size < SLAB_SIZE ? SLAB_SIZE / object_size : 1;
+    pool->free_list = NULL;
+    pool->number_of_slabs = 0;
+    atomic_init(&pool->live, 0);
+    atomic_init(&pool->high_water, 0);
+
+    pthread_mutex_init(&pool->mutex, NULL);
+    status = pthread_key_create(&pool->cache_key, destroy_cache);
+    if (status != 0) {
+        err_abort(status, "Create pool cache key");
+    }
+}
+
+void *object_pool_allocate(object_pool_t *pool) {
+    object_cache_t *cache = get_cache(pool);
+    free_object_t *object;
+    size_t live;
+    size_t high_water;
+
+    if (cache->free_list == NULL) {
+        refill_cache(cache);
+    }
+
+    object = cache->free_list;
+    cache->free_list = object->next;
+    cache->length--;
+
+    /*
+     * Update the statistics.
+     */
+    live = atomic_fetch_add_explicit(&pool->live, 1, memory_order_relaxed) + 1;
+    high_water = atomic_load_explicit(&pool->high_water, memory_order_relaxed);
+    while (live > high_water
+           && !atomic_compare_exchange_weak_explicit(
+                  &pool->high_water,
+                  &high_water,
+                  live,
+                  memory_order_relaxed,
+                  memory_order_relaxed)) {
+    }
+
+    return object;
+}
+
+void object_pool_free(object_pool_t *pool, void *object) {
+    object_cache_t *cache;
+    free_object_t *free_object = object;
+
+    if (object == NULL) {
+        return;
+    }
+
+    cache = get_cache(pool);
+    free_object->next = cache->free_list;
+    cache->free_list = free_object;
+    cache->length++;
+
+    if (cache->length >= 2 * CACHE_BATCH_SIZE) {
+        flush_cache(cache, CACHE_BATCH_SIZE);
+    }
+
+    atomic_fetch_sub_explicit(&pool->live, 1, memory_order_relaxed);
+}
+
+object_pool_statistics_t object_pool_statistics(object_pool_t *pool) {
+    object_pool_statistics_t statistics;
+    size_t capacity;
+
+    pthread_mutex_lock(&pool->mutex);
+    statistics.slabs = pool->number_of_slabs;
+    pthread_mutex_unlock(&pool->mutex);
+
+    capacity = statistics.slabs * pool->objects_per_slab;
+    statistics.live = atomic_load(&pool->live);
+    statistics.high_water = atomic_load(&pool->high_water);
+    statistics.free = capacity > statistics.live ? capacity - statistics.live : 0;
+
+    return statistics;
+}
+
+void object_pool_print_statistics(object_pool_t *pool, FILE *stream) {
+    object_pool_statistics_t statistics = object_pool_statistics(pool);
+
+    fprintf(
+        stream,
+        "Pool %s: Live = %zu Free = %zu High Water = %zu Slabs = %zu "
+        "(%zu bytes per object)\n",
+        pool->name,
+        statistics.live,
+        statistics.free,
+        statistics.high_water,
+        statistics.slabs,
+        pool->object_size
+    );
+}
@@ -0,0 +1,76 @@
+#ifndef OBJECT_POOL_H
+#define OBJECT_POOL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * A pool of objects of one size.
+ *
+ * Objects are carved out of large slabs, so allocating and freeing them does
+ * not go through malloc and free. Each thread keeps a small cache of free
+ * objects for each pool, so most allocations and frees do not lock anything.
+ * When a thread's cache is empty, it takes a batch of objects from the pool's
+ * shared free list (allocating a new slab if that is empty too), and when its
+ * cache gets too big it gives a batch back. A thread's cache is given back to
+ * the pool when the thread exits.
+ *
+ * An object may be freed by a different thread than the one that allocated it.
+ * Slabs are never given back to the system.
+ */
+typedef struct object_pool_t {
+    const char *name;
+    size_t object_size;
+    size_t objects_per_slab;
+
+    pthread_key_t cache_key;        // Each thread's cache for this pool.
+
+    pthread_mutex_t mutex;          // Protects the fields below.
+    void *free_list;                // Free objects not in any thread's cache.
+    size_t number_of_slabs;
+
+    atomic_size_t live;             // Objects allocated and not yet freed.
+    atomic_size_t high_water;       // Most objects that were ever live at once.
+} object_pool_t;
+
+/**
+ * A snapshot of the statistics of a pool.
+ */
+typedef struct object_pool_statistics_t {
+    size_t live;            // Objects allocated and not yet freed.
+    size_t free;            // Objects that can be allocated without a new
+                            // slab (including those in threads' caches).
+    size_t high_water;      // Most objects that were ever live at once.
+    size_t slabs;           // Slabs allocated from the system.
+} object_pool_statistics_t;
+
+/**
+ * Initializes an empty pool of objects of the given size. The name is only
+ * used when the statistics are printed.
+ */
+void object_pool_init(object_pool_t *pool, const char *name, size_t object_size);
+
+/**
+ * Allocates an object from the pool. The object is not initialized.
+ */
+void *object_pool_allocate(object_pool_t *pool);
+
+/**
+ * Gives an object back to the pool it was allocated from. Nothing happens if
+ * the object is NULL.
+ */
+void object_pool_free(object_pool_t *pool, void *object);
+
+/**
+ * Returns the current statistics of the pool.
+ */
+object_pool_statistics_t object_pool_statistics(object_pool_t *pool);
+
+/**
+ * Prints the current statistics of the pool on one line.
+ */
+void object_pool_print_statistics(object_pool_t *pool, FILE *stream);
+
+#endif
@@ -0,0 +1,187 @@
+#include <pthread.h>
+#include "errors.h"
+#include "Ring_Buffer.h"
+
+/**
+ * The number of times a thread checks the buffer again before it blocks.
+ * Items usually arrive (or leave) within a few microseconds, and blocking is
+ * much more expensive than checking.
+ */
+#define SPIN_LIMIT 128
+
+/*******************************************************************************
+ *                           HELPER FUNCTIONS                                  *
+ ******************************************************************************/
+
+/**
+ * Wakes up the other thread if it is blocked.
+ *
+ * The caller has just moved its own position (with a sequentially consistent
+ * store), and the waiting thread sets its flag before it checks the position
+ * again. So either this sees the flag, or the waiting thread sees the new
+ * position. Locking the mutex makes sure the waiting thread is either already
+ * waiting on the condition variable or has not checked the position yet.
+ */
+static void wake(ring_buffer_t *ring, atomic_bool *waiting, pthread_cond_t *cond) {
+    if (atomic_load(waiting)) {
+        pthread_mutex_lock(&ring->mutex);
+        pthread_cond_signal(cond);
+        pthread_mutex_unlock(&ring->mutex);
+    }
+}
+
+/**
+ * Waits until the other thread's position is no longer the given one, and
+ * returns its new position.
+ */
+static size_t wait_for_position_change(
+    ring_buffer_t *ring,
+    atomic_size_t *position,
+    size_t old_position,
+    atomic_bool *waiting,
+    pthread_cond_t *cond
+) {
+    size_t new_position;
+
+    for (int i = 0; i < SPIN_LIMIT; i++) {
+        new_position = atomic_load_explicit(position, memory_order_acquire);
+        if (new_position != old_position) {
+            return new_position;
+        }
+    }
+
+    pthread_mutex_lock(&ring->mutex);
+    atomic_store(waiting, true);
+    while ((new_position = atomic_load(position)) == old_position) {
+        pthread_cond_wait(cond, &ring->mutex);
+    }
+    atomic_store(waiting, false);
+    pthread_mutex_unlock(&ring->mutex);
+
+    return new_position;
+}
+
+/*******************************************************************************
+ *                              PUBLIC FUNCTIONS                               *
+ ******************************************************************************/
+
+void ring_buffer_init(ring_buffer_t *ring, size_t capacity) {
+    ring->slots = calloc(capacity, sizeof(void *));
+    if (ring->slots == NULL) {
+        errno_abort("Calloc failed");
+    }
+    ring->capacity = capacity;
+
+    atomic_init(&ring->write_position, 0);
+    atomic_init(&ring->read_position, 0);
+    ring->cached_read_position = 0;
+    ring->cached_write_position = 0;
+
+    atomic_init(&ring->producer_waiting, false);
+    atomic_init(&ring->consumer_waiting, false);
+    pthread_mutex_init(&ring->mutex, NULL);
+    pthread_cond_init(&ring->not_full, NULL);
+    pthread_cond_init(&ring->not_empty, NULL);
+}
+
+void ring_buffer_put(ring_buffer_t *ring, void *item) {
+    size_t write_position = atomic_load_explicit(
+        &ring->write_position,
+        memory_order_relaxed
+    );
+
+    /*
+     * If the buffer looks full, see how far the consumer has really got, and
+     * wait for it if the buffer is full.
+     */
+    if (write_position - ring->cached_read_position == ring->capacity) {
+        ring->cached_read_position = atomic_load_explicit(
+            &ring->read_position,
+            memory_order_acquire
+        );
+
+        if (write_position - ring->cached_read_position == ring->capacity) {
+            ring->cached_read_position = wait_for_position_change(
+                ring,
+                &ring->read_position,
+                ring->cached_read_position,
+                &ring->producer_waiting,
+                &ring->not_full
+            );
+        }
+    }
+
+    ring->slots[write_position % ring->capacity] = item;
+    atomic_store(&ring->write_position, write_position + 1);
+
+    wake(ring, &ring->consumer_waiting, &ring->not_empty);
+}
+
+/**
+ * Takes the item at the given read position out of the buffer. The buffer
+ * must not be empty.
+ */
+static void *take_item(ring_buffer_t *ring, size_t read_position, size_t *index) {
+    void *item;
+
+    item = ring->slots[read_position % ring->capacity];
+    ring->slots[read_position % ring->capacity] = NULL;
+    if (index != NULL) {
+        *index = read_position % ring->capacity;
+    }
+    atomic_store(&ring->read_position, read_position + 1);
+
+    wake(ring, &ring->producer_waiting, &ring->not_full);
+
+    return item;
+}
+
+void *ring_buffer_get(ring_buffer_t *ring, size_t *index) {
+    size_t read_position = atomic_load_explicit(
+        &ring->read_position,
+        memory_order_relaxed
+    );
+
+    /*
+     * If the buffer looks empty, see how far the producer has really got, and
+     * wait for it if the buffer is empty.
+     */
+    if (read_position == ring->cached_write_position) {
+        ring->cached_write_position = atomic_load_explicit(
+            &ring->write_position,
+            memory_order_acquire
+        );
+
+        if (read_position == ring->cached_write_position) {
+            ring->cached_write_position = wait_for_position_change(
+                ring,
+                &ring->write_position,
+                read_position,
+                &ring->consumer_waiting,
+                &ring->not_empty
+            );
+        }
+    }
+
+    return take_item(ring, read_position, index);
+}
+
+void *ring_buffer_try_get(ring_buffer_t *ring, size_t *index) {
+    size_t read_position = atomic_load_explicit(
+        &ring->read_position,
+        memory_order_relaxed
+    );
+
+    if (read_position == ring->cached_write_position) {
+        ring->cached_write_position = atomic_load_explicit(
+            &ring->write_position,
+            memory_order_acquire
+        );
+
+        if (read_position == ring->cached_write_position) {
+            return NULL;
+        }
+    }
+
+    return take_item(ring, read_position, index);
+}
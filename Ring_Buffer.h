@@ -0,0 +1,101 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define RING_BUFFER_CACHE_LINE_SIZE 64
+
+/**
+ * A bounded ring buffer with one producer thread and one consumer thread.
+ *
+ * The producer and the consumer each own one position (a count of the items
+ * they have put or got, so it never wraps around in practice), which only they
+ * write. The two positions are on separate cache lines, so the two threads do
+ * not invalidate each other's cache lines on every item. Each thread also keeps
+ * its own cached copy of the other's position, and only reads the other's
+ * position again when the cached copy says the buffer is full (or empty).
+ *
+ * Putting and getting do not lock anything unless the buffer is actually full
+ * (or empty), in which case the thread blocks on a condition variable until
+ * the other thread makes room (or puts an item).
+ */
+typedef struct ring_buffer_t {
+    /*
+     * Written by the producer only.
+     */
+    _Alignas(RING_BUFFER_CACHE_LINE_SIZE) atomic_size_t write_position;
+    size_t cached_read_position;
+
+    /*
+     * Written by the consumer only.
+     */
+    _Alignas(RING_BUFFER_CACHE_LINE_SIZE) atomic_size_t read_position;
+    size_t cached_write_position;
+
+    /*
+     * Only used when a thread has to block.
+     */
+    _Alignas(RING_BUFFER_CACHE_LINE_SIZE) atomic_bool producer_waiting;
+    atomic_bool consumer_waiting;
+    pthread_mutex_t mutex;
+    pthread_cond_t not_full;
+    pthread_cond_t not_empty;
+
+    /*
+     * Never written after initialization.
+     */
+    _Alignas(RING_BUFFER_CACHE_LINE_SIZE) void **slots;
+    size_t capacity;
+} ring_buffer_t;
+
+/**
+ * Initializes an empty ring buffer that can hold the given number of items.
+ */
+void ring_buffer_init(ring_buffer_t *ring, size_t capacity);
+
+/**
+ * Puts an item at the end of the buffer, blocking while the buffer is full.
+ * Only the producer thread may call this.
+ */
+void ring_buffer_put(ring_buffer_t *ring, void *item);
+
+/**
+ * Gets the item at the front of the buffer, blocking while the buffer is empty.
+ * The index of the slot that the item was in is returned through the index
+ * parameter (if it is not NULL). Only the consumer thread may call this.
+ */
+void *ring_buffer_get(ring_buffer_t *ring, size_t *index);
+
+/**
+ * Same as ring_buffer_get, but returns NULL instead of blocking if the buffer
+ * is empty (so NULL items should not be put in the buffer).
+ */
+void *ring_buffer_try_get(ring_buffer_t *ring, size_t *index);
+
+/**
+ * Returns the item at the given position (a position between the buffer's
+ * read position and write position).
+ */
+static inline void *ring_buffer_item_at(ring_buffer_t *ring, size_t position) {
+    return ring->slots[position % ring->capacity];
+}
+
+/**
+ * Returns how many items are in the buffer. Any thread may call this, without
+ * locking anything; the answer may already be out of date when it returns.
+ */
+static inline size_t ring_buffer_occupancy(ring_buffer_t *ring) {
+    size_t read_position = atomic_load_explicit(&ring->read_position, memory_order_relaxed);
+    size_t write_position = atomic_load_explicit(&ring->write_position, memory_order_relaxed);
+    size_t occupancy = write_position - read_position;
+
+    /*
+     * The producer may have refilled the buffer between the two loads.
+     */
+    return occupancy > ring->capacity ? ring->capacity : occupancy;
+}
+
+#endif
@@ -0,0 +1,126 @@
+#include <pthread.h>
+#include "errors.h"
+#include "types.h"
+#include "Hash.h"
+#include "Time_Value_Index.h"
+
+#define INITIAL_NUMBER_OF_BUCKETS 64
+
+/**
+ * Allocates an array of empty buckets.
+ */
+static time_value_entry_t **allocate_buckets(size_t number_of_buckets) {
+    time_value_entry_t **buckets = calloc(number_of_buckets, sizeof(time_value_entry_t *));
+    if (buckets == NULL) {
+        errno_abort("Calloc failed");
+    }
+
+    return buckets;
+}
+
+void time_value_index_init(time_value_index_t *index) {
+    index->number_of_buckets = INITIAL_NUMBER_OF_BUCKETS;
+    index->buckets = allocate_buckets(index->number_of_buckets);
+    index->number_of_entries = 0;
+}
+
+/**
+ * Doubles the number of buckets once there are more entries than buckets, so
+ * that buckets stay short.
+ */
+static void grow_time_value_index(time_value_index_t *index) {
+    time_value_entry_t **old_buckets = index->buckets;
+    size_t old_number_of_buckets = index->number_of_buckets;
+    time_value_entry_t *entry;
+    time_value_entry_t *next_entry;
+    size_t bucket;
+
+    index->number_of_buckets *= 2;
+    index->buckets = allocate_buckets(index->number_of_buckets);
+
+    for (size_t i = 0; i < old_number_of_buckets; i++) {
+        for (entry = old_buckets[i]; entry != NULL; entry = next_entry) {
+            next_entry = entry->hash_next;
+            bucket = hash_key(entry->time, index->number_of_buckets);
+            entry->hash_next = index->buckets[bucket];
+            index->buckets[bucket] = entry;
+        }
+    }
+
+    free(old_buckets);
+}
+
+time_value_entry_t *find_time_value(time_value_index_t *index, int time) {
+    time_value_entry_t *entry = index->buckets[
+        hash_key(time, index->number_of_buckets)
+    ];
+
+    while (entry != NULL && entry->time != time) {
+        entry = entry->hash_next;
+    }
+
+    return entry;
+}
+
+time_value_entry_t *add_alarm_to_time_value(time_value_index_t *index, int time) {
+    time_value_entry_t *entry = find_time_value(index, time);
+    size_t bucket;
+
+    if (entry == NULL) {
+        if (index->number_of_entries >= index->number_of_buckets) {
+            grow_time_value_index(index);
+        }
+
+        entry = malloc(sizeof(time_value_entry_t));
+        if (entry == NULL) {
+            errno_abort("Malloc failed");
+        }
+
+        entry->time = time;
+        entry->number_of_alarms = 0;
+        entry->thread = NULL;
+
+        bucket = hash_key(time, index->number_of_buckets);
+        entry->hash_next = index->buckets[bucket];
+        index->buckets[bucket] = entry;
+        index->number_of_entries++;
+    }
+
+    entry->number_of_alarms++;
+
+    return entry;
+}
+
+periodic_display_thread_t *remove_alarm_from_time_value(time_value_index_t *index, int time) {
+    time_value_entry_t **link = &index->buckets[
+        hash_key(time, index->number_of_buckets)
+    ];
+    time_value_entry_t *entry;
+    periodic_display_thread_t *thread;
+
+    while (*link != NULL && (*link)->time != time) {
+        link = &(*link)->hash_next;
+    }
+
+    entry = *link;
+    if (entry == NULL) {
+        return NULL;
+    }
+
+    entry->number_of_alarms--;
+    if (entry->number_of_alarms > 0) {
+        return NULL;
+    }
+
+    /*
+     * That was the last live alarm with this time value, so remove the entry
+     * and give its periodic display thread back to the caller.
+     */
+    *link = entry->hash_next;
+    index->number_of_entries--;
+
+    thread = entry->thread;
+    free(entry);
+
+    return thread;
+}
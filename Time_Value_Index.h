@@ -0,0 +1,63 @@
+#ifndef TIME_VALUE_INDEX_H
+#define TIME_VALUE_INDEX_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * An entry in the time value index. It counts the live alarms that have the
+ * time value, and holds the data of the periodic display thread that displays
+ * them (or NULL if no thread has been created for the time value yet).
+ *
+ * An entry only exists while at least one live alarm has the time value.
+ */
+typedef struct time_value_entry_t {
+    int time;
+    int number_of_alarms;
+    periodic_display_thread_t *thread;
+    struct time_value_entry_t *hash_next;
+} time_value_entry_t;
+
+/**
+ * A hash table from time value to time value entry. It is updated every time
+ * an alarm starts using or stops using a time value, so checking if a time
+ * value is still in use (or if it has a periodic display thread) takes
+ * constant time however many alarms and time values there are.
+ *
+ * A time value index is not thread-safe.
+ */
+typedef struct time_value_index_t {
+    time_value_entry_t **buckets;
+    size_t number_of_buckets;
+    size_t number_of_entries;
+} time_value_index_t;
+
+/**
+ * Initializes an empty time value index.
+ */
+void time_value_index_init(time_value_index_t *index);
+
+/**
+ * Returns the entry for the given time value, or NULL if no live alarm has
+ * that time value.
+ */
+time_value_entry_t *find_time_value(time_value_index_t *index, int time);
+
+/**
+ * Counts one more live alarm with the given time value, creating the entry if
+ * it is the first one. Returns the entry.
+ */
+time_value_entry_t *add_alarm_to_time_value(time_value_index_t *index, int time);
+
+/**
+ * Counts one less live alarm with the given time value. If it was the last
+ * one, the entry is removed and freed, and the data of its periodic display
+ * thread (which may be NULL) is returned so that the caller can retire it.
+ * Otherwise NULL is returned.
+ *
+ * If there is no entry for the time value, nothing happens and NULL is
+ * returned.
+ */
+periodic_display_thread_t *remove_alarm_from_time_value(time_value_index_t *index, int time);
+
+#endif
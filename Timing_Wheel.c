@@ -0,0 +1,399 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include "errors.h"
+#include "Timing_Wheel.h"
+
+#define LEVEL_SHIFT(level) (TIMING_WHEEL_SLOT_BITS * (level))
+#define SLOT_MASK (TIMING_WHEEL_SLOTS - 1)
+
+/**
+ * The number of ticks that the whole wheel covers. Timers further away than
+ * this are put in the furthest slot and moved down again when it comes round.
+ */
+#define WHEEL_RANGE (1ULL << LEVEL_SHIFT(TIMING_WHEEL_LEVELS))
+
+/*******************************************************************************
+ *                           HELPER FUNCTIONS                                  *
+ ******************************************************************************/
+
+/**
+ * Returns the number of whole ticks since the wheel was started.
+ */
+static uint64_t now_tick(timing_wheel_t *wheel) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    /*
+     * The nanoseconds are added up before dividing, because dividing a
+     * negative difference of the nanoseconds on its own would round it up,
+     * and a tick would then start up to a millisecond early.
+     */
+    long long nanoseconds = (now.tv_sec - wheel->start.tv_sec) * 1000000000LL
+        + (now.tv_nsec - wheel->start.tv_nsec);
+
+    return nanoseconds < 0 ? 0 : nanoseconds / (wheel->tick_milliseconds * 1000000LL);
+}
+
+/**
+ * Returns the time that the given tick starts at.
+ */
+static struct timespec tick_time(timing_wheel_t *wheel, uint64_t tick) {
+    long long milliseconds = (long long) tick * wheel->tick_milliseconds;
+    struct timespec time = wheel->start;
+
+    time.tv_sec += milliseconds / 1000;
+    time.tv_nsec += (milliseconds % 1000) * 1000000;
+    if (time.tv_nsec >= 1000000000) {
+        time.tv_sec++;
+        time.tv_nsec -= 1000000000;
+    }
+
+    return time;
+}
+
+/**
+ * Converts milliseconds to ticks, rounding up so that a timer never expires
+ * early.
+ */
+static uint64_t milliseconds_to_ticks(timing_wheel_t *wheel, long milliseconds) {
+    if (milliseconds <= 0) {
+        return 0;
+    }
+
+    return (milliseconds + wheel->tick_milliseconds - 1) / wheel->tick_milliseconds;
+}
+
+static void link_timer(wheel_timer_t *slot, wheel_timer_t *timer) {
+    timer->prev = slot->prev;
+    timer->next = slot;
+    slot->prev->next = timer;
+    slot->prev = timer;
+}
+
+static void unlink_timer(wheel_timer_t *timer) {
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->next = NULL;
+    timer->prev = NULL;
+}
+
+/**
+ * Puts the timer in the slot for its expiry, which must not be before the
+ * current tick. A timer that expires on the current tick goes in the current
+ * slot of level 0, so it only expires if that slot has not been emptied yet
+ * (while the wheel is advancing to this tick).
+ *
+ * Note that the wheel's mutex must be locked by the caller of this method.
+ */
+static void add_timer(timing_wheel_t *wheel, wheel_timer_t *timer) {
+    uint64_t delta;
+    uint64_t placement;
+    int level = 0;
+
+    delta = timer->expiry - wheel->current_tick;
+    placement = delta < WHEEL_RANGE
+        ? timer->expiry
+        : wheel->current_tick + WHEEL_RANGE - 1;
+
+    while (level < TIMING_WHEEL_LEVELS - 1
+           && delta >= (1ULL << LEVEL_SHIFT(level + 1))) {
+        level++;
+    }
+
+    link_timer(
+        &wheel->slots[level][(placement >> LEVEL_SHIFT(level)) & SLOT_MASK],
+        timer
+    );
+}
+
+/**
+ * Moves every timer in a slot of a higher level down to the level that now
+ * fits it. A timer that is due goes straight to the list of expired timers,
+ * with its expiry left as it is, so a periodic timer stays in phase.
+ */
+static void cascade(timing_wheel_t *wheel, int level, wheel_timer_t *expired) {
+    wheel_timer_t *slot = &wheel->slots[level][
+        (wheel->current_tick >> LEVEL_SHIFT(level)) & SLOT_MASK
+    ];
+    wheel_timer_t *timer;
+
+    while (slot->next != slot) {
+        timer = slot->next;
+        unlink_timer(timer);
+
+        if (timer->expiry <= wheel->current_tick) {
+            link_timer(expired, timer);
+        } else {
+            add_timer(wheel, timer);
+        }
+    }
+}
+
+/**
+ * Returns the first tick after the current one on which the wheel has
+ * something to do: a timer in level 0 expires, or a non-empty slot of a
+ * higher level is moved down. The wheel must have timers. Only the slots
+ * that are not empty are looked at, however far away that tick is.
+ *
+ * Note that the wheel's mutex must be locked by the caller of this method.
+ */
+static uint64_t next_event_tick(timing_wheel_t *wheel) {
+    uint64_t next = UINT64_MAX;
+    uint64_t index;
+    uint64_t tick;
+
+    /*
+     * A timer in level 0 expires on the tick of its slot, within one
+     * revolution of the current tick.
+     */
+    for (uint64_t i = 1; i < TIMING_WHEEL_SLOTS; i++) {
+        tick = wheel->current_tick + i;
+        if (wheel->slots[0][tick & SLOT_MASK].next != &wheel->slots[0][tick & SLOT_MASK]) {
+            next = tick;
+            break;
+        }
+    }
+
+    /*
+     * A slot of a higher level is moved down on the tick where the level
+     * below it wraps around onto that slot, up to a whole revolution of its
+     * level from the current one (a slot may be one revolution ahead).
+     */
+    for (int level = 1; level < TIMING_WHEEL_LEVELS; level++) {
+        for (uint64_t i = 1; i <= TIMING_WHEEL_SLOTS; i++) {
+            index = (wheel->current_tick >> LEVEL_SHIFT(level)) + i;
+            tick = index << LEVEL_SHIFT(level);
+            if (tick >= next) {
+                break;
+            }
+            if (wheel->slots[level][index & SLOT_MASK].next != &wheel->slots[level][index & SLOT_MASK]) {
+                next = tick;
+                break;
+            }
+        }
+    }
+
+    return next;
+}
+
+/**
+ * Advances the wheel by one tick and moves the timers that expire on that
+ * tick to the list of expired timers.
+ *
+ * Note that the wheel's mutex must be locked by the caller of this method.
+ */
+static void advance(timing_wheel_t *wheel, wheel_timer_t *expired) {
+    wheel_timer_t *slot;
+    wheel_timer_t *timer;
+
+    wheel->current_tick++;
+
+    /*
+     * Each time a level wraps around, the next slot of the level above it is
+     * moved down.
+     */
+    for (int level = 1; level < TIMING_WHEEL_LEVELS; level++) {
+        if ((wheel->current_tick & ((1ULL << LEVEL_SHIFT(level)) - 1)) != 0) {
+            break;
+        }
+        cascade(wheel, level, expired);
+    }
+
+    slot = &wheel->slots[0][wheel->current_tick & SLOT_MASK];
+    while (slot->next != slot) {
+        timer = slot->next;
+        unlink_timer(timer);
+
+        if (timer->expiry <= wheel->current_tick) {
+            link_timer(expired, timer);
+        } else {
+            add_timer(wheel, timer);
+        }
+    }
+}
+
+/*******************************************************************************
+ *                           TIMING WHEEL THREAD                               *
+ ******************************************************************************/
+
+/**
+ * Advances the wheel in real time and runs the callbacks of expired timers.
+ * Callbacks run without the wheel's mutex locked, so they can schedule timers.
+ *
+ * The thread only wakes up on the ticks where the wheel has something to do
+ * (or when a timer is scheduled), not on every tick, and skips straight over
+ * the empty ticks in between.
+ */
+static void *timing_wheel_thread_routine(void *arg) {
+    timing_wheel_t *wheel = arg;
+    wheel_timer_t *expired = &wheel->expired;
+    wheel_timer_t *timer;
+    struct timespec deadline;
+    uint64_t next;
+
+    pthread_mutex_lock(&wheel->mutex);
+
+    while (1) {
+        /*
+         * Sleep until there is a timer.
+         */
+        if (wheel->number_of_timers == 0) {
+            pthread_cond_wait(&wheel->cond, &wheel->mutex);
+            continue;
+        }
+
+        /*
+         * Sleep until the next tick with something to do starts (or a timer
+         * is scheduled, which may make it sooner).
+         */
+        next = next_event_tick(wheel);
+        if (now_tick(wheel) < next) {
+            deadline = tick_time(wheel, next);
+            pthread_cond_timedwait(&wheel->cond, &wheel->mutex, &deadline);
+            continue;
+        }
+
+        /*
+         * Nothing happens on the ticks before it, so jump over them.
+         */
+        wheel->current_tick = next - 1;
+        advance(wheel, expired);
+
+        /*
+         * Run the callbacks of the expired timers. A callback may cancel
+         * another expired timer, so they are taken one at a time.
+         */
+        while (expired->next != expired) {
+            timer = expired->next;
+            unlink_timer(timer);
+            wheel->number_of_timers--;
+
+            pthread_mutex_unlock(&wheel->mutex);
+            timer->callback(timer);
+            pthread_mutex_lock(&wheel->mutex);
+        }
+    }
+
+    return NULL;
+}
+
+/*******************************************************************************
+ *                              PUBLIC FUNCTIONS                               *
+ ******************************************************************************/
+
+void timing_wheel_init(timing_wheel_t *wheel, long tick_milliseconds) {
+    pthread_condattr_t cond_attributes;
+
+    for (int level = 0; level < TIMING_WHEEL_LEVELS; level++) {
+        for (int slot = 0; slot < TIMING_WHEEL_SLOTS; slot++) {
+            wheel->slots[level][slot].next = &wheel->slots[level][slot];
+            wheel->slots[level][slot].prev = &wheel->slots[level][slot];
+        }
+    }
+    wheel->expired.next = &wheel->expired;
+    wheel->expired.prev = &wheel->expired;
+
+    wheel->current_tick = 0;
+    wheel->number_of_timers = 0;
+    wheel->tick_milliseconds = tick_milliseconds;
+    clock_gettime(CLOCK_MONOTONIC, &wheel->start);
+
+    /*
+     * The condition variable uses the monotonic clock, so that changing the
+     * wall clock does not change when timers expire.
+     */
+    pthread_mutex_init(&wheel->mutex, NULL);
+    pthread_condattr_init(&cond_attributes);
+    pthread_condattr_setclock(&cond_attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&wheel->cond, &cond_attributes);
+    pthread_condattr_destroy(&cond_attributes);
+}
+
+void timing_wheel_start(timing_wheel_t *wheel) {
+    int status = pthread_create(
+        &wheel->thread,
+        NULL,
+        timing_wheel_thread_routine,
+        wheel
+    );
+    if (status != 0) {
+        err_abort(status, "Create timing wheel thread");
+    }
+}
+
+void timing_wheel_schedule(timing_wheel_t *wheel, wheel_timer_t *timer, long delay_milliseconds) {
+    uint64_t now;
+
+    pthread_mutex_lock(&wheel->mutex);
+
+    /*
+     * If the wheel is empty, its thread has stopped advancing it, so catch it
+     * up to the current time first.
+     */
+    now = now_tick(wheel);
+    if (wheel->number_of_timers == 0 && now > wheel->current_tick) {
+        wheel->current_tick = now;
+    }
+
+    timer->expiry = (now > wheel->current_tick ? now : wheel->current_tick)
+        + milliseconds_to_ticks(wheel, delay_milliseconds);
+
+    /*
+     * A timer that is already due expires on the next tick.
+     */
+    if (timer->expiry <= wheel->current_tick) {
+        timer->expiry = wheel->current_tick + 1;
+    }
+    add_timer(wheel, timer);
+    wheel->number_of_timers++;
+
+    pthread_cond_signal(&wheel->cond);
+    pthread_mutex_unlock(&wheel->mutex);
+}
+
+void timing_wheel_reschedule(timing_wheel_t *wheel, wheel_timer_t *timer, long period_milliseconds) {
+    uint64_t period = milliseconds_to_ticks(wheel, period_milliseconds);
+    uint64_t now;
+
+    pthread_mutex_lock(&wheel->mutex);
+
+    /*
+     * A timer may be rescheduled some time after its callback ran (by work
+     * that the callback handed to another thread), and if the wheel was empty
+     * meanwhile, its thread has stopped advancing it, so catch it up first.
+     */
+    now = now_tick(wheel);
+    if (wheel->number_of_timers == 0 && now > wheel->current_tick) {
+        wheel->current_tick = now;
+    }
+
+    /*
+     * Skip the periods that are already over, so the timer stays in phase.
+     * The wheel's thread only advances it when it has something to do, so
+     * the current tick may be behind the time; a period is over once a later
+     * tick has started.
+     */
+    do {
+        timer->expiry += period > 0 ? period : 1;
+    } while (timer->expiry <= wheel->current_tick || timer->expiry < now);
+    add_timer(wheel, timer);
+    wheel->number_of_timers++;
+
+    pthread_cond_signal(&wheel->cond);
+    pthread_mutex_unlock(&wheel->mutex);
+}
+
+struct timespec timing_wheel_expiry_time(timing_wheel_t *wheel, wheel_timer_t *timer) {
+    return tick_time(wheel, timer->expiry);
+}
+
+void timing_wheel_cancel(timing_wheel_t *wheel, wheel_timer_t *timer) {
+    pthread_mutex_lock(&wheel->mutex);
+
+    if (timer->next != NULL) {
+        unlink_timer(timer);
+        wheel->number_of_timers--;
+    }
+
+    pthread_mutex_unlock(&wheel->mutex);
+}
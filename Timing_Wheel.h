@@ -0,0 +1,95 @@
+#ifndef TIMING_WHEEL_H
+#define TIMING_WHEEL_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#define TIMING_WHEEL_LEVELS 5
+#define TIMING_WHEEL_SLOT_BITS 6
+#define TIMING_WHEEL_SLOTS (1 << TIMING_WHEEL_SLOT_BITS)
+
+/**
+ * A timer that can be scheduled on a timing wheel. When the timer expires,
+ * the timing wheel's thread calls the callback with the timer (the arg field
+ * is for the callback to use). The callback may schedule the timer again.
+ *
+ * A timer is linked into exactly one slot of the wheel while it is scheduled,
+ * through its next and prev pointers, so it can be cancelled in constant time.
+ * The next pointer is NULL while the timer is not scheduled, so a new timer
+ * must be zeroed before it is used.
+ */
+typedef struct wheel_timer_t {
+    uint64_t expiry;                       // Tick that the timer expires at.
+    void (*callback)(struct wheel_timer_t *timer);
+    void *arg;
+    struct wheel_timer_t *next;
+    struct wheel_timer_t *prev;
+} wheel_timer_t;
+
+/**
+ * A hierarchical timing wheel.
+ *
+ * Level 0 has one slot per tick. Each slot of level 1 covers a whole
+ * revolution of level 0 (64 ticks), each slot of level 2 covers a whole
+ * revolution of level 1, and so on. A timer is put in the lowest level that
+ * can hold its expiry, and is moved down a level (cascaded) each time the
+ * level below wraps around. Scheduling and cancelling a timer take constant
+ * time however many timers there are.
+ *
+ * One thread (started with timing_wheel_start) advances the wheel in real time
+ * and runs the callbacks of the timers that expire. All the other functions
+ * are thread-safe.
+ */
+typedef struct timing_wheel_t {
+    wheel_timer_t slots[TIMING_WHEEL_LEVELS][TIMING_WHEEL_SLOTS]; // Sentinels.
+    wheel_timer_t expired;                  // Expired timers waiting to run.
+    uint64_t current_tick;
+    size_t number_of_timers;
+    long tick_milliseconds;
+    struct timespec start;                  // When tick 0 was (monotonic).
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    pthread_t thread;
+} timing_wheel_t;
+
+/**
+ * Initializes an empty timing wheel whose ticks are the given number of
+ * milliseconds long.
+ */
+void timing_wheel_init(timing_wheel_t *wheel, long tick_milliseconds);
+
+/**
+ * Starts the thread that advances the wheel and runs expired timers.
+ */
+void timing_wheel_start(timing_wheel_t *wheel);
+
+/**
+ * Schedules the timer to expire after the given number of milliseconds
+ * (rounded up to whole ticks). The timer must not already be scheduled.
+ */
+void timing_wheel_schedule(timing_wheel_t *wheel, wheel_timer_t *timer, long delay_milliseconds);
+
+/**
+ * Schedules the timer to expire the given number of milliseconds after it
+ * last expired. This keeps a periodic timer from drifting, however long its
+ * callbacks take. If the wheel has already passed that time, whole periods are
+ * skipped, so the timer stays in phase. It should be called from the timer's
+ * callback, or from work that the callback handed to another thread.
+ */
+void timing_wheel_reschedule(timing_wheel_t *wheel, wheel_timer_t *timer, long period_milliseconds);
+
+/**
+ * Returns the time (on the monotonic clock) that the timer is due to expire
+ * at, or last expired at if it is not scheduled. It should be called from the
+ * timer's callback, or while the timer cannot be scheduled by another thread.
+ */
+struct timespec timing_wheel_expiry_time(timing_wheel_t *wheel, wheel_timer_t *timer);
+
+/**
+ * Cancels a scheduled timer. Nothing happens if the timer is not scheduled.
+ */
+void timing_wheel_cancel(timing_wheel_t *wheel, wheel_timer_t *timer);
+
+#endif
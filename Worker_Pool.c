@@ -0,0 +1,205 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "errors.h"
+#include "Worker_Pool.h"
+
+/**
+ * The worker that the calling thread is, or NULL if it is not a worker.
+ */
+static _Thread_local worker_t *current_worker = NULL;
+
+/*******************************************************************************
+ *                           HELPER FUNCTIONS                                  *
+ ******************************************************************************/
+
+static void link_task(worker_task_t *sentinel, worker_task_t *task) {
+    task->prev = sentinel->prev;
+    task->next = sentinel;
+    sentinel->prev->next = task;
+    sentinel->prev = task;
+}
+
+static void unlink_task(worker_task_t *task) {
+    task->prev->next = task->next;
+    task->next->prev = task->prev;
+    task->next = NULL;
+    task->prev = NULL;
+}
+
+/**
+ * Takes the task at the front of a worker's deque (its owner's end), or the
+ * one at the back (a thief's end), or returns NULL if the deque is empty.
+ */
+static worker_task_t *take_task(worker_t *worker, bool from_front) {
+    worker_task_t *task = NULL;
+
+    pthread_mutex_lock(&worker->mutex);
+    if (worker->tasks.next != &worker->tasks) {
+        task = from_front ? worker->tasks.next : worker->tasks.prev;
+        unlink_task(task);
+    }
+    pthread_mutex_unlock(&worker->mutex);
+
+    return task;
+}
+
+/**
+ * Takes a task for a worker: from its own deque, or else from the other
+ * workers' deques, starting with the next worker. Returns NULL if every deque
+ * is empty.
+ */
+static worker_task_t *find_task(worker_t *worker) {
+    worker_pool_t *pool = worker->pool;
+    worker_task_t *task;
+
+    /*
+     * Nothing can be taken while nothing is pending, so a worker that has
+     * nothing to run does not lock every deque to find that out.
+     */
+    if (atomic_load(&pool->pending) == 0) {
+        return NULL;
+    }
+
+    task = take_task(worker, true);
+    if (task != NULL) {
+        return task;
+    }
+
+    for (int i = 1; i < pool->number_of_workers; i++) {
+        task = take_task(&pool->workers[(worker->index + i) % pool->number_of_workers], false);
+        if (task != NULL) {
+            atomic_fetch_add_explicit(&pool->tasks_stolen, 1, memory_order_relaxed);
+            return task;
+        }
+    }
+
+    return NULL;
+}
+
+/*******************************************************************************
+ *                               WORKER THREAD                                 *
+ ******************************************************************************/
+
+/**
+ * Runs tasks until the program exits, sleeping while there are none.
+ */
+static void *worker_thread_routine(void *arg) {
+    worker_t *worker = arg;
+    worker_pool_t *pool = worker->pool;
+    worker_task_t *task;
+
+    current_worker = worker;
+
+    while (1) {
+        task = find_task(worker);
+        if (task != NULL) {
+            atomic_fetch_sub(&pool->pending, 1);
+            atomic_fetch_add_explicit(&pool->tasks_run, 1, memory_order_relaxed);
+            task->run(task);
+            continue;
+        }
+
+        /*
+         * Announce that this worker is sleeping before checking for pending
+         * tasks one last time. A submitter adds its task to pending before it
+         * checks for sleeping workers, so either this worker sees the task,
+         * or the submitter sees this worker and signals it (which it cannot
+         * do until this worker is waiting, because of the mutex). A task that
+         * is pending may not be linked yet, in which case the worker looks
+         * for it again until it is.
+         */
+        pthread_mutex_lock(&pool->mutex);
+        atomic_fetch_add(&pool->sleeping, 1);
+        while (atomic_load(&pool->pending) == 0) {
+            pthread_cond_wait(&pool->cond, &pool->mutex);
+        }
+        atomic_fetch_sub(&pool->sleeping, 1);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+
+    return NULL;
+}
+
+/*******************************************************************************
+ *                              PUBLIC FUNCTIONS                               *
+ ******************************************************************************/
+
+void worker_pool_start(worker_pool_t *pool, int number_of_workers) {
+    int status;
+
+    pool->workers = aligned_alloc(
+        WORKER_POOL_CACHE_LINE_SIZE,
+        number_of_workers * sizeof(worker_t)
+    );
+    if (pool->workers == NULL) {
+        errno_abort("Aligned_alloc failed");
+    }
+    pool->number_of_workers = number_of_workers;
+    atomic_init(&pool->next_worker, 0);
+    atomic_init(&pool->pending, 0);
+    atomic_init(&pool->sleeping, 0);
+    atomic_init(&pool->tasks_run, 0);
+    atomic_init(&pool->tasks_stolen, 0);
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+
+    for (int i = 0; i < number_of_workers; i++) {
+        pthread_mutex_init(&pool->workers[i].mutex, NULL);
+        pool->workers[i].tasks.next = &pool->workers[i].tasks;
+        pool->workers[i].tasks.prev = &pool->workers[i].tasks;
+        pool->workers[i].pool = pool;
+        pool->workers[i].index = i;
+    }
+
+    /*
+     * The workers are all initialized before any of them starts, because
+     * they steal from each other.
+     */
+    for (int i = 0; i < number_of_workers; i++) {
+        status = pthread_create(
+            &pool->workers[i].thread,
+            NULL,
+            worker_thread_routine,
+            &pool->workers[i]
+        );
+        if (status != 0) {
+            err_abort(status, "Create worker thread");
+        }
+    }
+}
+
+void worker_pool_submit(worker_pool_t *pool, worker_task_t *task) {
+    worker_t *worker = current_worker;
+
+    if (worker == NULL || worker->pool != pool) {
+        worker = &pool->workers[
+            atomic_fetch_add_explicit(&pool->next_worker, 1, memory_order_relaxed)
+            % pool->number_of_workers
+        ];
+    }
+
+    /*
+     * The task is counted as pending before it is linked, so a worker that
+     * takes it (and decrements pending) cannot do so before it is counted.
+     * See worker_thread_routine for why this cannot miss a sleeping worker.
+     */
+    atomic_fetch_add(&pool->pending, 1);
+
+    pthread_mutex_lock(&worker->mutex);
+    link_task(&worker->tasks, task);
+    pthread_mutex_unlock(&worker->mutex);
+
+    if (atomic_load(&pool->sleeping) > 0) {
+        pthread_mutex_lock(&pool->mutex);
+        pthread_cond_signal(&pool->cond);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+}
+
+int worker_pool_default_size(void) {
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return processors > 0 ? (int) processors : 1;
+}
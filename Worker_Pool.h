@@ -0,0 +1,85 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+#define WORKER_POOL_CACHE_LINE_SIZE 64
+
+/**
+ * A task that can be submitted to a worker pool. A worker thread calls the
+ * run function with the task (the arg field is for the function to use). The
+ * run function may submit the task again.
+ *
+ * A task is linked into exactly one worker's deque while it is waiting to
+ * run, through its next and prev pointers, so submitting it never allocates.
+ * A task must not be submitted again before it has started running.
+ */
+typedef struct worker_task_t {
+    void (*run)(struct worker_task_t *task);
+    void *arg;
+    struct worker_task_t *next;
+    struct worker_task_t *prev;
+} worker_task_t;
+
+/**
+ * A worker thread and its deque of tasks waiting to run. Each worker is on
+ * its own cache lines, so workers do not share the lines they lock.
+ */
+typedef struct worker_t {
+    _Alignas(WORKER_POOL_CACHE_LINE_SIZE) pthread_mutex_t mutex; // For tasks.
+    worker_task_t tasks;                // Sentinel of the deque.
+    struct worker_pool_t *pool;
+    int index;
+    pthread_t thread;
+} worker_t;
+
+/**
+ * A fixed number of worker threads that run submitted tasks, with work
+ * stealing.
+ *
+ * Each worker has a deque of tasks. Tasks submitted from outside the pool are
+ * spread over the workers in turn, and tasks submitted by a worker (from a
+ * task it is running) go to the back of its own deque. A worker runs the
+ * tasks of its own deque from the front, oldest first, and once it is empty,
+ * steals from the back of the other workers' deques, so no worker is idle
+ * while another has tasks waiting. Workers with nothing to run sleep until a
+ * task is submitted.
+ *
+ * The threads are created once, by worker_pool_start, and run until the
+ * program exits.
+ */
+typedef struct worker_pool_t {
+    worker_t *workers;
+    int number_of_workers;
+    atomic_uint next_worker;            // For tasks submitted from outside.
+    atomic_size_t pending;              // Tasks submitted and not yet taken
+                                        // (counted just before they are
+                                        // linked into a deque).
+    atomic_int sleeping;                // Workers waiting on cond.
+    atomic_ulong tasks_run;
+    atomic_ulong tasks_stolen;          // Run by a worker other than the one
+                                        // they were submitted to.
+    pthread_mutex_t mutex;              // Only for sleeping on cond.
+    pthread_cond_t cond;
+} worker_pool_t;
+
+/**
+ * Initializes a worker pool with the given number of workers, and starts
+ * their threads.
+ */
+void worker_pool_start(worker_pool_t *pool, int number_of_workers);
+
+/**
+ * Submits a task to run on one of the pool's workers.
+ */
+void worker_pool_submit(worker_pool_t *pool, worker_task_t *task);
+
+/**
+ * Returns the number of processors online, which is the size of a pool that
+ * keeps every processor busy without more threads than it can run at once.
+ */
+int worker_pool_default_size(void);
+
+#endif
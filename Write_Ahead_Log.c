@@ -0,0 +1,446 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include "errors.h"
+#include "types.h"
+#include "Alarm_Request.h"
+#include "Write_Ahead_Log.h"
+
+#define WAL_MAGIC "ALARMWAL"
+#define WAL_VERSION 1
+#define INITIAL_BUFFER_CAPACITY 65536
+
+/**
+ * The header at the start of the log file.
+ */
+typedef struct wal_file_header_t {
+    char magic[8];                  // WAL_MAGIC, without the terminating zero.
+    uint32_t version;
+    uint32_t unused;
+} wal_file_header_t;
+
+/**
+ * The header of each record. The message follows it, without a terminating
+ * zero.
+ */
+typedef struct wal_record_header_t {
+    uint32_t checksum;              // Of the rest of the header and the
+                                    // message.
+    uint32_t type;
+    int32_t alarm_id;
+    int32_t time;
+    uint32_t message_length;
+} wal_record_header_t;
+
+/*******************************************************************************
+ *                           HELPER FUNCTIONS                                  *
+ ******************************************************************************/
+
+/**
+ * FNV-1a, continued from the given hash.
+ */
+static uint32_t checksum_bytes(uint32_t hash, const void *data, size_t length) {
+    const unsigned char *bytes = data;
+
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+static uint32_t record_checksum(const wal_record_header_t *header, const char *message) {
+    uint32_t hash = checksum_bytes(
+        2166136261u,
+        (const char *) header + sizeof(header->checksum),
+        sizeof(wal_record_header_t) - sizeof(header->checksum)
+    );
+
+    return checksum_bytes(hash, message, header->message_length);
+}
+
+static void write_all(int fd, const char *data, size_t length) {
+    ssize_t written;
+
+    while (length > 0) {
+        written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            errno_abort("Write-ahead log write failed");
+        }
+        data += written;
+        length -= written;
+    }
+}
+
+/**
+ * Reads the whole file. Returns its contents (which must be freed) and sets
+ * the length.
+ */
+static char *read_file(int fd, size_t *length) {
+    struct stat status;
+    char *contents;
+    ssize_t bytes_read;
+
+    if (fstat(fd, &status) != 0) {
+        errno_abort("Write-ahead log fstat failed");
+    }
+
+    contents = malloc(status.st_size > 0 ? status.st_size : 1);
+    if (contents == NULL) {
+        errno_abort("Malloc failed");
+    }
+
+    *length = 0;
+    while (*length < (size_t) status.st_size) {
+        bytes_read = read(fd, contents + *length, status.st_size - *length);
+        if (bytes_read < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            errno_abort("Write-ahead log read failed");
+        }
+        if (bytes_read == 0) {
+            break;
+        }
+        *length += bytes_read;
+    }
+
+    return contents;
+}
+
+/**
+ * Passes every whole record of the log to the replay handler. Returns the
+ * number of records, and sets the end to the offset just after the last whole
+ * record.
+ */
+static unsigned long replay(
+    const char *contents,
+    size_t length,
+    size_t *end,
+    wal_replay_handler_t replay_handler,
+    void *arg
+) {
+    wal_record_header_t header;
+    alarm_request_t *alarm_request;
+    const char *message;
+    unsigned long records = 0;
+    size_t offset = sizeof(wal_file_header_t);
+
+    while (offset + sizeof(header) <= length) {
+        memcpy(&header, contents + offset, sizeof(header));
+        message = contents + offset + sizeof(header);
+
+        if (header.message_length > length - offset - sizeof(header)
+            || header.type > Cancel_Alarm
+            || record_checksum(&header, message) != header.checksum) {
+            break;
+        }
+
+        /*
+         * Fill the alarm request the way parse_request does.
+         */
+        alarm_request = allocate_alarm_request();
+        alarm_request->type = header.type;
+        alarm_request->change_status = alarm_request->type == Change_Alarm;
+        alarm_request->next = NULL;
+        alarm_request->sequence_number = 0;
+        alarm_request->queue_next = NULL;
+        alarm_request->bulk_next = NULL;
+        alarm_request->alarm_id = header.alarm_id;
+        alarm_request->time = header.time;
+        alarm_request->message = message_intern(message, header.message_length);
+        alarm_request->creation_time = time(NULL);
+
+        replay_handler(alarm_request, arg);
+
+        records++;
+        offset += sizeof(header) + header.message_length;
+    }
+
+    *end = offset;
+    return records;
+}
+
+/**
+ * Writes the records that have been appended and syncs them, once the oldest
+ * of them has waited for the sync interval or enough of them are waiting.
+ * The next records are appended to a new buffer while this one is written.
+ */
+static void *wal_sync_thread_routine(void *arg) {
+    write_ahead_log_t *wal = arg;
+    struct timespec deadline;
+    char *buffer;
+    size_t length;
+    size_t capacity;
+    char *spare_buffer = NULL;      // Written last time, empty now.
+    size_t spare_capacity = 0;
+    unsigned long lsn;
+
+    pthread_mutex_lock(&wal->mutex);
+
+    while (1) {
+        if (wal->appended_lsn == wal->written_lsn) {
+            if (wal->closing) {
+                break;
+            }
+            pthread_cond_wait(&wal->append_cond, &wal->mutex);
+            continue;
+        }
+
+        if (wal->sync_interval > 0
+            && !wal->closing
+            && wal->appended_lsn - wal->written_lsn < wal->sync_count) {
+            deadline = wal->oldest_append_time;
+            deadline.tv_sec += wal->sync_interval / 1000;
+            deadline.tv_nsec += (long) (wal->sync_interval % 1000) * 1000000;
+            if (deadline.tv_nsec >= 1000000000) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000;
+            }
+            if (pthread_cond_timedwait(&wal->append_cond, &wal->mutex, &deadline) == 0) {
+                continue;
+            }
+        }
+
+        /*
+         * Take the buffer, and leave the spare one for the next records.
+         */
+        buffer = wal->buffer;
+        length = wal->length;
+        capacity = wal->capacity;
+        lsn = wal->appended_lsn;
+        wal->buffer = spare_buffer;
+        wal->capacity = spare_capacity;
+        wal->length = 0;
+        wal->written_lsn = lsn;
+
+        pthread_mutex_unlock(&wal->mutex);
+
+        write_all(wal->fd, buffer, length);
+        spare_buffer = buffer;
+        spare_capacity = capacity;
+        if (fdatasync(wal->fd) != 0) {
+            errno_abort("Write-ahead log fdatasync failed");
+        }
+
+        pthread_mutex_lock(&wal->mutex);
+        wal->durable_lsn = lsn;
+        wal->syncs++;
+        pthread_cond_broadcast(&wal->durable_cond);
+    }
+
+    pthread_mutex_unlock(&wal->mutex);
+    free(spare_buffer);
+
+    return NULL;
+}
+
+/*******************************************************************************
+ *                              PUBLIC FUNCTIONS                               *
+ ******************************************************************************/
+
+unsigned long wal_open(
+    write_ahead_log_t *wal,
+    const char *path,
+    int sync_interval,
+    unsigned long sync_count,
+    wal_replay_handler_t replay_handler,
+    void *arg
+) {
+    wal_file_header_t file_header;
+    pthread_condattr_t cond_attributes;
+    unsigned long records = 0;
+    char *contents;
+    size_t length;
+    size_t end;
+    int status;
+
+    wal->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (wal->fd < 0) {
+        errno_abort("Write-ahead log open failed");
+    }
+
+    contents = read_file(wal->fd, &length);
+
+    if (length == 0) {
+        /*
+         * A new log.
+         */
+        memset(&file_header, 0, sizeof(file_header));
+        memcpy(file_header.magic, WAL_MAGIC, sizeof(file_header.magic));
+        file_header.version = WAL_VERSION;
+        write_all(wal->fd, (const char *) &file_header, sizeof(file_header));
+        if (fdatasync(wal->fd) != 0) {
+            errno_abort("Write-ahead log fdatasync failed");
+        }
+    } else {
+        if (length < sizeof(file_header)) {
+            fprintf(stderr, "%s is not a write-ahead log\n", path);
+            exit(1);
+        }
+        memcpy(&file_header, contents, sizeof(file_header));
+        if (memcmp(file_header.magic, WAL_MAGIC, sizeof(file_header.magic)) != 0) {
+            fprintf(stderr, "%s is not a write-ahead log\n", path);
+            exit(1);
+        }
+        if (file_header.version != WAL_VERSION) {
+            fprintf(stderr, "%s is a write-ahead log of version %u, not %u\n",
+                    path, file_header.version, WAL_VERSION);
+            exit(1);
+        }
+
+        records = replay(contents, length, &end, replay_handler, arg);
+
+        /*
+         * Cut off a torn record (from a crash in the middle of a write), so
+         * new records are appended after the last whole one.
+         */
+        if (end < length) {
+            fprintf(stderr, "Write-ahead log %s: cut off %zu bytes of torn "
+                    "records after %lu records\n", path, length - end, records);
+            if (ftruncate(wal->fd, end) != 0) {
+                errno_abort("Write-ahead log ftruncate failed");
+            }
+        }
+        if (lseek(wal->fd, end, SEEK_SET) < 0) {
+            errno_abort("Write-ahead log lseek failed");
+        }
+    }
+
+    free(contents);
+
+    wal->sync_interval = sync_interval;
+    wal->sync_count = sync_count > 0 ? sync_count : 1;
+    wal->buffer = NULL;
+    wal->length = 0;
+    wal->capacity = 0;
+    wal->appended_lsn = 0;
+    wal->written_lsn = 0;
+    wal->durable_lsn = 0;
+    wal->syncs = 0;
+    wal->closing = false;
+
+    pthread_mutex_init(&wal->mutex, NULL);
+    pthread_condattr_init(&cond_attributes);
+    pthread_condattr_setclock(&cond_attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&wal->append_cond, &cond_attributes);
+    pthread_condattr_destroy(&cond_attributes);
+    pthread_cond_init(&wal->durable_cond, NULL);
+
+    status = pthread_create(&wal->thread, NULL, wal_sync_thread_routine, wal);
+    if (status != 0) {
+        err_abort(status, "Create write-ahead log sync thread");
+    }
+
+    return records;
+}
+
+unsigned long wal_append(write_ahead_log_t *wal, alarm_request_t *alarm_request) {
+    wal_record_header_t header;
+    size_t record_length;
+    size_t capacity;
+    unsigned long lsn;
+
+    header.type = alarm_request->type;
+    header.alarm_id = alarm_request->alarm_id;
+    header.time = alarm_request->time;
+    header.message_length = alarm_request->message->length;
+    header.checksum = record_checksum(&header, alarm_request->message->text);
+    record_length = sizeof(header) + header.message_length;
+
+    pthread_mutex_lock(&wal->mutex);
+
+    if (wal->length + record_length > wal->capacity) {
+        capacity = wal->capacity > 0 ? wal->capacity : INITIAL_BUFFER_CAPACITY;
+        while (capacity < wal->length + record_length) {
+            capacity *= 2;
+        }
+        wal->buffer = realloc(wal->buffer, capacity);
+        if (wal->buffer == NULL) {
+            errno_abort("Realloc failed");
+        }
+        wal->capacity = capacity;
+    }
+
+    memcpy(wal->buffer + wal->length, &header, sizeof(header));
+    memcpy(wal->buffer + wal->length + sizeof(header), alarm_request->message->text,
+           header.message_length);
+    wal->length += record_length;
+    lsn = ++wal->appended_lsn;
+
+    /*
+     * The sync thread only needs to know about the first record of a group
+     * (to start its interval) and about the one that fills the group.
+     */
+    if (lsn - wal->written_lsn == 1) {
+        clock_gettime(CLOCK_MONOTONIC, &wal->oldest_append_time);
+        pthread_cond_signal(&wal->append_cond);
+    } else if (lsn - wal->written_lsn == wal->sync_count) {
+        pthread_cond_signal(&wal->append_cond);
+    }
+
+    pthread_mutex_unlock(&wal->mutex);
+
+    return lsn;
+}
+
+void wal_wait_durable(write_ahead_log_t *wal, unsigned long lsn) {
+    pthread_mutex_lock(&wal->mutex);
+    while (wal->durable_lsn < lsn) {
+        pthread_cond_wait(&wal->durable_cond, &wal->mutex);
+    }
+    pthread_mutex_unlock(&wal->mutex);
+}
+
+void wal_truncate(write_ahead_log_t *wal) {
+    pthread_mutex_lock(&wal->mutex);
+
+    while (wal->durable_lsn < wal->appended_lsn) {
+        pthread_cond_wait(&wal->durable_cond, &wal->mutex);
+    }
+
+    /*
+     * Everything appended is durable, so the sync thread is waiting for the
+     * next append, which cannot come while the mutex is locked.
+     */
+    if (ftruncate(wal->fd, sizeof(wal_file_header_t)) != 0) {
+        errno_abort("Write-ahead log ftruncate failed");
+    }
+    if (lseek(wal->fd, sizeof(wal_file_header_t), SEEK_SET) < 0) {
+        errno_abort("Write-ahead log lseek failed");
+    }
+    if (fdatasync(wal->fd) != 0) {
+        errno_abort("Write-ahead log fdatasync failed");
+    }
+
+    pthread_mutex_unlock(&wal->mutex);
+}
+
+unsigned long wal_number_of_syncs(write_ahead_log_t *wal) {
+    unsigned long syncs;
+
+    pthread_mutex_lock(&wal->mutex);
+    syncs = wal->syncs;
+    pthread_mutex_unlock(&wal->mutex);
+
+    return syncs;
+}
+
+void wal_close(write_ahead_log_t *wal) {
+    pthread_mutex_lock(&wal->mutex);
+    wal->closing = true;
+    pthread_cond_signal(&wal->append_cond);
+    pthread_mutex_unlock(&wal->mutex);
+
+    pthread_join(wal->thread, NULL);
+
+    close(wal->fd);
+    free(wal->buffer);
+    pthread_mutex_destroy(&wal->mutex);
+    pthread_cond_destroy(&wal->append_cond);
+    pthread_cond_destroy(&wal->durable_cond);
+}
@@ -0,0 +1,108 @@
+#ifndef WRITE_AHEAD_LOG_H
+#define WRITE_AHEAD_LOG_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+/**
+ * An append-only log of the alarm requests that were accepted into the alarm
+ * list, so that they can be replayed after a restart.
+ *
+ * Records are appended to a buffer in memory, and a sync thread writes the
+ * buffer to the file and syncs it (with fdatasync). Every record gets a log
+ * sequence number (LSN), and a record is durable once a sync that includes it
+ * has finished. The sync thread syncs once the oldest record that is not
+ * durable yet has waited for the sync interval, or once the sync count of
+ * records are waiting, whichever comes first. Everything appended in the
+ * meantime goes out in the same sync (group commit), so durability costs one
+ * sync per group rather than one per request.
+ *
+ * Each record has a checksum, so a record that was torn by a crash in the
+ * middle of a write is found when the log is opened. It is cut off, along
+ * with everything after it.
+ */
+typedef struct write_ahead_log_t {
+    int fd;
+    int sync_interval;              // In milliseconds (0 to sync as soon as
+                                    // there is something to sync).
+    unsigned long sync_count;       // Records waiting that make the sync
+                                    // thread sync before the interval is up.
+
+    pthread_mutex_t mutex;          // Protects the fields below.
+    pthread_cond_t append_cond;     // Signalled when the sync thread may have
+                                    // something to do.
+    pthread_cond_t durable_cond;    // Signalled after every sync.
+    char *buffer;                   // Records not handed to the sync thread.
+    size_t length;
+    size_t capacity;
+    struct timespec oldest_append_time; // Of the oldest record in the buffer.
+    unsigned long appended_lsn;     // LSN of the last record appended.
+    unsigned long written_lsn;      // LSN of the last record handed to the
+                                    // sync thread.
+    unsigned long durable_lsn;      // LSN of the last record synced.
+    unsigned long syncs;            // Number of syncs so far.
+    bool closing;                   // Set by wal_close.
+
+    pthread_t thread;
+} write_ahead_log_t;
+
+/**
+ * Called for every record of the log when it is opened, in the order they
+ * were appended, with a new alarm request (allocated from the alarm request
+ * pool) that holds the record. The handler owns the alarm request.
+ */
+typedef void (*wal_replay_handler_t)(alarm_request_t *alarm_request, void *arg);
+
+/**
+ * Opens the log at the given path (creating it if it does not exist), passes
+ * each of its records to the replay handler, and starts the sync thread.
+ * Returns the number of records replayed.
+ *
+ * A torn record at the end of the log is cut off, with a message to standard
+ * error. A file that is not a log of this version is an error.
+ */
+unsigned long wal_open(
+    write_ahead_log_t *wal,
+    const char *path,
+    int sync_interval,
+    unsigned long sync_count,
+    wal_replay_handler_t replay_handler,
+    void *arg
+);
+
+/**
+ * Appends an alarm request (its type, alarm ID, time and message) to the log
+ * and returns its LSN. The records are replayed in the order they were
+ * appended in, so appends that must stay in order (such as requests to the
+ * alarm list) must be serialized by the caller.
+ */
+unsigned long wal_append(write_ahead_log_t *wal, alarm_request_t *alarm_request);
+
+/**
+ * Waits until the record with the given LSN (and every record before it) is
+ * durable.
+ */
+void wal_wait_durable(write_ahead_log_t *wal, unsigned long lsn);
+
+/**
+ * Waits until every record appended so far is durable, and then removes all
+ * the records from the log. Used once the alarm list has been saved some other
+ * way (see Checkpoint.h), so the records are not needed to rebuild it. Nothing
+ * may be appended to the log at the same time.
+ */
+void wal_truncate(write_ahead_log_t *wal);
+
+/**
+ * Returns the number of syncs so far.
+ */
+unsigned long wal_number_of_syncs(write_ahead_log_t *wal);
+
+/**
+ * Syncs every record appended so far, stops the sync thread and closes the
+ * log. Nothing may be appended to the log while or after it is closed.
+ */
+void wal_close(write_ahead_log_t *wal);
+
+#endif
@@ -0,0 +1,154 @@
+/*
+ * Alarm_List_Benchmark.c
+ *
+ * Measures how long it takes to look up, cancel and change one alarm in an
+ * alarm list, for lists of increasing size. With the alarm ID index, the time
+ * per operation should stay about the same however many alarms are in the
+ * list.
+ *
+ * Every operation works the way the main thread and the alarm thread use the
+ * list: a Cancel_Alarm or Change_Alarm request is inserted with the next
+ * sequence number, then the older requests for the same alarm ID are removed.
+ *
+ * Build and run with:
+ *
+ *   make alarm_list_benchmark
+ */
+#include <pthread.h>
+#include <time.h>
+#include "errors.h"
+#include "types.h"
+#include "Alarm_List.h"
+#include "Alarm_Request.h"
+
+#define NUMBER_OF_TIME_VALUES 16
+#define OPERATIONS_PER_SIZE 100000
+#define SEED 3221
+
+static unsigned long last_sequence_number = 0;
+
+static double now_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static alarm_request_t *new_alarm_request(request_type type, int alarm_id, int time) {
+    alarm_request_t *alarm_request = allocate_alarm_request();
+
+    memset(alarm_request, 0, sizeof(alarm_request_t));
+
+    alarm_request->type = type;
+    alarm_request->alarm_id = alarm_id;
+    alarm_request->time = time;
+    alarm_request->sequence_number = ++last_sequence_number;
+    alarm_request->message = message_intern("benchmark", strlen("benchmark"));
+
+    return alarm_request;
+}
+
+/**
+ * Runs the benchmark on a list with the given number of alarms and prints the
+ * average time of each operation in nanoseconds.
+ */
+static void run(int number_of_alarms) {
+    alarm_list_t list;
+    alarm_request_t *alarm_request;
+    double start;
+    double lookup_time;
+    double change_time;
+    double cancel_time;
+    int alarm_id;
+    volatile int found = 0;
+
+    alarm_list_init(&list);
+    srand(SEED);
+
+    for (int i = 0; i < number_of_alarms; i++) {
+        insert_to_alarm_list(
+            &list,
+            new_alarm_request(Start_Alarm, i, 1 + rand() % NUMBER_OF_TIME_VALUES)
+        );
+    }
+
+    /*
+     * Lookup: find the newest request for a random alarm ID.
+     */
+    start = now_seconds();
+    for (int i = 0; i < OPERATIONS_PER_SIZE; i++) {
+        found += find_newest_alarm_request(&list, rand() % number_of_alarms) != NULL;
+    }
+    lookup_time = (now_seconds() - start) / OPERATIONS_PER_SIZE;
+
+    /*
+     * Change: insert a Change_Alarm request with a new time value, then
+     * remove the older requests for that alarm ID.
+     */
+    start = now_seconds();
+    for (int i = 0; i < OPERATIONS_PER_SIZE; i++) {
+        alarm_id = rand() % number_of_alarms;
+        alarm_request = new_alarm_request(
+            Change_Alarm,
+            alarm_id,
+            1 + rand() % NUMBER_OF_TIME_VALUES
+        );
+        insert_to_alarm_list(&list, alarm_request);
+        remove_old_alarm_requests_from_list(&list, alarm_id, alarm_request);
+    }
+    change_time = (now_seconds() - start) / OPERATIONS_PER_SIZE;
+
+    /*
+     * Cancel: insert a Cancel_Alarm request and remove every request for that
+     * alarm ID, then start the alarm again so the list keeps its size.
+     */
+    start = now_seconds();
+    for (int i = 0; i < OPERATIONS_PER_SIZE; i++) {
+        alarm_id = rand() % number_of_alarms;
+        alarm_request = find_newest_alarm_request(&list, alarm_id);
+        alarm_request = new_alarm_request(Cancel_Alarm, alarm_id, alarm_request->time);
+        insert_to_alarm_list(&list, alarm_request);
+        remove_alarm_requests_from_list(&list, alarm_request);
+
+        insert_to_alarm_list(
+            &list,
+            new_alarm_request(Start_Alarm, alarm_id, 1 + rand() % NUMBER_OF_TIME_VALUES)
+        );
+    }
+    cancel_time = (now_seconds() - start) / OPERATIONS_PER_SIZE;
+
+    if (found != OPERATIONS_PER_SIZE || list.length != (size_t) number_of_alarms) {
+        fprintf(stderr, "List is inconsistent after %d alarms\n", number_of_alarms);
+        exit(1);
+    }
+
+    printf("%10d %14.1f %14.1f %14.1f\n",
+           number_of_alarms, lookup_time * 1e9, change_time * 1e9, cancel_time * 1e9);
+
+    /*
+     * Free the list
+     */
+    while (list.header.next != NULL) {
+        alarm_request = list.header.next;
+        unlink_from_alarm_list(&list, alarm_request);
+        free_alarm_request(alarm_request);
+    }
+    free(list.id_buckets);
+    free(list.time_buckets);
+}
+
+int main(int argc, char *argv[]) {
+    static const int sizes[] = {1000, 10000, 100000, 1000000};
+
+    alarm_request_pool_init();
+
+    printf("%d time values, %d operations per size (seed %d)\n",
+           NUMBER_OF_TIME_VALUES, OPERATIONS_PER_SIZE, SEED);
+    printf("%10s %14s %14s %14s\n",
+           "alarms", "lookup ns/op", "change ns/op", "cancel ns/op");
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        run(sizes[i]);
+    }
+
+    return 0;
+}
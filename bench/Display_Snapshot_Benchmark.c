@@ -0,0 +1,292 @@
+/*
+ * Display_Snapshot_Benchmark.c
+ *
+ * Measures how fast periodic displays can search and scan a snapshot of the
+ * alarm display list, and how much memory the alarms and the snapshot take,
+ * with 1,000,000 alarms.
+ *
+ * Each measurement is done twice: once on the compact arrays of the snapshot
+ * (sequence numbers and the alarm ID table with the IDs in it), and once the
+ * way snapshots were read before they had them, by following a pointer to the
+ * alarm request for every entry that is looked at. The alarm requests are
+ * allocated in insertion order, and the snapshot is sorted by time value, so
+ * consecutive entries of a bucket point all over the pool, as they do in the
+ * program.
+ *
+ * Build and run with:
+ *
+ *   make display_snapshot_benchmark
+ */
+#include <pthread.h>
+#include <stdalign.h>
+#include <stddef.h>
+#include <time.h>
+#include "errors.h"
+#include "types.h"
+#include "Hash.h"
+#include "Alarm_List.h"
+#include "Alarm_Request.h"
+#include "Display_Snapshot.h"
+
+#define NUMBER_OF_ALARMS 1000000
+#define NUMBER_OF_TIME_VALUES 1000
+#define NUMBER_OF_LOOKUPS 1000000
+#define REPETITIONS 10
+#define SEED 3221
+
+/**
+ * The layout of alarm_request_t before its hot fields were moved to the front,
+ * only used for its size.
+ */
+typedef struct old_alarm_request_t {
+    int alarm_id;
+    request_type type;
+    int time;
+    message_t *message;
+    time_t creation_time;
+    unsigned long sequence_number;
+    struct alarm_request_t *next;
+    struct alarm_request_t *prev;
+    struct alarm_request_t *id_hash_next;
+    struct alarm_request_t *id_hash_prev;
+    struct alarm_request_t *queue_next;
+    atomic_bool change_status;
+} old_alarm_request_t;
+
+/**
+ * The layout of display_bucket_t before the time values of the buckets were
+ * moved to an array of their own, only used for its size.
+ */
+typedef struct old_display_bucket_t {
+    int time;
+    size_t first;
+    size_t length;
+    unsigned long version;
+} old_display_bucket_t;
+
+/**
+ * Returns how many bytes an object of the given size takes in an object pool,
+ * which rounds sizes up to the strictest alignment.
+ */
+static size_t pool_object_size(size_t size) {
+    return (size + alignof(max_align_t) - 1) / alignof(max_align_t) * alignof(max_align_t);
+}
+
+static double now_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/*******************************************************************************
+ *                     REFERENCE (POINTER) SNAPSHOT READS                      *
+ ******************************************************************************/
+
+/**
+ * The alarm ID table of a snapshot before it had compact entries: a table of
+ * pointers to the alarm requests, built from the snapshot's alarm requests.
+ */
+typedef struct pointer_id_table_t {
+    alarm_request_t **entries;
+    size_t size;
+} pointer_id_table_t;
+
+static pointer_id_table_t build_pointer_id_table(display_snapshot_t *snapshot) {
+    pointer_id_table_t table = {NULL, snapshot->id_table_size};
+    alarm_request_t *alarm_request;
+    size_t bucket;
+
+    table.entries = calloc(table.size, sizeof(alarm_request_t *));
+    if (table.entries == NULL) {
+        errno_abort("Calloc failed");
+    }
+
+    for (size_t i = 0; i < snapshot->length; i++) {
+        alarm_request = snapshot->alarm_requests[i];
+        bucket = hash_key(alarm_request->alarm_id, table.size);
+        while (table.entries[bucket] != NULL
+               && table.entries[bucket]->alarm_id != alarm_request->alarm_id) {
+            bucket = (bucket + 1) & (table.size - 1);
+        }
+        table.entries[bucket] = alarm_request;
+    }
+
+    return table;
+}
+
+static alarm_request_t *find_in_pointer_id_table(pointer_id_table_t *table, int alarm_id) {
+    size_t bucket = hash_key(alarm_id, table->size);
+
+    while (table->entries[bucket] != NULL) {
+        if (table->entries[bucket]->alarm_id == alarm_id) {
+            return table->entries[bucket];
+        }
+        bucket = (bucket + 1) & (table->size - 1);
+    }
+
+    return NULL;
+}
+
+/**
+ * Counts the alarm requests in every bucket that are newer than the given
+ * sequence number, reading each sequence number through its alarm request.
+ */
+static size_t scan_buckets_through_pointers(
+    display_snapshot_t *snapshot,
+    unsigned long sequence_number
+) {
+    size_t newer = 0;
+
+    for (size_t i = 0; i < snapshot->number_of_buckets; i++) {
+        display_bucket_t *bucket = &snapshot->buckets[i];
+
+        for (size_t j = bucket->first; j < bucket->first + bucket->length; j++) {
+            newer += snapshot->alarm_requests[j]->sequence_number > sequence_number;
+        }
+    }
+
+    return newer;
+}
+
+/*******************************************************************************
+ *                         COMPACT SNAPSHOT READS                              *
+ ******************************************************************************/
+
+/**
+ * Same as scan_buckets_through_pointers, but reads the snapshot's array of
+ * sequence numbers.
+ */
+static size_t scan_buckets(display_snapshot_t *snapshot, unsigned long sequence_number) {
+    size_t newer = 0;
+
+    for (size_t i = 0; i < snapshot->number_of_buckets; i++) {
+        display_bucket_t *bucket = &snapshot->buckets[i];
+
+        for (size_t j = bucket->first; j < bucket->first + bucket->length; j++) {
+            newer += snapshot->sequence_numbers[j] > sequence_number;
+        }
+    }
+
+    return newer;
+}
+
+/*******************************************************************************
+ *                                BENCHMARK                                    *
+ ******************************************************************************/
+
+int main(int argc, char *argv[]) {
+    alarm_list_t list;
+    alarm_request_t *alarm_request;
+    display_snapshot_t *snapshot;
+    pointer_id_table_t pointer_id_table;
+    unsigned long last_bucket_version = 0;
+    unsigned long newest_sequence_number = 0;
+    int *lookup_ids;
+    size_t pointer_scan_count = 0;
+    size_t compact_scan_count = 0;
+    size_t pointer_found = 0;
+    size_t compact_found = 0;
+    double start;
+    double pointer_scan_time;
+    double compact_scan_time;
+    double pointer_lookup_time;
+    double compact_lookup_time;
+    double old_bytes;
+    double new_bytes;
+
+    alarm_request_pool_init();
+    alarm_list_init(&list);
+    srand(SEED);
+
+    for (int i = 0; i < NUMBER_OF_ALARMS; i++) {
+        alarm_request = allocate_alarm_request();
+        memset(alarm_request, 0, sizeof(alarm_request_t));
+        alarm_request->type = Start_Alarm;
+        alarm_request->alarm_id = i;
+        alarm_request->time = 1 + rand() % NUMBER_OF_TIME_VALUES;
+        alarm_request->sequence_number = i + 1;
+        alarm_request->message = message_intern("benchmark", strlen("benchmark"));
+        insert_to_alarm_list(&list, alarm_request);
+    }
+
+    snapshot = build_display_snapshot(
+        &list,
+        NULL,
+        &last_bucket_version,
+        &newest_sequence_number
+    );
+    pointer_id_table = build_pointer_id_table(snapshot);
+
+    lookup_ids = malloc(NUMBER_OF_LOOKUPS * sizeof(int));
+    if (lookup_ids == NULL) {
+        errno_abort("Malloc failed");
+    }
+    for (int i = 0; i < NUMBER_OF_LOOKUPS; i++) {
+        lookup_ids[i] = rand() % NUMBER_OF_ALARMS;
+    }
+
+    /*
+     * Bucket scans: how many alarms of each bucket are newer than the ones
+     * inserted in the first half.
+     */
+    start = now_seconds();
+    for (int repetition = 0; repetition < REPETITIONS; repetition++) {
+        pointer_scan_count += scan_buckets_through_pointers(snapshot, NUMBER_OF_ALARMS / 2);
+    }
+    pointer_scan_time = (now_seconds() - start) / REPETITIONS;
+
+    start = now_seconds();
+    for (int repetition = 0; repetition < REPETITIONS; repetition++) {
+        compact_scan_count += scan_buckets(snapshot, NUMBER_OF_ALARMS / 2);
+    }
+    compact_scan_time = (now_seconds() - start) / REPETITIONS;
+
+    /*
+     * Alarm ID lookups.
+     */
+    start = now_seconds();
+    for (int i = 0; i < NUMBER_OF_LOOKUPS; i++) {
+        pointer_found += find_in_pointer_id_table(&pointer_id_table, lookup_ids[i]) != NULL;
+    }
+    pointer_lookup_time = (now_seconds() - start) / NUMBER_OF_LOOKUPS;
+
+    start = now_seconds();
+    for (int i = 0; i < NUMBER_OF_LOOKUPS; i++) {
+        compact_found += find_in_display_snapshot(snapshot, lookup_ids[i]) != NULL;
+    }
+    compact_lookup_time = (now_seconds() - start) / NUMBER_OF_LOOKUPS;
+
+    if (pointer_scan_count != compact_scan_count
+        || pointer_found != NUMBER_OF_LOOKUPS
+        || compact_found != NUMBER_OF_LOOKUPS) {
+        fprintf(stderr, "The two ways of reading the snapshot disagree\n");
+        return 1;
+    }
+
+    /*
+     * Memory per alarm: the alarm request and its share of the snapshot.
+     * Before, the snapshot had an array of pointers, a table of pointers and
+     * buckets that held their time value.
+     */
+    old_bytes = pool_object_size(sizeof(old_alarm_request_t))
+        + (double) (NUMBER_OF_ALARMS * sizeof(alarm_request_t *)
+                    + snapshot->id_table_size * sizeof(alarm_request_t *)
+                    + NUMBER_OF_ALARMS * sizeof(old_display_bucket_t))
+          / NUMBER_OF_ALARMS;
+    new_bytes = pool_object_size(sizeof(alarm_request_t)) + (double) snapshot->size / NUMBER_OF_ALARMS;
+
+    printf("%d alarms, %d time values, %d lookups (seed %d)\n",
+           NUMBER_OF_ALARMS, NUMBER_OF_TIME_VALUES, NUMBER_OF_LOOKUPS, SEED);
+    printf("%-28s %14s %14s\n", "", "pointers", "compact");
+    printf("%-28s %14.1f %14.1f\n", "bucket scan (M alarms/s)",
+           NUMBER_OF_ALARMS / pointer_scan_time / 1e6,
+           NUMBER_OF_ALARMS / compact_scan_time / 1e6);
+    printf("%-28s %14.1f %14.1f\n", "alarm ID lookup (ns)",
+           pointer_lookup_time * 1e9, compact_lookup_time * 1e9);
+    printf("%-28s %14zu %14zu\n", "alarm request in pool (bytes)",
+           pool_object_size(sizeof(old_alarm_request_t)),
+           pool_object_size(sizeof(alarm_request_t)));
+    printf("%-28s %14.1f %14.1f\n", "total per alarm (bytes)", old_bytes, new_bytes);
+
+    return 0;
+}
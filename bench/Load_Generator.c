@@ -0,0 +1,895 @@
+/*
+ * Load_Generator.c
+ *
+ * Drives the real program (a.out) with a steady stream of Start_Alarm,
+ * Change_Alarm and Cancel_Alarm commands, and measures how long each command
+ * takes to get through each stage of the pipeline:
+ *
+ *   main      "Main Thread has Inserted ..." (parsed and in the alarm list)
+ *   consumer  "Consumer Thread ... into Alarm Display List" (or, for
+ *             Cancel_Alarm, "Consumer Thread ... Has Cancelled ...")
+ *   display   the first line a periodic display prints for the alarm request
+ *             (Start_Alarm and Change_Alarm only)
+ *
+ * Latencies are measured from the time each command was due to be sent, not
+ * from when it was actually written, so that when the program falls behind
+ * and the pipe to it fills up, the time the commands waited to be written is
+ * counted too. Output lines are timestamped when the generator reads them.
+ *
+ * If the program falls so far behind that the commands of a run have not all
+ * been written after twice the run's duration, the rest are not sent. Output
+ * lines longer than OUTPUT_LINE_SIZE (the alarm list and circular buffer
+ * dumps) are skipped after their first OUTPUT_LINE_SIZE bytes.
+ *
+ * Every Start_Alarm and Change_Alarm command has a message of its own
+ * ("lg<number of the command>"), which is how its output lines are matched to
+ * it. Cancel_Alarm lines are matched by alarm ID, in order.
+ *
+ * The whole run is repeated for every combination of command rate and number
+ * of consumer threads, so the table shows where throughput stops following
+ * the offered rate (the pipeline is saturated) and how far more consumers
+ * move that point.
+ *
+ * Build and run with:
+ *
+ *   make load_generator
+ *
+ * or run ./load_generator --help for the options.
+ */
+#include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <time.h>
+#include "errors.h"
+#include "types.h"
+#include "Alarm_Request.h"
+#include "Command_Parser.h"
+
+#define MAXIMUM_LIST_LENGTH 16
+#define OUTPUT_LINE_SIZE 4096
+#define COMMAND_SIZE 64
+#define WRITE_INTERVAL_NANOSECONDS 1000000
+
+/**
+ * The stages of the pipeline that a command's latency is measured to.
+ */
+typedef enum load_stage {
+    Main_Stage,
+    Consumer_Stage,
+    Display_Stage,
+    NUMBER_OF_STAGES
+} load_stage;
+
+static const char *stage_names[NUMBER_OF_STAGES] = {"main", "consumer", "display"};
+
+/**
+ * One command of a run. The commands of a run are generated before the
+ * program is started, so the reader thread only writes the stage times.
+ */
+typedef struct load_command_t {
+    request_type type;
+    int alarm_id;
+    int period;                         // Index in the list of periods.
+    int next_cancel;                    // Next Cancel_Alarm command for the
+                                        // same alarm ID, or -1.
+    double stage_times[NUMBER_OF_STAGES]; // When the stage's line was read
+                                          // (ns), or 0 if it was not.
+} load_command_t;
+
+/**
+ * The settings of the generator, from the command line.
+ */
+typedef struct load_settings_t {
+    const char *program;
+    long rates[MAXIMUM_LIST_LENGTH];    // Commands per second.
+    int number_of_rates;
+    long consumers[MAXIMUM_LIST_LENGTH];
+    int number_of_consumers;
+    const char *periods[MAXIMUM_LIST_LENGTH]; // As written in commands.
+    int period_milliseconds[MAXIMUM_LIST_LENGTH];
+    int number_of_periods;
+    int number_of_alarms;               // Alarm IDs 0 to number_of_alarms - 1.
+    int mix[3];                         // Weights of Start, Change and Cancel.
+    double duration;                    // Seconds of commands per run.
+    const char *buffer_capacity;        // Passed on with -c, or NULL.
+    bool timing_wheel;
+    unsigned int seed;
+    const char *output;                 // JSON results file, or NULL.
+} load_settings_t;
+
+/**
+ * Latency percentiles of one stage of a run, in milliseconds.
+ */
+typedef struct stage_result_t {
+    size_t count;
+    double p50;
+    double p90;
+    double p99;
+    double max;
+} stage_result_t;
+
+/**
+ * The result of one run.
+ */
+typedef struct run_result_t {
+    long rate;
+    long consumers;
+    size_t commands;                    // Commands sent.
+    double throughput;                  // Commands per second through the
+                                        // consumer stage.
+    stage_result_t stages[NUMBER_OF_STAGES];
+} run_result_t;
+
+/**
+ * The state of one run, shared by the writer (main thread) and the reader
+ * thread.
+ */
+typedef struct load_run_t {
+    load_command_t *commands;
+    size_t number_of_commands;
+    size_t number_sent;
+    int *main_cancels;                  // Next Cancel_Alarm command of each
+    int *consumer_cancels;              // alarm ID to reach each stage.
+    FILE *output;                       // The program's standard output.
+} load_run_t;
+
+/*******************************************************************************
+ *                           HELPER FUNCTIONS                                  *
+ ******************************************************************************/
+
+static double now_nanoseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+static void sleep_until_nanoseconds(double deadline) {
+    struct timespec time;
+
+    time.tv_sec = (time_t) (deadline / 1e9);
+    time.tv_nsec = (long) (deadline - time.tv_sec * 1e9);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &time, NULL) == EINTR) {
+    }
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * Returns the given percentile of sorted values (nearest rank).
+ */
+static double percentile(double *sorted, size_t count, double fraction) {
+    size_t rank = (size_t) (fraction * count + 0.999999);
+
+    if (rank < 1) {
+        rank = 1;
+    }
+
+    return sorted[rank - 1];
+}
+
+/**
+ * Parses a comma-separated list of positive numbers. Returns the number of
+ * numbers, or -1 if the list is not valid.
+ */
+static int parse_number_list(char *text, long numbers[]) {
+    int count = 0;
+    char *end;
+
+    for (char *item = strtok(text, ","); item != NULL; item = strtok(NULL, ",")) {
+        if (count == MAXIMUM_LIST_LENGTH) {
+            return -1;
+        }
+        numbers[count] = strtol(item, &end, 10);
+        if (*end != '\0' || numbers[count] < 1) {
+            return -1;
+        }
+        count++;
+    }
+
+    return count > 0 ? count : -1;
+}
+
+/**
+ * Parses a comma-separated list of periods (times as the program accepts
+ * them, e.g. "250ms" or "2"). The program's own parser gives their values.
+ * Returns the number of periods, or -1 if the list is not valid.
+ */
+static int parse_period_list(char *text, load_settings_t *settings) {
+    char command[COMMAND_SIZE];
+    alarm_request_t *alarm_request;
+    int count = 0;
+
+    for (char *item = strtok(text, ","); item != NULL; item = strtok(NULL, ",")) {
+        if (count == MAXIMUM_LIST_LENGTH) {
+            return -1;
+        }
+        snprintf(command, COMMAND_SIZE, "Start_Alarm(1): %s period", item);
+        alarm_request = parse_request(command);
+        if (alarm_request == NULL) {
+            return -1;
+        }
+        settings->periods[count] = item;
+        settings->period_milliseconds[count] = alarm_request->time;
+        free_alarm_request(alarm_request);
+        count++;
+    }
+
+    return count > 0 ? count : -1;
+}
+
+/**
+ * Returns a number from 0 to limit - 1 (rand_r, so that runs do not depend on
+ * anything else that uses rand).
+ */
+static int random_below(unsigned int *seed, int limit) {
+    return rand_r(seed) % limit;
+}
+
+/**
+ * Returns the ID of a random alarm that exists (or does not exist, depending on
+ * the argument), or -1 if none was found after a few tries.
+ */
+static int random_alarm_id(
+    unsigned int *seed,
+    const bool *exists,
+    int number_of_alarms,
+    bool existing
+) {
+    int alarm_id;
+
+    for (int attempt = 0; attempt < 16; attempt++) {
+        alarm_id = random_below(seed, number_of_alarms);
+        if (exists[alarm_id] == existing) {
+            return alarm_id;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * Returns the number of the command whose message is in an output line
+ * ("lg<number>" after "= "), or -1 if there is none.
+ */
+static long command_in_line(const char *line) {
+    const char *message = strstr(line, "= lg");
+
+    if (message == NULL) {
+        return -1;
+    }
+
+    return strtol(message + strlen("= lg"), NULL, 10);
+}
+
+/**
+ * Returns the alarm ID that follows the given text in an output line, or -1
+ * if the text is not there.
+ */
+static int alarm_id_after(const char *line, const char *text) {
+    const char *position = strstr(line, text);
+
+    if (position == NULL) {
+        return -1;
+    }
+
+    return (int) strtol(position + strlen(text), NULL, 10);
+}
+
+/*******************************************************************************
+ *                                  RUNS                                       *
+ ******************************************************************************/
+
+/**
+ * Generates the commands of a run: a random mix of commands with the given
+ * weights, each for an alarm ID it is valid for (Start_Alarm for an alarm
+ * that does not exist, the others for one that does), so the program accepts
+ * all of them.
+ */
+static void generate_commands(load_run_t *run, load_settings_t *settings) {
+    bool *exists = calloc(settings->number_of_alarms, sizeof(bool));
+    int *last_cancel = malloc(settings->number_of_alarms * sizeof(int));
+    int total_weight = settings->mix[0] + settings->mix[1] + settings->mix[2];
+    unsigned int seed = settings->seed;
+    load_command_t *command;
+    int weight;
+
+    if (exists == NULL || last_cancel == NULL) {
+        errno_abort("Allocation failed");
+    }
+    for (int i = 0; i < settings->number_of_alarms; i++) {
+        last_cancel[i] = -1;
+        run->main_cancels[i] = -1;
+        run->consumer_cancels[i] = -1;
+    }
+
+    for (size_t i = 0; i < run->number_of_commands; i++) {
+        command = &run->commands[i];
+        memset(command, 0, sizeof(load_command_t));
+        command->next_cancel = -1;
+        command->period = random_below(&seed, settings->number_of_periods);
+
+        weight = random_below(&seed, total_weight);
+        command->type = weight < settings->mix[0] ? Start_Alarm
+            : weight < settings->mix[0] + settings->mix[1] ? Change_Alarm
+            : Cancel_Alarm;
+
+        command->alarm_id = random_alarm_id(
+            &seed,
+            exists,
+            settings->number_of_alarms,
+            command->type != Start_Alarm
+        );
+
+        /*
+         * If there is no alarm the command is valid for, start or change one
+         * instead.
+         */
+        if (command->alarm_id == -1) {
+            command->type = command->type == Start_Alarm ? Change_Alarm : Start_Alarm;
+            command->alarm_id = random_alarm_id(
+                &seed,
+                exists,
+                settings->number_of_alarms,
+                command->type != Start_Alarm
+            );
+        }
+        if (command->alarm_id == -1) {
+            fprintf(stderr, "Could not find an alarm ID; use more alarm IDs\n");
+            exit(1);
+        }
+
+        exists[command->alarm_id] = command->type != Cancel_Alarm;
+
+        if (command->type == Cancel_Alarm) {
+            if (last_cancel[command->alarm_id] == -1) {
+                run->main_cancels[command->alarm_id] = (int) i;
+                run->consumer_cancels[command->alarm_id] = (int) i;
+            } else {
+                run->commands[last_cancel[command->alarm_id]].next_cancel = (int) i;
+            }
+            last_cancel[command->alarm_id] = (int) i;
+        }
+    }
+
+    free(exists);
+    free(last_cancel);
+}
+
+/**
+ * Records that a command reached a stage, unless it already had.
+ */
+static void record_stage(load_run_t *run, long number, load_stage stage, double time) {
+    if (number >= 0 && (size_t) number < run->number_of_commands
+        && run->commands[number].stage_times[stage] == 0) {
+        run->commands[number].stage_times[stage] = time;
+    }
+}
+
+/**
+ * Records that the next Cancel_Alarm command of an alarm ID reached a stage.
+ */
+static void record_cancel_stage(load_run_t *run, int *cancels, int alarm_id, load_stage stage, double time) {
+    if (alarm_id < 0 || cancels[alarm_id] == -1) {
+        return;
+    }
+
+    record_stage(run, cancels[alarm_id], stage, time);
+    cancels[alarm_id] = run->commands[cancels[alarm_id]].next_cancel;
+}
+
+/**
+ * Reads the program's output until it ends, timestamping the lines of each
+ * stage of each command.
+ */
+static void *reader_routine(void *arg) {
+    load_run_t *run = arg;
+    char line[OUTPUT_LINE_SIZE];
+    bool continuation = false;          // Whether the line is the rest of a
+                                        // line that was too long.
+    double time;
+
+    while (fgets(line, OUTPUT_LINE_SIZE, run->output) != NULL) {
+        time = now_nanoseconds();
+
+        if (continuation) {
+            continuation = strchr(line, '\n') == NULL;
+            continue;
+        }
+        continuation = strchr(line, '\n') == NULL;
+
+        if (strncmp(line, "Main Thread has Inserted", strlen("Main Thread has Inserted")) == 0) {
+            /*
+             * A Cancel_Alarm request has the message of the alarm it cancels.
+             */
+            if (strstr(line, "Cancel_Alarm Request(") != NULL) {
+                record_cancel_stage(
+                    run,
+                    run->main_cancels,
+                    alarm_id_after(line, "Cancel_Alarm Request("),
+                    Main_Stage,
+                    time
+                );
+            } else {
+                record_stage(run, command_in_line(line), Main_Stage, time);
+            }
+        } else if (strncmp(line, "Consumer Thread", strlen("Consumer Thread")) == 0) {
+            if (strstr(line, "Has Cancelled") != NULL) {
+                record_cancel_stage(
+                    run,
+                    run->consumer_cancels,
+                    alarm_id_after(line, "Alarm ID ("),
+                    Consumer_Stage,
+                    time
+                );
+            } else if (strstr(line, "into Alarm Display List") != NULL) {
+                record_stage(run, command_in_line(line), Consumer_Stage, time);
+            }
+        } else if (strncmp(line, "ALARM MESSAGE", strlen("ALARM MESSAGE")) == 0
+                   || strstr(line, "Has Taken Over Printing") != NULL
+                   || strstr(line, "Starting to Print Changed Message") != NULL) {
+            record_stage(run, command_in_line(line), Display_Stage, time);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Starts the program with the given number of consumers, with pipes to its
+ * standard input and from its standard output.
+ */
+static pid_t start_program(load_settings_t *settings, long consumers, int *input, FILE **output) {
+    int input_pipe[2];
+    int output_pipe[2];
+    char consumer_argument[32];
+    const char *arguments[16];
+    int number_of_arguments = 0;
+    pid_t pid;
+
+    if (pipe(input_pipe) != 0 || pipe(output_pipe) != 0) {
+        errno_abort("Pipe failed");
+    }
+
+    snprintf(consumer_argument, sizeof(consumer_argument), "%ld", consumers);
+    arguments[number_of_arguments++] = settings->program;
+    arguments[number_of_arguments++] = "-b";
+    arguments[number_of_arguments++] = "-n";
+    arguments[number_of_arguments++] = consumer_argument;
+    if (settings->timing_wheel) {
+        arguments[number_of_arguments++] = "-w";
+    }
+    if (settings->buffer_capacity != NULL) {
+        arguments[number_of_arguments++] = "-c";
+        arguments[number_of_arguments++] = settings->buffer_capacity;
+    }
+    arguments[number_of_arguments] = NULL;
+
+    pid = fork();
+    if (pid < 0) {
+        errno_abort("Fork failed");
+    }
+
+    if (pid == 0) {
+        dup2(input_pipe[0], STDIN_FILENO);
+        dup2(output_pipe[1], STDOUT_FILENO);
+        close(input_pipe[0]);
+        close(input_pipe[1]);
+        close(output_pipe[0]);
+        close(output_pipe[1]);
+        execv(settings->program, (char **) arguments);
+        errno_abort("Exec failed");
+    }
+
+    close(input_pipe[0]);
+    close(output_pipe[1]);
+    *input = input_pipe[1];
+    *output = fdopen(output_pipe[0], "r");
+    if (*output == NULL) {
+        errno_abort("Fdopen failed");
+    }
+
+    return pid;
+}
+
+/**
+ * Writes the commands to the program, each at the time it is due (in groups,
+ * every WRITE_INTERVAL_NANOSECONDS), until they have all been written or
+ * twice the run's duration has passed. Returns the time the first one was due.
+ */
+static double write_commands(load_run_t *run, load_settings_t *settings, long rate, int input) {
+    size_t buffer_size = (size_t) (rate / 1000 + 1) * COMMAND_SIZE + COMMAND_SIZE;
+    char *buffer = malloc(buffer_size);
+    double interval = 1e9 / rate;
+    double start = now_nanoseconds();
+    double end = start + 2e9 * settings->duration;
+    double now;
+    size_t next = 0;
+    size_t length;
+    load_command_t *command;
+
+    if (buffer == NULL) {
+        errno_abort("Malloc failed");
+    }
+
+    while (next < run->number_of_commands) {
+        now = now_nanoseconds();
+        if (now > end) {
+            break;
+        }
+        length = 0;
+
+        while (next < run->number_of_commands
+               && start + next * interval <= now
+               && length + COMMAND_SIZE <= buffer_size) {
+            command = &run->commands[next];
+            if (command->type == Cancel_Alarm) {
+                length += snprintf(buffer + length, COMMAND_SIZE,
+                                   "Cancel_Alarm(%d)\n", command->alarm_id);
+            } else {
+                length += snprintf(buffer + length, COMMAND_SIZE, "%s(%d): %s lg%zu\n",
+                                   command->type == Start_Alarm ? "Start_Alarm" : "Change_Alarm",
+                                   command->alarm_id,
+                                   settings->periods[command->period],
+                                   next);
+            }
+            next++;
+        }
+
+        for (size_t written = 0; written < length; ) {
+            ssize_t count = write(input, buffer + written, length - written);
+            if (count < 0) {
+                errno_abort("Write to program failed");
+            }
+            written += count;
+        }
+
+        if (next < run->number_of_commands && start + next * interval > now) {
+            sleep_until_nanoseconds(now + WRITE_INTERVAL_NANOSECONDS);
+        }
+    }
+
+    free(buffer);
+    run->number_sent = next;
+
+    return start;
+}
+
+/**
+ * Computes the latency percentiles of one stage, in milliseconds from the
+ * time each command was due.
+ */
+static stage_result_t stage_result(
+    load_run_t *run,
+    load_stage stage,
+    double start,
+    double interval,
+    double *latencies
+) {
+    stage_result_t result = {0, 0, 0, 0, 0};
+    load_command_t *command;
+
+    for (size_t i = 0; i < run->number_sent; i++) {
+        command = &run->commands[i];
+        if (command->stage_times[stage] != 0) {
+            latencies[result.count++] =
+                (command->stage_times[stage] - (start + i * interval)) / 1e6;
+        }
+    }
+
+    if (result.count > 0) {
+        qsort(latencies, result.count, sizeof(double), compare_doubles);
+        result.p50 = percentile(latencies, result.count, 0.50);
+        result.p90 = percentile(latencies, result.count, 0.90);
+        result.p99 = percentile(latencies, result.count, 0.99);
+        result.max = latencies[result.count - 1];
+    }
+
+    return result;
+}
+
+/**
+ * Runs the program once at the given rate with the given number of consumers.
+ */
+static run_result_t run_load(load_settings_t *settings, long rate, long consumers) {
+    load_run_t run;
+    run_result_t result;
+    pthread_t reader;
+    pid_t pid;
+    int input;
+    int status;
+    int longest_period = 0;
+    double start;
+    double interval = 1e9 / rate;
+    double last_consumer_time = 0;
+    double *latencies;
+
+    run.number_of_commands = (size_t) (rate * settings->duration);
+    if (run.number_of_commands == 0) {
+        run.number_of_commands = 1;
+    }
+    run.commands = malloc(run.number_of_commands * sizeof(load_command_t));
+    run.main_cancels = malloc(settings->number_of_alarms * sizeof(int));
+    run.consumer_cancels = malloc(settings->number_of_alarms * sizeof(int));
+    latencies = malloc(run.number_of_commands * sizeof(double));
+    if (run.commands == NULL || run.main_cancels == NULL
+        || run.consumer_cancels == NULL || latencies == NULL) {
+        errno_abort("Malloc failed");
+    }
+
+    generate_commands(&run, settings);
+
+    pid = start_program(settings, consumers, &input, &run.output);
+
+    status = pthread_create(&reader, NULL, reader_routine, &run);
+    if (status != 0) {
+        err_abort(status, "Create reader thread");
+    }
+
+    start = write_commands(&run, settings, rate, input);
+
+    /*
+     * Give the last alarms time to be displayed (a display may be up to one
+     * period away), then stop the program, which ends its output.
+     */
+    for (int i = 0; i < settings->number_of_periods; i++) {
+        if (settings->period_milliseconds[i] > longest_period) {
+            longest_period = settings->period_milliseconds[i];
+        }
+    }
+    sleep_until_nanoseconds(now_nanoseconds() + (longest_period + 1000) * 1e6);
+
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    close(input);
+
+    status = pthread_join(reader, NULL);
+    if (status != 0) {
+        err_abort(status, "Join reader thread");
+    }
+    fclose(run.output);
+
+    result.rate = rate;
+    result.consumers = consumers;
+    result.commands = run.number_sent;
+    for (int stage = 0; stage < NUMBER_OF_STAGES; stage++) {
+        result.stages[stage] = stage_result(&run, stage, start, interval, latencies);
+    }
+    for (size_t i = 0; i < run.number_sent; i++) {
+        if (run.commands[i].stage_times[Consumer_Stage] > last_consumer_time) {
+            last_consumer_time = run.commands[i].stage_times[Consumer_Stage];
+        }
+    }
+    result.throughput = last_consumer_time > start
+        ? result.stages[Consumer_Stage].count / ((last_consumer_time - start) / 1e9)
+        : 0;
+
+    free(run.commands);
+    free(run.main_cancels);
+    free(run.consumer_cancels);
+    free(latencies);
+
+    return result;
+}
+
+/*******************************************************************************
+ *                                 OUTPUT                                      *
+ ******************************************************************************/
+
+static void print_result(run_result_t *result) {
+    printf("%9ld %9ld %9zu %9zu %11.0f",
+           result->consumers, result->rate, result->commands,
+           result->stages[Consumer_Stage].count, result->throughput);
+    for (int stage = 0; stage < NUMBER_OF_STAGES; stage++) {
+        printf(" %9.2f %9.2f",
+               result->stages[stage].p50, result->stages[stage].p99);
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+static void write_results(const char *path, load_settings_t *settings, run_result_t *results, int count) {
+    FILE *file = fopen(path, "w");
+
+    if (file == NULL) {
+        errno_abort("Could not open results file");
+    }
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"seed\": %u,\n", settings->seed);
+    fprintf(file, "  \"alarms\": %d,\n", settings->number_of_alarms);
+    fprintf(file, "  \"duration_seconds\": %.1f,\n", settings->duration);
+    fprintf(file, "  \"timing_wheel\": %s,\n", settings->timing_wheel ? "true" : "false");
+    fprintf(file, "  \"runs\": [\n");
+    for (int i = 0; i < count; i++) {
+        fprintf(file,
+                "    {\"consumers\": %ld, \"rate\": %ld, \"sent\": %zu, "
+                "\"throughput\": %.1f, \"latency_ms\": {",
+                results[i].consumers, results[i].rate, results[i].commands,
+                results[i].throughput);
+        for (int stage = 0; stage < NUMBER_OF_STAGES; stage++) {
+            stage_result_t *stage_result = &results[i].stages[stage];
+            fprintf(file,
+                    "\"%s\": {\"count\": %zu, \"p50\": %.3f, \"p90\": %.3f, "
+                    "\"p99\": %.3f, \"max\": %.3f}%s",
+                    stage_names[stage], stage_result->count, stage_result->p50,
+                    stage_result->p90, stage_result->p99, stage_result->max,
+                    stage + 1 < NUMBER_OF_STAGES ? ", " : "");
+        }
+        fprintf(file, "}}%s\n", i + 1 < count ? "," : "");
+    }
+    fprintf(file, "  ]\n");
+    fprintf(file, "}\n");
+
+    if (fclose(file) != 0) {
+        errno_abort("Could not write results file");
+    }
+}
+
+static void print_usage(const char *program_name) {
+    fprintf(
+        stderr,
+        "Usage: %s [options]\n"
+        "  -x, --program=path       program to drive (default ./a.out)\n"
+        "  -r, --rates=r1,r2,...    commands per second (default 200,1000)\n"
+        "  -n, --consumers=n1,...   consumer threads (default 1,2,4)\n"
+        "  -a, --alarms=count       number of alarm IDs (default 100)\n"
+        "  -p, --periods=p1,...     alarm times, e.g. 250ms,1,2 (default 1,2)\n"
+        "  -m, --mix=s:c:x          weights of Start, Change and Cancel\n"
+        "                           (default 50:30:20)\n"
+        "  -d, --duration=seconds   seconds of commands per run (default 3)\n"
+        "  -c, --buffer-capacity=capacity\n"
+        "                           passed on to the program\n"
+        "  -w, --timing-wheel       run the program with -w\n"
+        "  -s, --seed=seed          seed of the commands (default 3221)\n"
+        "  -o, --output=file        also write the results as JSON\n",
+        program_name
+    );
+}
+
+/*******************************************************************************
+ *                                  MAIN                                       *
+ ******************************************************************************/
+
+int main(int argc, char *argv[]) {
+    static const struct option options[] = {
+        {"program", required_argument, NULL, 'x'},
+        {"rates", required_argument, NULL, 'r'},
+        {"consumers", required_argument, NULL, 'n'},
+        {"alarms", required_argument, NULL, 'a'},
+        {"periods", required_argument, NULL, 'p'},
+        {"mix", required_argument, NULL, 'm'},
+        {"duration", required_argument, NULL, 'd'},
+        {"buffer-capacity", required_argument, NULL, 'c'},
+        {"timing-wheel", no_argument, NULL, 'w'},
+        {"seed", required_argument, NULL, 's'},
+        {"output", required_argument, NULL, 'o'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    static char default_rates[] = "200,1000";
+    static char default_consumers[] = "1,2,4";
+    static char default_periods[] = "1,2";
+    load_settings_t settings = {
+        .program = "./a.out",
+        .number_of_alarms = 100,
+        .mix = {50, 30, 20},
+        .duration = 3,
+        .seed = 3221
+    };
+    char *rates = default_rates;
+    char *consumers = default_consumers;
+    char *periods = default_periods;
+    run_result_t *results;
+    int number_of_results = 0;
+    int option;
+    char *end;
+
+    while ((option = getopt_long(argc, argv, "x:r:n:a:p:m:d:c:ws:o:h", options, NULL)) != -1) {
+        switch (option) {
+            case 'x':
+                settings.program = optarg;
+                break;
+            case 'r':
+                rates = optarg;
+                break;
+            case 'n':
+                consumers = optarg;
+                break;
+            case 'a':
+                settings.number_of_alarms = (int) strtol(optarg, &end, 10);
+                if (*end != '\0' || settings.number_of_alarms < 1) {
+                    fprintf(stderr, "Invalid number of alarms: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'p':
+                periods = optarg;
+                break;
+            case 'm':
+                if (sscanf(optarg, "%d:%d:%d", &settings.mix[0], &settings.mix[1], &settings.mix[2]) != 3
+                    || settings.mix[0] < 1 || settings.mix[1] < 0 || settings.mix[2] < 0) {
+                    fprintf(stderr, "Invalid mix: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'd':
+                settings.duration = strtod(optarg, &end);
+                if (*end != '\0' || settings.duration <= 0) {
+                    fprintf(stderr, "Invalid duration: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'c':
+                settings.buffer_capacity = optarg;
+                break;
+            case 'w':
+                settings.timing_wheel = true;
+                break;
+            case 's':
+                settings.seed = (unsigned int) strtoul(optarg, NULL, 10);
+                break;
+            case 'o':
+                settings.output = optarg;
+                break;
+            default:
+                print_usage(argv[0]);
+                return option == 'h' ? 0 : 1;
+        }
+    }
+
+    alarm_request_pool_init();
+
+    settings.number_of_rates = parse_number_list(rates, settings.rates);
+    settings.number_of_consumers = parse_number_list(consumers, settings.consumers);
+    settings.number_of_periods = parse_period_list(periods, &settings);
+    if (settings.number_of_rates < 0 || settings.number_of_consumers < 0
+        || settings.number_of_periods < 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    /*
+     * A write to the program after it has died should fail, not kill the
+     * generator.
+     */
+    signal(SIGPIPE, SIG_IGN);
+
+    results = malloc(settings.number_of_rates * settings.number_of_consumers * sizeof(run_result_t));
+    if (results == NULL) {
+        errno_abort("Malloc failed");
+    }
+
+    printf("%d alarm IDs, mix %d:%d:%d, %.1f s per run (seed %u), latencies in ms\n",
+           settings.number_of_alarms, settings.mix[0], settings.mix[1],
+           settings.mix[2], settings.duration, settings.seed);
+    printf("%9s %9s %9s %9s %11s %9s %9s %9s %9s %9s %9s\n",
+           "consumers", "rate/s", "sent", "done", "throughput",
+           "main p50", "p99", "cons p50", "p99", "disp p50", "p99");
+
+    for (int i = 0; i < settings.number_of_consumers; i++) {
+        for (int j = 0; j < settings.number_of_rates; j++) {
+            results[number_of_results] = run_load(
+                &settings,
+                settings.rates[j],
+                settings.consumers[i]
+            );
+            print_result(&results[number_of_results]);
+            number_of_results++;
+        }
+    }
+
+    if (settings.output != NULL) {
+        write_results(settings.output, &settings, results, number_of_results);
+        printf("Results written to %s\n", settings.output);
+    }
+
+    free(results);
+
+    return 0;
+}
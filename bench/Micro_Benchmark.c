@@ -0,0 +1,517 @@
+/*
+ * Micro_Benchmark.c
+ *
+ * Measures the core pieces of the program on their own, linked from
+ * libalarm.a instead of through New_Alarm_Cond.c:
+ *
+ *   alarm_list_insert     insert_to_alarm_list with a new alarm ID
+ *   alarm_list_find       find_newest_alarm_request (what find_alarm_by_id
+ *                         does on the alarm thread's list)
+ *   alarm_list_change     insert_to_alarm_list of a Change_Alarm request,
+ *                         then remove_old_alarm_requests_from_list
+ *   display_snapshot_find find_in_display_snapshot
+ *   ring_buffer_put_get   ring_buffer_put then ring_buffer_get, on one thread
+ *   ring_buffer_transfer  ring_buffer_get while another thread puts
+ *   parse_request         parse_request then free_alarm_request
+ *
+ * The alarm list and snapshot benchmarks run on lists of 10 up to 1,000,000
+ * alarms. Every benchmark starts again from the same seed, so each run does
+ * exactly the same operations.
+ *
+ * Operations are timed in batches of BATCH_SIZE, because reading the clock
+ * takes about as long as the smallest operations. Each batch gives one sample
+ * of the time per operation, and the percentiles are taken over the samples.
+ *
+ * The results are printed as a table and written as JSON to the file given on
+ * the command line (bench_results.json by default).
+ *
+ * Build and run with:
+ *
+ *   make bench
+ */
+#include <pthread.h>
+#include <time.h>
+#include "errors.h"
+#include "types.h"
+#include "Alarm_List.h"
+#include "Alarm_Request.h"
+#include "Command_Parser.h"
+#include "Display_Snapshot.h"
+#include "Ring_Buffer.h"
+
+#define SEED 3221
+#define BATCH_SIZE 32
+#define NUMBER_OF_SAMPLES 4000
+#define NUMBER_OF_TIME_VALUES 60
+#define RING_BUFFER_CAPACITY 1024
+#define CORPUS_SIZE 10000
+#define LINE_SIZE 160
+#define MAXIMUM_RESULTS 64
+
+/**
+ * The result of running one benchmark on one size. Times are in nanoseconds
+ * per operation.
+ */
+typedef struct result_t {
+    const char *benchmark;
+    size_t size;
+    size_t operations;
+    double operations_per_second;
+    double mean;
+    double p50;
+    double p90;
+    double p99;
+    double max;
+} result_t;
+
+static result_t results[MAXIMUM_RESULTS];
+static int number_of_results = 0;
+
+static double samples[NUMBER_OF_SAMPLES];
+static unsigned long last_sequence_number = 0;
+
+/*******************************************************************************
+ *                           HELPER FUNCTIONS                                  *
+ ******************************************************************************/
+
+static double now_nanoseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * Returns the given percentile of sorted samples (nearest rank).
+ */
+static double percentile(double *sorted, int number_of_samples, double fraction) {
+    int rank = (int) (fraction * number_of_samples + 0.999999);
+
+    if (rank < 1) {
+        rank = 1;
+    }
+
+    return sorted[rank - 1];
+}
+
+/**
+ * Adds the result of a benchmark from its samples (each the time per operation
+ * of one batch) and prints it.
+ */
+static void add_result(const char *benchmark, size_t size, int number_of_samples) {
+    result_t *result;
+    double total = 0;
+
+    if (number_of_results == MAXIMUM_RESULTS) {
+        fprintf(stderr, "Too many results\n");
+        exit(1);
+    }
+
+    for (int i = 0; i < number_of_samples; i++) {
+        total += samples[i];
+    }
+    qsort(samples, number_of_samples, sizeof(double), compare_doubles);
+
+    result = &results[number_of_results++];
+    result->benchmark = benchmark;
+    result->size = size;
+    result->operations = (size_t) number_of_samples * BATCH_SIZE;
+    result->mean = total / number_of_samples;
+    result->operations_per_second = 1e9 / result->mean;
+    result->p50 = percentile(samples, number_of_samples, 0.50);
+    result->p90 = percentile(samples, number_of_samples, 0.90);
+    result->p99 = percentile(samples, number_of_samples, 0.99);
+    result->max = samples[number_of_samples - 1];
+
+    printf("%-22s %8zu %14.0f %9.1f %9.1f %9.1f %9.1f %9.1f\n",
+           result->benchmark, result->size, result->operations_per_second,
+           result->mean, result->p50, result->p90, result->p99, result->max);
+}
+
+static void write_results(const char *path) {
+    FILE *file = fopen(path, "w");
+
+    if (file == NULL) {
+        errno_abort("Could not open results file");
+    }
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"seed\": %d,\n", SEED);
+    fprintf(file, "  \"batch_size\": %d,\n", BATCH_SIZE);
+    fprintf(file, "  \"results\": [\n");
+    for (int i = 0; i < number_of_results; i++) {
+        result_t *result = &results[i];
+
+        fprintf(file,
+                "    {\"benchmark\": \"%s\", \"size\": %zu, \"operations\": %zu, "
+                "\"ops_per_second\": %.1f, \"ns_per_op\": {\"mean\": %.2f, "
+                "\"p50\": %.2f, \"p90\": %.2f, \"p99\": %.2f, \"max\": %.2f}}%s\n",
+                result->benchmark, result->size, result->operations,
+                result->operations_per_second, result->mean, result->p50,
+                result->p90, result->p99, result->max,
+                i + 1 < number_of_results ? "," : "");
+    }
+    fprintf(file, "  ]\n");
+    fprintf(file, "}\n");
+
+    if (fclose(file) != 0) {
+        errno_abort("Could not write results file");
+    }
+}
+
+static alarm_request_t *new_alarm_request(request_type type, int alarm_id, int time) {
+    alarm_request_t *alarm_request = allocate_alarm_request();
+
+    memset(alarm_request, 0, sizeof(alarm_request_t));
+
+    alarm_request->type = type;
+    alarm_request->alarm_id = alarm_id;
+    alarm_request->time = time;
+    alarm_request->sequence_number = ++last_sequence_number;
+    alarm_request->message = message_intern("benchmark", strlen("benchmark"));
+
+    return alarm_request;
+}
+
+static int random_time(void) {
+    return 1000 * (1 + rand() % NUMBER_OF_TIME_VALUES);
+}
+
+static void free_alarm_list(alarm_list_t *list) {
+    alarm_request_t *alarm_request;
+
+    while (list->header.next != NULL) {
+        alarm_request = list->header.next;
+        unlink_from_alarm_list(list, alarm_request);
+        free_alarm_request(alarm_request);
+    }
+    free(list->id_buckets);
+    free(list->time_buckets);
+}
+
+/*******************************************************************************
+ *                         ALARM LIST BENCHMARKS                               *
+ ******************************************************************************/
+
+static void benchmark_alarm_list_find(alarm_list_t *list, int number_of_alarms) {
+    int alarm_ids[BATCH_SIZE];
+    volatile int found = 0;
+    double start;
+
+    srand(SEED);
+
+    for (int sample = 0; sample < NUMBER_OF_SAMPLES; sample++) {
+        for (int i = 0; i < BATCH_SIZE; i++) {
+            alarm_ids[i] = rand() % number_of_alarms;
+        }
+
+        start = now_nanoseconds();
+        for (int i = 0; i < BATCH_SIZE; i++) {
+            found += find_newest_alarm_request(list, alarm_ids[i]) != NULL;
+        }
+        samples[sample] = (now_nanoseconds() - start) / BATCH_SIZE;
+    }
+
+    if (found != NUMBER_OF_SAMPLES * BATCH_SIZE) {
+        fprintf(stderr, "Lookups failed with %d alarms\n", number_of_alarms);
+        exit(1);
+    }
+
+    add_result("alarm_list_find", number_of_alarms, NUMBER_OF_SAMPLES);
+}
+
+/**
+ * Inserts a batch of alarms with new alarm IDs, then unlinks them again
+ * (without timing it) so the list keeps its size.
+ */
+static void benchmark_alarm_list_insert(alarm_list_t *list, int number_of_alarms) {
+    alarm_request_t *batch[BATCH_SIZE];
+    double start;
+
+    srand(SEED);
+
+    for (int sample = 0; sample < NUMBER_OF_SAMPLES; sample++) {
+        for (int i = 0; i < BATCH_SIZE; i++) {
+            batch[i] = new_alarm_request(Start_Alarm, number_of_alarms + i, random_time());
+        }
+
+        start = now_nanoseconds();
+        for (int i = 0; i < BATCH_SIZE; i++) {
+            insert_to_alarm_list(list, batch[i]);
+        }
+        samples[sample] = (now_nanoseconds() - start) / BATCH_SIZE;
+
+        for (int i = 0; i < BATCH_SIZE; i++) {
+            unlink_from_alarm_list(list, batch[i]);
+            free_alarm_request(batch[i]);
+        }
+    }
+
+    add_result("alarm_list_insert", number_of_alarms, NUMBER_OF_SAMPLES);
+}
+
+/**
+ * Changes a batch of random alarms the way the alarm thread does: inserts a
+ * Change_Alarm request, then removes the older requests for the alarm ID.
+ */
+static void benchmark_alarm_list_change(alarm_list_t *list, int number_of_alarms) {
+    alarm_request_t *batch[BATCH_SIZE];
+    double start;
+
+    srand(SEED);
+
+    for (int sample = 0; sample < NUMBER_OF_SAMPLES; sample++) {
+        for (int i = 0; i < BATCH_SIZE; i++) {
+            batch[i] = new_alarm_request(
+                Change_Alarm,
+                rand() % number_of_alarms,
+                random_time()
+            );
+        }
+
+        start = now_nanoseconds();
+        for (int i = 0; i < BATCH_SIZE; i++) {
+            insert_to_alarm_list(list, batch[i]);
+            remove_old_alarm_requests_from_list(list, batch[i]->alarm_id, batch[i]);
+        }
+        samples[sample] = (now_nanoseconds() - start) / BATCH_SIZE;
+    }
+
+    if (list->length != (size_t) number_of_alarms) {
+        fprintf(stderr, "List is inconsistent after %d alarms\n", number_of_alarms);
+        exit(1);
+    }
+
+    add_result("alarm_list_change", number_of_alarms, NUMBER_OF_SAMPLES);
+}
+
+static void benchmark_display_snapshot_find(alarm_list_t *list, int number_of_alarms) {
+    display_snapshot_t *snapshot;
+    unsigned long last_bucket_version = 0;
+    unsigned long newest_sequence_number = 0;
+    int alarm_ids[BATCH_SIZE];
+    volatile int found = 0;
+    double start;
+
+    snapshot = build_display_snapshot(list, NULL, &last_bucket_version, &newest_sequence_number);
+    srand(SEED);
+
+    for (int sample = 0; sample < NUMBER_OF_SAMPLES; sample++) {
+        for (int i = 0; i < BATCH_SIZE; i++) {
+            alarm_ids[i] = rand() % number_of_alarms;
+        }
+
+        start = now_nanoseconds();
+        for (int i = 0; i < BATCH_SIZE; i++) {
+            found += find_in_display_snapshot(snapshot, alarm_ids[i]) != NULL;
+        }
+        samples[sample] = (now_nanoseconds() - start) / BATCH_SIZE;
+    }
+
+    if (found != NUMBER_OF_SAMPLES * BATCH_SIZE) {
+        fprintf(stderr, "Snapshot lookups failed with %d alarms\n", number_of_alarms);
+        exit(1);
+    }
+
+    free(snapshot);
+    add_result("display_snapshot_find", number_of_alarms, NUMBER_OF_SAMPLES);
+}
+
+/**
+ * Runs the alarm list and snapshot benchmarks on a list with the given number
+ * of alarms.
+ */
+static void run_alarm_list_benchmarks(int number_of_alarms) {
+    alarm_list_t list;
+
+    alarm_list_init(&list);
+    srand(SEED);
+
+    for (int i = 0; i < number_of_alarms; i++) {
+        insert_to_alarm_list(&list, new_alarm_request(Start_Alarm, i, random_time()));
+    }
+
+    benchmark_alarm_list_find(&list, number_of_alarms);
+    benchmark_alarm_list_insert(&list, number_of_alarms);
+    benchmark_alarm_list_change(&list, number_of_alarms);
+    benchmark_display_snapshot_find(&list, number_of_alarms);
+
+    free_alarm_list(&list);
+}
+
+/*******************************************************************************
+ *                         RING BUFFER BENCHMARKS                              *
+ ******************************************************************************/
+
+static void benchmark_ring_buffer_put_get(void) {
+    ring_buffer_t ring;
+    volatile size_t total = 0;
+    double start;
+
+    ring_buffer_init(&ring, RING_BUFFER_CAPACITY);
+
+    for (int sample = 0; sample < NUMBER_OF_SAMPLES; sample++) {
+        start = now_nanoseconds();
+        for (size_t i = 1; i <= BATCH_SIZE; i++) {
+            ring_buffer_put(&ring, (void *) i);
+            total += (size_t) ring_buffer_get(&ring, NULL);
+        }
+        samples[sample] = (now_nanoseconds() - start) / BATCH_SIZE;
+    }
+
+    add_result("ring_buffer_put_get", RING_BUFFER_CAPACITY, NUMBER_OF_SAMPLES);
+}
+
+static void *ring_buffer_producer_routine(void *arg) {
+    ring_buffer_t *ring = arg;
+
+    for (size_t i = 1; i <= (size_t) NUMBER_OF_SAMPLES * BATCH_SIZE; i++) {
+        ring_buffer_put(ring, (void *) i);
+    }
+
+    return NULL;
+}
+
+/**
+ * Gets items on this thread while a producer thread puts them, so both
+ * threads' positions and cached positions move the way they do between the
+ * alarm thread and a consumer thread.
+ */
+static void benchmark_ring_buffer_transfer(void) {
+    ring_buffer_t ring;
+    pthread_t producer;
+    size_t expected = 1;
+    double start;
+    int status;
+
+    ring_buffer_init(&ring, RING_BUFFER_CAPACITY);
+
+    status = pthread_create(&producer, NULL, ring_buffer_producer_routine, &ring);
+    if (status != 0) {
+        err_abort(status, "Create producer thread");
+    }
+
+    for (int sample = 0; sample < NUMBER_OF_SAMPLES; sample++) {
+        start = now_nanoseconds();
+        for (int i = 0; i < BATCH_SIZE; i++) {
+            if ((size_t) ring_buffer_get(&ring, NULL) != expected++) {
+                fprintf(stderr, "Ring buffer items out of order\n");
+                exit(1);
+            }
+        }
+        samples[sample] = (now_nanoseconds() - start) / BATCH_SIZE;
+    }
+
+    status = pthread_join(producer, NULL);
+    if (status != 0) {
+        err_abort(status, "Join producer thread");
+    }
+
+    add_result("ring_buffer_transfer", RING_BUFFER_CAPACITY, NUMBER_OF_SAMPLES);
+}
+
+/*******************************************************************************
+ *                            PARSER BENCHMARK                                 *
+ ******************************************************************************/
+
+static char corpus[CORPUS_SIZE][LINE_SIZE];
+
+/**
+ * Fills the corpus with a fixed mix of requests of each type and lines that
+ * are not requests.
+ */
+static void build_corpus(void) {
+    static const char *odd_lines[] = {
+        "Start_Alarm(1): five message",
+        "Cancel_Alarm(abc)",
+        "hello world",
+        "Start_Alarm(1): 0 message",
+        "Change_Alarm(3): 4 Cancel_Alarm(9)"
+    };
+    int number_of_odd_lines = sizeof(odd_lines) / sizeof(odd_lines[0]);
+
+    srand(SEED);
+
+    for (int i = 0; i < CORPUS_SIZE; i++) {
+        int id = rand() % 100000;
+        int time_value = 1 + rand() % NUMBER_OF_TIME_VALUES;
+
+        switch (rand() % 8) {
+            case 0:
+            case 1:
+            case 2:
+                snprintf(corpus[i], LINE_SIZE, "Start_Alarm(%d): %d message %d",
+                         id, time_value, rand() % 100);
+                break;
+            case 3:
+                snprintf(corpus[i], LINE_SIZE, "Start_Alarm(%d): %d.%03ds message",
+                         id, time_value, rand() % 1000);
+                break;
+            case 4:
+                snprintf(corpus[i], LINE_SIZE, "Change_Alarm(%d): %dms changed",
+                         id, 250 * time_value);
+                break;
+            case 5:
+            case 6:
+                snprintf(corpus[i], LINE_SIZE, "Cancel_Alarm(%d)", id);
+                break;
+            default:
+                snprintf(corpus[i], LINE_SIZE, "%s",
+                         odd_lines[rand() % number_of_odd_lines]);
+                break;
+        }
+    }
+}
+
+static void benchmark_parse_request(void) {
+    int line = 0;
+    double start;
+
+    build_corpus();
+
+    for (int sample = 0; sample < NUMBER_OF_SAMPLES; sample++) {
+        start = now_nanoseconds();
+        for (int i = 0; i < BATCH_SIZE; i++) {
+            free_alarm_request(parse_request(corpus[line]));
+            line = (line + 1) % CORPUS_SIZE;
+        }
+        samples[sample] = (now_nanoseconds() - start) / BATCH_SIZE;
+    }
+
+    add_result("parse_request", CORPUS_SIZE, NUMBER_OF_SAMPLES);
+}
+
+/*******************************************************************************
+ *                                BENCHMARK                                    *
+ ******************************************************************************/
+
+int main(int argc, char *argv[]) {
+    static const int sizes[] = {10, 100, 1000, 10000, 100000, 1000000};
+    const char *results_path = argc > 1 ? argv[1] : "bench_results.json";
+
+    alarm_request_pool_init();
+
+    printf("Seed %d, %d samples of %d operations per benchmark (times in ns/op)\n",
+           SEED, NUMBER_OF_SAMPLES, BATCH_SIZE);
+    printf("%-22s %8s %14s %9s %9s %9s %9s %9s\n",
+           "benchmark", "size", "ops/s", "mean", "p50", "p90", "p99", "max");
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        run_alarm_list_benchmarks(sizes[i]);
+    }
+
+    benchmark_ring_buffer_put_get();
+    benchmark_ring_buffer_transfer();
+    benchmark_parse_request();
+
+    write_results(results_path);
+    printf("Results written to %s\n", results_path);
+
+    return 0;
+}
@@ -0,0 +1,289 @@
+/*
+ * Parser_Benchmark.c
+ *
+ * Measures the throughput of parse_request and compares it with the regex
+ * parser that it replaced (which compiled and freed three regexes for every
+ * line). Every line in the corpus is parsed by both parsers and the results
+ * are checked to be the same before anything is timed.
+ *
+ * Build and run with:
+ *
+ *   make parser_benchmark
+ */
+#include <pthread.h>
+#include <regex.h>
+#include <time.h>
+#include "errors.h"
+#include "types.h"
+#include "Command_Parser.h"
+#include "Alarm_Request.h"
+
+#define CORPUS_SIZE 4096
+#define LINE_SIZE 256
+#define DEFAULT_ITERATIONS 50
+#define SEED 3221
+
+/*******************************************************************************
+ *                         REFERENCE (REGEX) PARSER                            *
+ ******************************************************************************/
+
+typedef struct regex_parser {
+    request_type type;
+    const char *regex_string;
+    int expected_matches;
+} regex_parser;
+
+static regex_parser regexes[] = {
+    {
+        Start_Alarm,
+        "Start_Alarm\\(([0-9]+)\\):[[:space:]]([0-9]+)[[:space:]](.*)",
+        4
+    },
+    {
+        Change_Alarm,
+        "Change_Alarm\\(([0-9]+)\\):[[:space:]]([0-9]+)[[:space:]](.*)",
+        4
+    },
+    {
+        Cancel_Alarm,
+        "Cancel_Alarm\\(([0-9]+)\\)",
+        2
+    }
+};
+
+/**
+ * The old parse_request, kept here so that the new parser can be compared with
+ * it. The only differences are that the number buffers are zeroed before they
+ * are used (the old code did not terminate them), messages are interned, and
+ * times are converted to milliseconds. The corpus only
+ * uses whole seconds, which is all that the old parser accepted.
+ */
+static alarm_request_t *parse_request_regex(char input[]) {
+    regex_t regex;
+    regmatch_t matches[4];
+    alarm_request_t *alarm_request;
+    char alarm_id_buffer[64];
+    char time_buffer[64];
+    size_t length;
+
+    for (int i = 0; i < 3; i++) {
+        if (regcomp(&regex, regexes[i].regex_string, REG_EXTENDED) != 0) {
+            fprintf(stderr, "Regex %d did not compile\n", i);
+            exit(1);
+        }
+
+        if (regexec(&regex, input, regexes[i].expected_matches, matches, 0) != 0) {
+            regfree(&regex);
+            continue;
+        }
+        regfree(&regex);
+
+        alarm_request = malloc(sizeof(alarm_request_t));
+        if (alarm_request == NULL) {
+            errno_abort("Malloc failed");
+        }
+
+        alarm_request->type = regexes[i].type;
+        alarm_request->change_status = alarm_request->type == Change_Alarm;
+        alarm_request->next = NULL;
+
+        memset(alarm_id_buffer, 0, sizeof(alarm_id_buffer));
+        length = matches[1].rm_eo - matches[1].rm_so;
+        strncpy(alarm_id_buffer, input + matches[1].rm_so,
+                length < 63 ? length : 63);
+        alarm_request->alarm_id = atoi(alarm_id_buffer);
+
+        if (regexes[i].expected_matches > 2) {
+            memset(time_buffer, 0, sizeof(time_buffer));
+            length = matches[2].rm_eo - matches[2].rm_so;
+            strncpy(time_buffer, input + matches[2].rm_so,
+                    length < 63 ? length : 63);
+            alarm_request->time = atoi(time_buffer) * 1000; // Milliseconds,
+                                                            // like parse_request
+
+            alarm_request->message = message_intern(
+                input + matches[3].rm_so,
+                matches[3].rm_eo - matches[3].rm_so
+            );
+        } else {
+            alarm_request->time = 0;
+            alarm_request->message = message_intern("", 0);
+        }
+
+        alarm_request->creation_time = time(NULL);
+        return alarm_request;
+    }
+
+    return NULL;
+}
+
+/*******************************************************************************
+ *                                  CORPUS                                     *
+ ******************************************************************************/
+
+static char corpus[CORPUS_SIZE][LINE_SIZE];
+
+/**
+ * Fills the corpus with a fixed mix of lines: mostly valid requests of each
+ * type, plus lines that are almost valid, lines that contain more than one
+ * request and lines that are nonsense.
+ */
+static void build_corpus(void) {
+    static const char *odd_lines[] = {
+        "",
+        "Start_Alarm(1):5 message",
+        "Start_Alarm(1): five message",
+        "Start_Alarm(x): 5 message",
+        "Change_Alarm(2) 10 message",
+        "Cancel_Alarm()",
+        "Cancel_Alarm(abc)",
+        "start_alarm(1): 5 message",
+        "hello world",
+        "Stats",
+        "xxStart_Alarm(7):\t30\tmessage",
+        "Cancel_Alarm(1) Start_Alarm(2): 3 message",
+        "Change_Alarm(3): 4 Cancel_Alarm(9)",
+        "Cancel_Alarm(12)trailing",
+        "Start_Alarm(1): 5 ",
+        "Start_Alarm(99999999999999999999): 5 message",
+        "Start_Alarm(4): 5 0123456789012345678901234567890123456789012345678901"
+        "234567890123456789012345678901234567890123456789012345678901234567890123"
+        "4567890123456789"
+    };
+    int number_of_odd_lines = sizeof(odd_lines) / sizeof(odd_lines[0]);
+
+    srand(SEED);
+
+    for (int i = 0; i < CORPUS_SIZE; i++) {
+        int id = rand() % 100000;
+        int time_value = 1 + rand() % 60;
+
+        switch (rand() % 8) {
+            case 0:
+            case 1:
+            case 2:
+                snprintf(corpus[i], LINE_SIZE, "Start_Alarm(%d): %d message %d",
+                         id, time_value, rand());
+                break;
+            case 3:
+            case 4:
+                snprintf(corpus[i], LINE_SIZE, "Change_Alarm(%d): %d changed %d",
+                         id, time_value, rand());
+                break;
+            case 5:
+            case 6:
+                snprintf(corpus[i], LINE_SIZE, "Cancel_Alarm(%d)", id);
+                break;
+            default:
+                snprintf(corpus[i], LINE_SIZE, "%s",
+                         odd_lines[rand() % number_of_odd_lines]);
+                break;
+        }
+    }
+}
+
+/*******************************************************************************
+ *                                BENCHMARK                                    *
+ ******************************************************************************/
+
+static double now_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * Returns true if both parsers produced the same request (or both rejected
+ * the line).
+ */
+static bool same_request(alarm_request_t *a, alarm_request_t *b) {
+    if (a == NULL || b == NULL) {
+        return a == b;
+    }
+
+    return a->type == b->type
+        && a->alarm_id == b->alarm_id
+        && a->time == b->time
+        && a->change_status == b->change_status
+        && a->message == b->message;
+}
+
+/**
+ * Frees a request from the regex parser, which uses malloc.
+ */
+static void free_regex_request(alarm_request_t *alarm_request) {
+    if (alarm_request != NULL) {
+        message_release(alarm_request->message);
+    }
+    free(alarm_request);
+}
+
+/**
+ * Parses the whole corpus the given number of times and returns the number
+ * of lines parsed per second. Each request is freed with the given function.
+ */
+static double run(
+    alarm_request_t *(*parser)(char[]),
+    void (*free_request)(alarm_request_t *),
+    int iterations
+) {
+    double start = now_seconds();
+
+    for (int iteration = 0; iteration < iterations; iteration++) {
+        for (int i = 0; i < CORPUS_SIZE; i++) {
+            free_request(parser(corpus[i]));
+        }
+    }
+
+    return (double) iterations * CORPUS_SIZE / (now_seconds() - start);
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = argc > 1 ? atoi(argv[1]) : DEFAULT_ITERATIONS;
+    int mismatches = 0;
+    double regex_rate;
+    double single_pass_rate;
+
+    alarm_request_pool_init();
+    build_corpus();
+
+    /*
+     * Make sure both parsers agree on every line before timing them.
+     */
+    for (int i = 0; i < CORPUS_SIZE; i++) {
+        alarm_request_t *expected = parse_request_regex(corpus[i]);
+        alarm_request_t *actual = parse_request(corpus[i]);
+
+        if (!same_request(expected, actual)) {
+            fprintf(stderr, "Parsers disagree on \"%s\"\n", corpus[i]);
+            mismatches++;
+        }
+
+        free_regex_request(expected);
+        free_alarm_request(actual);
+    }
+
+    if (mismatches != 0) {
+        fprintf(stderr, "%d mismatches\n", mismatches);
+        return 1;
+    }
+
+    /*
+     * The regex parser is much slower, so it gets fewer iterations.
+     */
+    regex_rate = run(
+        parse_request_regex,
+        free_regex_request,
+        iterations / 10 > 0 ? iterations / 10 : 1
+    );
+    single_pass_rate = run(parse_request, free_alarm_request, iterations);
+
+    printf("Corpus: %d lines (seed %d)\n", CORPUS_SIZE, SEED);
+    printf("regex parser:       %12.0f lines/s  %8.1f ns/line\n",
+           regex_rate, 1e9 / regex_rate);
+    printf("single-pass parser: %12.0f lines/s  %8.1f ns/line\n",
+           single_pass_rate, 1e9 / single_pass_rate);
+    printf("speedup:            %12.1fx\n", single_pass_rate / regex_rate);
+
+    return 0;
+}
@@ -0,0 +1,278 @@
+/*
+ * Periodic_Display_Benchmark.c
+ *
+ * Checks that the real program (a.out) displays every alarm it starts at
+ * least once, including when the alarms are started by a bulk request, have
+ * a period of a millisecond, or are started while their consumer is still
+ * busy with a large bulk request, so that a periodic display's first periods
+ * can come before the consumer has published the alarms. Each case sends its
+ * commands to a new instance of the program, and reads its output until
+ * every alarm of the case has printed an "ALARM MESSAGE" line, or until
+ * TIMEOUT_SECONDS have passed. It prints how long it took until every alarm
+ * had been displayed.
+ *
+ * Output lines longer than OUTPUT_LINE_SIZE (the alarm list dumps) are
+ * skipped after their first OUTPUT_LINE_SIZE bytes.
+ *
+ * Build and run with:
+ *
+ *   make periodic_display_benchmark
+ */
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <sys/wait.h>
+#include <time.h>
+#include "errors.h"
+
+#define PROGRAM "./a.out"
+#define OUTPUT_LINE_SIZE 4096
+#define TIMEOUT_SECONDS 10
+
+/**
+ * A case: the options the program is started with, the commands it is sent,
+ * and the alarm IDs that must be displayed.
+ */
+typedef struct display_case_t {
+    const char *name;
+    const char *arguments[8];           // After the program name and -b.
+    const char *commands;
+    int first_alarm_id;
+    int last_alarm_id;
+} display_case_t;
+
+static const display_case_t cases[] = {
+    {
+        "bulk, 1 ms",
+        {NULL},
+        "Start_Alarm(1-5000): 1ms bulk\n",
+        1, 5000
+    },
+    {
+        "bulk, 10 ms",
+        {NULL},
+        "Start_Alarm(1-5000): 10ms bulk\n",
+        1, 5000
+    },
+    {
+        "bulk, 1 ms, -w",
+        {"-w", NULL},
+        "Start_Alarm(1-5000): 1ms bulk\n",
+        1, 5000
+    },
+    {
+        "1 ms, busy consumer",
+        {"-n", "1", "-c", "1", NULL},
+        "Start_Alarm(1-200000): 100 busy\nStart_Alarm(300000): 1ms late\n",
+        300000, 300000
+    },
+};
+
+#define NUMBER_OF_CASES (sizeof(cases) / sizeof(cases[0]))
+
+/**
+ * Stops the program once the timeout has passed, unless the case finished
+ * first, so that reading its output never blocks for longer than that.
+ */
+typedef struct watchdog_t {
+    pid_t pid;
+    bool done;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} watchdog_t;
+
+/*******************************************************************************
+ *                           HELPER FUNCTIONS                                  *
+ ******************************************************************************/
+
+static double now_milliseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
+
+static void *watchdog_routine(void *arg) {
+    watchdog_t *watchdog = arg;
+    struct timespec deadline;
+    int status = 0;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += TIMEOUT_SECONDS;
+
+    pthread_mutex_lock(&watchdog->mutex);
+    while (!watchdog->done && status != ETIMEDOUT) {
+        status = pthread_cond_timedwait(&watchdog->cond, &watchdog->mutex, &deadline);
+    }
+    if (!watchdog->done) {
+        kill(watchdog->pid, SIGTERM);
+    }
+    pthread_mutex_unlock(&watchdog->mutex);
+
+    return NULL;
+}
+
+/**
+ * Starts the program in batch mode with the arguments of a case, with pipes
+ * to its standard input and from its standard output.
+ */
+static pid_t start_program(const display_case_t *display_case, int *input, FILE **output) {
+    int input_pipe[2];
+    int output_pipe[2];
+    const char *arguments[16];
+    int number_of_arguments = 0;
+    pid_t pid;
+
+    if (pipe(input_pipe) != 0 || pipe(output_pipe) != 0) {
+        errno_abort("Pipe failed");
+    }
+
+    arguments[number_of_arguments++] = PROGRAM;
+    arguments[number_of_arguments++] = "-b";
+    for (int i = 0; display_case->arguments[i] != NULL; i++) {
+        arguments[number_of_arguments++] = display_case->arguments[i];
+    }
+    arguments[number_of_arguments] = NULL;
+
+    pid = fork();
+    if (pid < 0) {
+        errno_abort("Fork failed");
+    }
+
+    if (pid == 0) {
+        dup2(input_pipe[0], STDIN_FILENO);
+        dup2(output_pipe[1], STDOUT_FILENO);
+        close(input_pipe[0]);
+        close(input_pipe[1]);
+        close(output_pipe[0]);
+        close(output_pipe[1]);
+        execv(PROGRAM, (char **) arguments);
+        errno_abort("Exec failed");
+    }
+
+    close(input_pipe[0]);
+    close(output_pipe[1]);
+    *input = input_pipe[1];
+    *output = fdopen(output_pipe[0], "r");
+    if (*output == NULL) {
+        errno_abort("Fdopen failed");
+    }
+
+    return pid;
+}
+
+/**
+ * Runs a case. Returns the number of its alarms that were displayed, and sets
+ * the number of milliseconds until the last of them was.
+ */
+static int run_case(const display_case_t *display_case, double *milliseconds) {
+    int number_of_alarms = display_case->last_alarm_id - display_case->first_alarm_id + 1;
+    bool *displayed = calloc(number_of_alarms, sizeof(bool));
+    int number_displayed = 0;
+    char line[OUTPUT_LINE_SIZE];
+    bool continuation = false;          // Whether the line is the rest of a
+                                        // line that was too long.
+    watchdog_t watchdog;
+    pthread_t watchdog_thread;
+    FILE *output;
+    int input;
+    int status;
+    int index;
+    double start;
+
+    if (displayed == NULL) {
+        errno_abort("Calloc failed");
+    }
+
+    watchdog.pid = start_program(display_case, &input, &output);
+    watchdog.done = false;
+    pthread_mutex_init(&watchdog.mutex, NULL);
+    pthread_cond_init(&watchdog.cond, NULL);
+    status = pthread_create(&watchdog_thread, NULL, watchdog_routine, &watchdog);
+    if (status != 0) {
+        err_abort(status, "Create watchdog thread");
+    }
+
+    start = now_milliseconds();
+    if (write(input, display_case->commands, strlen(display_case->commands)) < 0) {
+        errno_abort("Write failed");
+    }
+    *milliseconds = 0;
+
+    while (number_displayed < number_of_alarms
+           && fgets(line, OUTPUT_LINE_SIZE, output) != NULL) {
+        if (continuation) {
+            continuation = strchr(line, '\n') == NULL;
+            continue;
+        }
+        continuation = strchr(line, '\n') == NULL;
+
+        if (strncmp(line, "ALARM MESSAGE (", strlen("ALARM MESSAGE (")) != 0) {
+            continue;
+        }
+
+        index = atoi(line + strlen("ALARM MESSAGE (")) - display_case->first_alarm_id;
+        if (index >= 0 && index < number_of_alarms && !displayed[index]) {
+            displayed[index] = true;
+            number_displayed++;
+            *milliseconds = now_milliseconds() - start;
+        }
+    }
+
+    pthread_mutex_lock(&watchdog.mutex);
+    watchdog.done = true;
+    pthread_cond_signal(&watchdog.cond);
+    pthread_mutex_unlock(&watchdog.mutex);
+    status = pthread_join(watchdog_thread, NULL);
+    if (status != 0) {
+        err_abort(status, "Join watchdog thread");
+    }
+
+    kill(watchdog.pid, SIGTERM);
+    close(input);
+    fclose(output);
+    waitpid(watchdog.pid, NULL, 0);
+    free(displayed);
+
+    return number_displayed;
+}
+
+/*******************************************************************************
+ *                                   MAIN                                      *
+ ******************************************************************************/
+
+int main(void) {
+    int failures = 0;
+    int number_of_alarms;
+    int number_displayed;
+    double milliseconds;
+
+    /*
+     * A write to the program after it has died should fail, not kill the
+     * benchmark.
+     */
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("%-22s %10s %10s %18s\n", "Case", "Alarms", "Displayed", "All shown (ms)");
+    for (size_t i = 0; i < NUMBER_OF_CASES; i++) {
+        number_of_alarms = cases[i].last_alarm_id - cases[i].first_alarm_id + 1;
+        number_displayed = run_case(&cases[i], &milliseconds);
+
+        if (number_displayed == number_of_alarms) {
+            printf("%-22s %10d %10d %18.1f\n",
+                   cases[i].name, number_of_alarms, number_displayed, milliseconds);
+        } else {
+            printf("%-22s %10d %10d %18s\n",
+                   cases[i].name, number_of_alarms, number_displayed, "-");
+            fprintf(stderr, "%s: %d of %d alarms were never displayed\n",
+                    cases[i].name, number_of_alarms - number_displayed, number_of_alarms);
+            failures++;
+        }
+    }
+
+    if (failures != 0) {
+        fprintf(stderr, "%d failures\n", failures);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,161 @@
+/*
+ * Timing_Wheel_Benchmark.c
+ *
+ * Checks that periodic timers on the timing wheel stay in phase: each one is
+ * rescheduled from its callback, the way periodic displays are, and every
+ * expiry must be exactly a whole number of periods after the first, which
+ * must be one period after the timer was scheduled. The periods include
+ * multiples of 64 ticks, whose expiries fall on the ticks where timers are
+ * moved down from the higher levels of the wheel. No callback may run before
+ * its timer's due time. It also prints how late the callbacks ran.
+ *
+ * Build and run with:
+ *
+ *   make timing_wheel_benchmark
+ */
+#include <pthread.h>
+#include <stdbool.h>
+#include <time.h>
+#include "errors.h"
+#include "Timing_Wheel.h"
+
+#define TICK_MILLISECONDS 1
+#define FIRINGS 8
+
+/**
+ * Periods in milliseconds (and ticks).
+ */
+static const long periods[] = {64, 100, 128, 192, 257};
+
+#define NUMBER_OF_TIMERS (sizeof(periods) / sizeof(periods[0]))
+
+/**
+ * A periodic timer and what it saw each time it expired.
+ */
+typedef struct checked_timer_t {
+    wheel_timer_t timer;
+    long period;
+    uint64_t first_expiry;          // Expiry when it was scheduled.
+    uint64_t expiries[FIRINGS];
+    long lateness[FIRINGS];         // In microseconds (negative if early).
+    int firings;
+} checked_timer_t;
+
+static timing_wheel_t wheel;
+static checked_timer_t timers[NUMBER_OF_TIMERS];
+static int timers_done = 0;
+static pthread_mutex_t done_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+
+/*******************************************************************************
+ *                           HELPER FUNCTIONS                                  *
+ ******************************************************************************/
+
+/**
+ * Returns the number of microseconds from the given time to now, on the
+ * monotonic clock.
+ */
+static long microseconds_since(const struct timespec *time) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - time->tv_sec) * 1000000L
+        + (now.tv_nsec - time->tv_nsec) / 1000;
+}
+
+/**
+ * Records the expiry of a timer and reschedules it, until it has expired
+ * FIRINGS times.
+ */
+static void timer_callback(wheel_timer_t *timer) {
+    checked_timer_t *checked = timer->arg;
+    struct timespec deadline = timing_wheel_expiry_time(&wheel, timer);
+
+    checked->lateness[checked->firings] = microseconds_since(&deadline);
+    checked->expiries[checked->firings] = timer->expiry;
+    checked->firings++;
+
+    if (checked->firings < FIRINGS) {
+        timing_wheel_reschedule(&wheel, timer, checked->period);
+        return;
+    }
+
+    pthread_mutex_lock(&done_mutex);
+    timers_done++;
+    pthread_cond_signal(&done_cond);
+    pthread_mutex_unlock(&done_mutex);
+}
+
+/*******************************************************************************
+ *                                   MAIN                                      *
+ ******************************************************************************/
+
+int main(void) {
+    int failures = 0;
+    int timer_failures;
+    checked_timer_t *checked;
+    uint64_t expected;
+    long minimum;
+    long maximum;
+
+    /*
+     * The timers are scheduled right after the wheel is initialized, on tick 0,
+     * so the ones whose periods are multiples of 64 ticks expire on the ticks
+     * where the higher levels are moved down.
+     */
+    timing_wheel_init(&wheel, TICK_MILLISECONDS);
+    for (size_t i = 0; i < NUMBER_OF_TIMERS; i++) {
+        timers[i].period = periods[i];
+        timers[i].timer.callback = timer_callback;
+        timers[i].timer.arg = &timers[i];
+        timing_wheel_schedule(&wheel, &timers[i].timer, periods[i]);
+        timers[i].first_expiry = timers[i].timer.expiry;
+    }
+    timing_wheel_start(&wheel);
+
+    pthread_mutex_lock(&done_mutex);
+    while (timers_done < (int) NUMBER_OF_TIMERS) {
+        pthread_cond_wait(&done_cond, &done_mutex);
+    }
+    pthread_mutex_unlock(&done_mutex);
+
+    printf("%-10s %-12s %-14s %14s %14s\n",
+           "Period", "First tick", "Phase", "Min late (us)", "Max late (us)");
+    for (size_t i = 0; i < NUMBER_OF_TIMERS; i++) {
+        checked = &timers[i];
+        minimum = maximum = checked->lateness[0];
+        timer_failures = 0;
+
+        for (int j = 0; j < FIRINGS; j++) {
+            expected = checked->first_expiry + j * (checked->period / TICK_MILLISECONDS);
+            if (checked->expiries[j] != expected) {
+                fprintf(stderr, "Timer with period %ld expired at tick %lu instead of %lu\n",
+                        checked->period, (unsigned long) checked->expiries[j],
+                        (unsigned long) expected);
+                timer_failures++;
+            }
+            if (checked->lateness[j] < 0) {
+                fprintf(stderr, "Timer with period %ld ran %ld us early\n",
+                        checked->period, -checked->lateness[j]);
+                timer_failures++;
+            }
+            minimum = checked->lateness[j] < minimum ? checked->lateness[j] : minimum;
+            maximum = checked->lateness[j] > maximum ? checked->lateness[j] : maximum;
+        }
+
+        printf("%-10ld %-12lu %-14s %14ld %14ld\n",
+               checked->period,
+               (unsigned long) checked->first_expiry,
+               timer_failures == 0 ? "in phase" : "out of phase",
+               minimum,
+               maximum);
+        failures += timer_failures;
+    }
+
+    if (failures != 0) {
+        fprintf(stderr, "%d failures\n", failures);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,178 @@
+/*
+ * Wal_Benchmark.c
+ *
+ * Measures how many requests per second can be committed to the write-ahead
+ * log (appended and then waited for until they are durable, the way the main
+ * thread does), and how long each commit takes, for several sync intervals
+ * and numbers of committing threads.
+ *
+ * The first row of each group syncs once per commit, without the log's sync
+ * thread: each commit writes its record and calls fdatasync itself, with the
+ * mutex that serializes appends locked. The other rows use the log with the
+ * given sync interval, so commits that arrive while a sync is running (or
+ * during the interval) share the next one.
+ *
+ * Build and run with:
+ *
+ *   make wal_benchmark
+ *
+ * The log is written to "wal_benchmark.log" in the current directory (or to
+ * the file given as the first argument), which is removed afterwards. The
+ * numbers depend on how long the file system takes to sync.
+ */
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+#include "errors.h"
+#include "types.h"
+#include "Alarm_Request.h"
+#include "Latency_Histogram.h"
+#include "Write_Ahead_Log.h"
+
+#define RUN_SECONDS 1.0
+#define SYNC_COUNT 1024
+#define MAXIMUM_COMMITTERS 16
+#define PER_COMMIT_SYNC -1      // Sync interval that means one sync per commit.
+
+static const int committer_counts[] = {1, 4, 16};
+static const int sync_intervals[] = {PER_COMMIT_SYNC, 0, 1, 5, 20};
+
+typedef struct run_t {
+    const char *path;
+    int sync_interval;
+    write_ahead_log_t wal;
+    int fd;                         // Only used with PER_COMMIT_SYNC.
+    pthread_mutex_t mutex;          // Serializes appends, like the alarm list
+                                    // mutex does in the program.
+    double end_time;
+    latency_histogram_t latencies;
+    atomic_ulong commits;
+} run_t;
+
+static double now_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void replay_nothing(alarm_request_t *alarm_request, void *arg) {
+    free_alarm_request(alarm_request);
+}
+
+/**
+ * Commits requests until the run is over.
+ */
+static void *committer_thread_routine(void *arg) {
+    run_t *run = arg;
+    alarm_request_t alarm_request;
+    char record[64];
+    unsigned long lsn;
+    uint64_t start;
+
+    memset(&alarm_request, 0, sizeof(alarm_request));
+    alarm_request.type = Start_Alarm;
+    alarm_request.time = 30000;
+    alarm_request.message = message_intern("benchmark message", strlen("benchmark message"));
+    memset(record, 'r', sizeof(record));
+
+    for (int i = 0; now_seconds() < run->end_time; i++) {
+        alarm_request.alarm_id = i;
+        start = latency_clock_now();
+
+        pthread_mutex_lock(&run->mutex);
+        if (run->sync_interval == PER_COMMIT_SYNC) {
+            if (write(run->fd, record, 20 + alarm_request.message->length) < 0
+                || fdatasync(run->fd) != 0) {
+                errno_abort("Write failed");
+            }
+            pthread_mutex_unlock(&run->mutex);
+        } else {
+            lsn = wal_append(&run->wal, &alarm_request);
+            pthread_mutex_unlock(&run->mutex);
+            wal_wait_durable(&run->wal, lsn);
+        }
+
+        latency_histogram_record_since(&run->latencies, start);
+        atomic_fetch_add_explicit(&run->commits, 1, memory_order_relaxed);
+    }
+
+    message_release(alarm_request.message);
+    return NULL;
+}
+
+static void benchmark(const char *path, int committers, int sync_interval) {
+    static run_t run;
+    pthread_t threads[MAXIMUM_COMMITTERS];
+    latency_histogram_statistics_t statistics;
+    unsigned long syncs;
+    double start;
+    double seconds;
+    char label[32];
+
+    unlink(path);
+    memset(&run, 0, sizeof(run));
+    run.path = path;
+    run.sync_interval = sync_interval;
+    run.latencies.name = "Commit";
+    pthread_mutex_init(&run.mutex, NULL);
+
+    if (sync_interval == PER_COMMIT_SYNC) {
+        run.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (run.fd < 0) {
+            errno_abort("Open failed");
+        }
+    } else {
+        wal_open(&run.wal, path, sync_interval, SYNC_COUNT, replay_nothing, NULL);
+    }
+
+    start = now_seconds();
+    run.end_time = start + RUN_SECONDS;
+    for (int i = 0; i < committers; i++) {
+        pthread_create(&threads[i], NULL, committer_thread_routine, &run);
+    }
+    for (int i = 0; i < committers; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    seconds = now_seconds() - start;
+
+    if (sync_interval == PER_COMMIT_SYNC) {
+        syncs = atomic_load(&run.commits);
+        close(run.fd);
+        snprintf(label, sizeof(label), "per commit");
+    } else {
+        syncs = wal_number_of_syncs(&run.wal);
+        wal_close(&run.wal);
+        snprintf(label, sizeof(label), "%d ms", sync_interval);
+    }
+    unlink(path);
+
+    statistics = latency_histogram_statistics(&run.latencies);
+    printf("%10d %12s %14.0f %12.0f %12.1f %12.1f %12.1f\n",
+           committers,
+           label,
+           statistics.count / seconds,
+           syncs / seconds,
+           syncs > 0 ? (double) statistics.count / syncs : 0.0,
+           statistics.p50 / 1000.0,
+           statistics.p99 / 1000.0);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = argc > 1 ? argv[1] : "wal_benchmark.log";
+
+    alarm_request_pool_init();
+
+    printf("%10s %12s %14s %12s %12s %12s %12s\n",
+           "committers", "sync", "commits/s", "syncs/s", "commits/sync",
+           "p50 (us)", "p99 (us)");
+
+    for (size_t i = 0; i < sizeof(committer_counts) / sizeof(committer_counts[0]); i++) {
+        for (size_t j = 0; j < sizeof(sync_intervals) / sizeof(sync_intervals[0]); j++) {
+            benchmark(path, committer_counts[i], sync_intervals[j]);
+        }
+    }
+
+    return 0;
+}
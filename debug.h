@@ -1,5 +1,6 @@
 #include <stdarg.h>
 #include "types.h"
+#include "Log_Writer.h"
 
 #ifndef DEBUG_H
 #define DEBUG_H
@@ -21,9 +22,9 @@
 static inline void debug_printf(const char *format, ...) {
     va_list args;
     va_start(args, format);
-    printf("\x1B[36m");
-    vprintf(format, args);
-    printf("\x1B[0m");
+    log_printf("\x1B[36m");
+    log_vprintf(format, args);
+    log_printf("\x1B[0m");
     va_end(args);
 }
 
@@ -50,12 +51,12 @@ static inline void debug_message(const char *message) {
 
 static inline void debug_print_alarm_request_without_newline(alarm_request_t *alarm_request) {
     debug_printf(
-        "{id: %d, type: %s, time: %d, message: %s, "
+        "{id: %d, type: %s, time: %s, message: %s, "
         "creation_time: %ld, next: %p}",
         alarm_request->alarm_id,
         request_type_string( alarm_request),
-        alarm_request->time,
-        alarm_request->message,
+        TIME_STRING(alarm_request->time),
+        alarm_request->message->text,
         alarm_request->creation_time,
         alarm_request->next
     );
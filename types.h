@@ -1,6 +1,10 @@
 #ifndef TYPES_H
 #define TYPES_H
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include "Message_Store.h"
 
 /**
  * The six possible types of commands that a user can enter.
@@ -13,15 +17,37 @@ typedef enum request_type {
 
 /**
  * Data structure representing an alarm request.
+ *
+ * An alarm request can be in one alarm list at a time. The next and prev
+ * pointers link it into the list (sorted by time value), and the id_hash_next
+ * and id_hash_prev pointers link it into the list's alarm ID index (see
+ * Alarm_List.h). The queue_next pointer links it into the queue of requests
+ * that the alarm thread has not handled yet. The bulk_next pointer links the
+ * alarm requests of one bulk request (see Command_Parser.h) behind the first
+ * of them, which stands for all of them in the alarm thread's queue and in the
+ * circular buffers.
+ *
+ * The fields used when alarm lists are searched, walked and relinked come
+ * first, so that they share a cache line; the message and the fields that are
+ * only used once per request come last.
  */
 typedef struct alarm_request_t {
     int alarm_id;
+    int time;                   // Period in milliseconds.
     request_type type;
-    int time;
-    char message[128];
-    time_t creation_time;
+    atomic_bool change_status;  // Atomic because periodic display threads
+                                // clear it in the alarm display list while
+                                // other display threads read it.
+    unsigned long sequence_number;
     struct alarm_request_t *next;
-    bool change_status;
+    struct alarm_request_t *prev;
+    struct alarm_request_t *id_hash_next;
+    struct alarm_request_t *id_hash_prev;
+
+    message_t *message;         // Owns one reference to the message.
+    time_t creation_time;
+    struct alarm_request_t *queue_next;
+    struct alarm_request_t *bulk_next;
 } alarm_request_t;
 
 /**
@@ -53,15 +79,48 @@ static inline const char *request_type_string(alarm_request_t *alarm_request) {
 }
 
 /**
- * Data type representing a periodic display thread. This is how the alarm
- * thread will create periodic display threads, and is the type of the parameter
- * that will be given to periodic display threads upon creation.
+ * The size of a buffer that can hold any time value formatted by format_time.
+ */
+#define TIME_STRING_SIZE 16
+
+/**
+ * Formats a time value (in milliseconds) as a number of seconds, with as many
+ * decimals as it needs (so whole seconds are printed as before, e.g. "5", and
+ * others like "0.25" or "1.5"). Returns the buffer.
+ */
+static inline const char *format_time(char buffer[TIME_STRING_SIZE], int milliseconds) {
+    int length = snprintf(buffer, TIME_STRING_SIZE, "%d", milliseconds / 1000);
+
+    if (milliseconds % 1000 != 0) {
+        snprintf(buffer + length, TIME_STRING_SIZE - length, ".%03d", milliseconds % 1000);
+
+        // Remove the trailing zeros of the decimals
+        length = strlen(buffer);
+        while (buffer[length - 1] == '0') {
+            buffer[--length] = 0;
+        }
+    }
+
+    return buffer;
+}
+
+/**
+ * Formats a time value into a temporary buffer that lasts until the end of the
+ * enclosing block, so it can be used directly as an argument of printf.
+ */
+#define TIME_STRING(milliseconds) \
+    format_time((char[TIME_STRING_SIZE]) {0}, (milliseconds))
+
+/**
+ * Data type representing a periodic display thread. This is what the alarm
+ * thread keeps in the time value index for each periodic display it creates.
+ * The display's periods run on shared worker threads, but it keeps its own
+ * display thread ID, which its messages are printed with.
  */
 typedef struct periodic_display_thread_t {
     int thread_id;
-    pthread_t thread;
-    int time;
-    struct periodic_display_thread_t *next;
+    int time;                   // In milliseconds.
+    struct periodic_display_t *display; // Told when this is retired.
 } periodic_display_thread_t;
 
 #endif